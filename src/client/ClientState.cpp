@@ -9,6 +9,9 @@
 extern bool execute_terminal_command(const std::string& command);
 
 namespace {
+  // editors write files in several steps
+  const auto config_change_debounce = std::chrono::milliseconds(20);
+
   KeySequence replace_logical_keys(KeySequence sequence) {
     for (auto& event : sequence) {
       if (event.key == Key::Shift)
@@ -38,6 +41,58 @@ namespace {
       sequence.emplace_back(key, KeyState::Up);
     return sequence;
   }
+
+  bool equal(const Filter& a, const Filter& b) {
+    return (a.string == b.string && a.invert == b.invert);
+  }
+
+  bool equal(const GrabDeviceFilter& a, const GrabDeviceFilter& b) {
+    return (equal(static_cast<const Filter&>(a), b) && a.by_id == b.by_id);
+  }
+
+  // only compares what is sent to the server
+  bool equal(const Config::Context& a, const Config::Context& b) {
+    return (a.begin_stage == b.begin_stage &&
+      std::equal(a.inputs.begin(), a.inputs.end(),
+        b.inputs.begin(), b.inputs.end(),
+        [](const Config::Input& a, const Config::Input& b) {
+          return (a.input == b.input && a.output_index == b.output_index);
+        }) &&
+      a.outputs == b.outputs &&
+      std::equal(a.command_outputs.begin(), a.command_outputs.end(),
+        b.command_outputs.begin(), b.command_outputs.end(),
+        [](const Config::CommandOutput& a, const Config::CommandOutput& b) {
+          return (a.output == b.output && a.index == b.index);
+        }) &&
+      equal(a.device_filter, b.device_filter) &&
+      equal(a.device_id_filter, b.device_id_filter) &&
+      a.modifier_filter == b.modifier_filter &&
+      a.invert_modifier_filter == b.invert_modifier_filter &&
+      a.fallthrough == b.fallthrough);
+  }
+
+  // returns false when the configuration cannot be updated context-wise
+  bool get_updated_contexts(const Config& prev, const Config& config,
+      std::vector<int>* indices) {
+    if (prev.contexts.size() != config.contexts.size() ||
+        prev.server_directives != config.server_directives ||
+        !std::equal(prev.grab_device_filters.begin(), prev.grab_device_filters.end(),
+          config.grab_device_filters.begin(), config.grab_device_filters.end(),
+          [](const GrabDeviceFilter& a, const GrabDeviceFilter& b) { return equal(a, b); }))
+      return false;
+
+    indices->clear();
+    for (auto i = 0; i < static_cast<int>(config.contexts.size()); ++i) {
+      const auto& a = prev.contexts[i];
+      const auto& b = config.contexts[i];
+      // stages cannot be updated
+      if (a.begin_stage != b.begin_stage)
+        return false;
+      if (!equal(a, b))
+        indices->push_back(i);
+    }
+    return true;
+  }
 } // namespace
 
 void ClientState::on_execute_action_message(int triggered_action) {
@@ -46,9 +101,10 @@ void ClientState::on_execute_action_message(int triggered_action) {
       triggered_action < static_cast<int>(actions.size())) {
     const auto& action = actions[triggered_action];
     const auto& command = action.terminal_command;
+    const auto begin = Clock::now();
     const auto succeeded = execute_terminal_command(command);
-    verbose("Executing terminal command '%s'%s", 
-      command.c_str(), succeeded ? "" : " failed");
+    verbose("Executing terminal command '%s'%s (%.2fms)", command.c_str(),
+      succeeded ? "" : " failed", Duration(Clock::now() - begin).count() * 1000);
   }
 }
 
@@ -61,9 +117,9 @@ void ClientState::on_set_virtual_key_state_message(Key key, KeyState state) {
 }
 
 bool ClientState::on_set_config_file_message(std::string filename) {
-  if (load_config(filename))
-    return send_config();
-  return false;
+  const auto loaded = load_config(filename);
+  update_config_watcher();
+  return (loaded && send_config());
 }
 
 const std::filesystem::path& ClientState::config_filename() const {
@@ -76,6 +132,7 @@ bool ClientState::is_focused_window_inaccessible() const {
 
 std::optional<Socket> ClientState::connect_server() {
   verbose("Connecting to keymapperd");
+  m_sent_config.reset();
   if (m_server.connect())
     return m_server.socket();
   error("Connecting to keymapperd failed");
@@ -87,6 +144,7 @@ bool ClientState::read_server_messages(std::optional<Duration> timeout) {
 }
 
 void ClientState::on_server_disconnected() {
+  m_sent_config.reset();
   m_control.reset();
   m_server.disconnect();
   m_focused_window.shutdown();
@@ -121,18 +179,73 @@ bool ClientState::load_config(std::filesystem::path filename) {
 }
 
 bool ClientState::update_config(bool check_modified) {
+  if (check_modified && m_config_watcher.fd() >= 0) {
+    // reload once watched files did not change for a moment
+    if (m_config_watcher.read_changes())
+      m_config_changed_time = Clock::now();
+    if (!m_config_changed_time ||
+        Clock::now() < *m_config_changed_time + config_change_debounce)
+      return false;
+    m_config_changed_time.reset();
+    const auto updated = m_config_file.update(true);
+    // files might have been replaced and includes changed
+    update_config_watcher();
+    if (!updated)
+      return false;
+    notify("Configuration updated");
+    return true;
+  }
   if (!m_config_file.update(check_modified))
     return false;
+  update_config_watcher();
   notify("Configuration updated");
   return true;
 }
 
+bool ClientState::watch_config() {
+  m_watch_config = true;
+  update_config_watcher();
+  return (m_config_watcher.fd() >= 0);
+}
+
+void ClientState::update_config_watcher() {
+  if (!m_watch_config)
+    return;
+  auto filenames = m_config_file.config().include_filenames;
+  filenames.insert(filenames.begin(), m_config_file.filename());
+  m_config_watcher.watch(filenames);
+}
+
+std::optional<Duration> ClientState::get_config_change_timeout() const {
+  if (!m_config_changed_time)
+    return { };
+  return std::max(Duration::zero(), Duration(
+    *m_config_changed_time + config_change_debounce - Clock::now()));
+}
+
 bool ClientState::send_config() {
-  verbose("Sending configuration");
-  if (!m_server.send_config(m_config_file.config())) {
-    error("Sending configuration failed");
-    return false;
+  // only send changed contexts, so the server can keep its state
+  const auto& config = m_config_file.config();
+  auto updated_contexts = std::vector<int>();
+  if (m_sent_config &&
+      get_updated_contexts(*m_sent_config, config, &updated_contexts)) {
+    verbose("Sending configuration update (%u contexts)",
+      updated_contexts.size());
+    if (!updated_contexts.empty() &&
+        !m_server.send_config_update(config, updated_contexts)) {
+      error("Sending configuration failed");
+      return false;
+    }
   }
+  else {
+    verbose("Sending configuration");
+    if (!m_server.send_config(config)) {
+      error("Sending configuration failed");
+      return false;
+    }
+  }
+  m_sent_config = config;
+  m_context_matcher.set_contexts(config.contexts);
 
   m_control.set_virtual_key_aliases(
     m_config_file.config().virtual_key_aliases);
@@ -182,14 +295,11 @@ bool ClientState::update_active_contexts() {
       return false;
   }
 
-  m_new_active_contexts.clear();
-  const auto& contexts = m_config_file.config().contexts;
-  for (auto i = 0; i < static_cast<int>(contexts.size()); ++i)
-    if (contexts[i].matches(
-        m_focused_window.window_class(),
-        m_focused_window.window_title(),
-        m_focused_window.window_path()))
-      m_new_active_contexts.push_back(i);
+  m_context_matcher.match(
+    m_focused_window.window_class(),
+    m_focused_window.window_title(),
+    m_focused_window.window_path(),
+    &m_new_active_contexts);
 
   if (m_new_active_contexts != m_active_contexts) {
     verbose("Active contexts updated");
@@ -216,6 +326,25 @@ void ClientState::read_control_messages() {
   m_control.read_messages(*this);
 }
 
+void ClientState::read_control_messages(
+    const std::vector<Socket>& readable_sockets) {
+  m_control.read_messages(*this, readable_sockets);
+}
+
+bool ClientState::get_wait_sockets(std::vector<Socket>* sockets) const {
+  if (m_server.socket() != invalid_socket)
+    sockets->push_back(m_server.socket());
+  m_control.get_sockets(sockets);
+  if (m_config_watcher.fd() >= 0)
+    sockets->push_back(static_cast<Socket>(m_config_watcher.fd()));
+
+  auto fds = std::vector<int>();
+  const auto waitable = m_focused_window.get_poll_fds(&fds);
+  for (auto fd : fds)
+    sockets->push_back(static_cast<Socket>(fd));
+  return waitable;
+}
+
 void ClientState::on_next_key_info_message(Key key, DeviceDesc device) {
   extern const char* current_system;
   auto ss = std::stringstream();
@@ -247,6 +376,15 @@ void ClientState::on_next_key_info_requested_message() {
   request_next_key_info();
 }
 
+void ClientState::on_latency_report_requested_message(bool chrome_trace) {
+  m_server.send_request_latency_report(chrome_trace);
+}
+
+void ClientState::on_latency_report_message(const std::string& report) {
+  if (!m_control.reply_latency_report(report))
+    message("%s", report.c_str());
+}
+
 void ClientState::request_next_key_info() {
   m_server.send_request_next_key_info();
 }
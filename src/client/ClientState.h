@@ -2,8 +2,10 @@
 
 #include "client/FocusedWindow.h"
 #include "client/ConfigFile.h"
+#include "client/FileWatcher.h"
 #include "client/ServerPort.h"
 #include "client/ControlPort.h"
+#include "config/ContextMatcher.h"
 
 class ClientState : public ServerPort::MessageHandler,
                     public ControlPort::MessageHandler {
@@ -14,6 +16,10 @@ public:
 
   bool load_config(std::filesystem::path filename);
   bool update_config(bool check_modified);
+  // returns false when config file needs to be polled
+  bool watch_config();
+  // time until a change of the watched config file should be applied
+  std::optional<Duration> get_config_change_timeout() const;
   std::optional<Socket> connect_server();
   bool read_server_messages(std::optional<Duration> timeout = { });
   void on_server_disconnected();
@@ -27,29 +33,42 @@ public:
   std::optional<Socket> listen_for_control_connections();
   std::optional<Socket> accept_control_connection();
   void read_control_messages();
+  void read_control_messages(const std::vector<Socket>& readable_sockets);
   void request_next_key_info();
+  // returns false when focused window needs to be polled
+  bool get_wait_sockets(std::vector<Socket>* sockets) const;
 
 protected:
   // server messages
   void on_execute_action_message(int triggered_action) override;
   void on_virtual_key_state_message(Key key, KeyState state) override;
   void on_next_key_info_message(Key key, DeviceDesc device) override;
+  void on_latency_report_message(const std::string& report) override;
 
   // control messages
   void on_set_virtual_key_state_message(Key key, KeyState state) override;
   bool on_set_config_file_message(std::string filename) override;
   void on_next_key_info_requested_message() override;
+  void on_latency_report_requested_message(bool chrome_trace) override;
   bool on_inject_input_message(const std::string& string) override;
   bool on_inject_output_message(const std::string& string) override;
 
   virtual void show_next_key_info(const std::string& next_key_info);
 
 private:
+  void update_config_watcher();
+
   ConfigFile m_config_file;
+  FileWatcher m_config_watcher;
+  bool m_watch_config{ };
+  std::optional<Clock::time_point> m_config_changed_time;
+  // the configuration the server received last
+  std::optional<Config> m_sent_config;
   std::vector<ConfigFile> m_recent_config_files;
   ServerPort m_server;
   ControlPort m_control;
   FocusedWindow m_focused_window;
+  ContextMatcher m_context_matcher;
   std::vector<int> m_active_contexts;
   std::vector<int> m_new_active_contexts;
   bool m_active{ true };
@@ -1,41 +1,33 @@
 
 #include "ConfigFile.h"
 #include "config/ParseConfig.h"
+#include "config/ConfigCache.h"
 #include "common/output.h"
 #include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <iterator>
 
 #if defined(_WIN32)
 
 #include "common/windows/win.h"
 
 namespace {
-  std::time_t filetime_to_time_t(const FILETIME& ft) {
-    auto ull = ULARGE_INTEGER{ };
-    ull.LowPart = ft.dwLowDateTime;
-    ull.HighPart = ft.dwHighDateTime;
-    return ull.QuadPart / 10000000ULL - 11644473600ULL;
-  }
-
-  std::time_t get_modify_time(const std::filesystem::path& filename) {
-    auto file_attr_data = WIN32_FILE_ATTRIBUTE_DATA{ };
-    if (!GetFileAttributesExW(filename.c_str(),
-        GetFileExInfoStandard, &file_attr_data))
-      return { };
-    return filetime_to_time_t(file_attr_data.ftLastWriteTime);
+  std::filesystem::path get_cache_path() {
+    if (auto dir = std::getenv("LOCALAPPDATA"))
+      return std::filesystem::path(dir) / "keymapper";
+    return { };
   }
 } // namespace
 
 #else // !defined(_WIN32)
 
-#include <sys/stat.h>
-
 namespace {
-  std::time_t get_modify_time(const std::string& filename) {
-    using stat_t = struct stat;
-    auto st = stat_t{ };
-    if (::stat(filename.c_str(), &st) == 0)
-      return st.st_mtime;
+  std::filesystem::path get_cache_path() {
+    if (auto dir = std::getenv("XDG_CACHE_HOME"))
+      return std::filesystem::path(dir) / "keymapper";
+    if (auto homedir = std::getenv("HOME"))
+      return std::filesystem::path(homedir) / ".cache" / "keymapper";
     return { };
   }
 } // namespace
@@ -43,21 +35,51 @@ namespace {
 #endif // !defined(_WIN32)
 
 namespace {
-  std::time_t get_latest_modify_time(const std::filesystem::path& filename, 
+  using FileTime = std::filesystem::file_time_type;
+
+  FileTime get_modify_time(const std::filesystem::path& filename) {
+    auto error = std::error_code{ };
+    const auto time = std::filesystem::last_write_time(filename, error);
+    return (error ? FileTime{ } : time);
+  }
+
+  FileTime get_latest_modify_time(const std::filesystem::path& filename, 
       const std::vector<std::filesystem::path>& include_filenames) {
     auto time = get_modify_time(filename);
-    if (time)
+    if (time != FileTime{ })
       for (const auto& include_filename : include_filenames)
-        if (const auto include_time = get_modify_time(include_filename))
-          time = std::max(time, include_time);
+        time = std::max(time, get_modify_time(include_filename));
     return time;
   }
+
+  size_t get_contents_hash(const std::filesystem::path& filename, 
+      const std::vector<std::filesystem::path>& include_filenames) {
+    auto contents = std::string();
+    const auto append = [&](const std::filesystem::path& filename) {
+      auto is = std::ifstream(filename, std::ios::binary);
+      contents.append(std::istreambuf_iterator<char>(is), { });
+      contents.push_back('\0');
+    };
+    append(filename);
+    for (const auto& include_filename : include_filenames)
+      append(include_filename);
+    return std::hash<std::string>{ }(contents);
+  }
+
+  std::filesystem::path get_cache_filename(const std::filesystem::path& filename) {
+    const auto path = get_cache_path();
+    if (path.empty())
+      return { };
+    char name[32];
+    std::snprintf(name, sizeof(name), "config-%016llx.cache",
+      static_cast<unsigned long long>(std::filesystem::hash_value(filename)));
+    return path / name;
+  }
 } // namespace
 
 bool ConfigFile::load(std::filesystem::path filename) {
   m_filename = std::move(filename);
-  m_modify_time = { -1 };
-  return update();
+  return update(false);
 }
 
 bool ConfigFile::update(bool check_modified) {
@@ -67,11 +89,42 @@ bool ConfigFile::update(bool check_modified) {
       modify_time == m_modify_time)
     return false;
   m_modify_time = modify_time;
+
+  // ignore when only the modification time changed
+  const auto contents_hash = get_contents_hash(
+    m_filename, m_config.include_filenames);
+  if (check_modified &&
+      contents_hash == m_contents_hash)
+    return false;
+  m_contents_hash = contents_hash;
+
+  const auto set_config = [&](Config config) {
+    // also check new include files from now on
+    if (config.include_filenames != m_config.include_filenames) {
+      m_modify_time = get_latest_modify_time(
+        m_filename, config.include_filenames);
+      m_contents_hash = get_contents_hash(
+        m_filename, config.include_filenames);
+    }
+    m_config = std::move(config);
+  };
   try {
+    // skip parsing when configuration did not change since it was cached
+    const auto cache = ConfigCache(get_cache_filename(m_filename));
+    if (auto config = cache.read(m_filename)) {
+      verbose("Read configuration from cache");
+      set_config(std::move(*config));
+      return true;
+    }
+
     auto is = std::ifstream(m_filename);
     if (is.good()) {
       auto parse = ParseConfig();
-      m_config = parse(is, m_filename.parent_path());
+      set_config(parse(is, m_filename.parent_path()));
+      if (m_config.include_filenames_expanded)
+        verbose("Not caching configuration with expanded include paths");
+      else if (!cache.write(m_filename, m_config))
+        verbose("Writing configuration cache failed");
       return true;
     }
     else {
@@ -1,13 +1,14 @@
 #pragma once
 
 #include "config/Config.h"
-#include <ctime>
 #include <string>
 #include <filesystem>
 
 class ConfigFile {
 public:
   bool load(std::filesystem::path filename);
+  // when checking, only reparses when a file was modified and its
+  // contents changed
   bool update(bool check_modified = true);
   const Config& config() const { return m_config; }
   const std::filesystem::path& filename() const { return m_filename; }
@@ -15,6 +16,7 @@ public:
 
 private:
   std::filesystem::path m_filename;
-  std::time_t m_modify_time{ -1 };
+  std::filesystem::file_time_type m_modify_time{ };
+  size_t m_contents_hash{ };
   Config m_config;
 };
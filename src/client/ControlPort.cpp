@@ -2,10 +2,11 @@
 #include "ControlPort.h"
 #include "config/get_key_name.h"
 #include <algorithm>
+#include <functional>
 #include <utility>
 
-ControlPort::ControlPort() 
-  : m_host("keymapperctl") {
+ControlPort::ControlPort(std::string ipc_id) 
+  : m_host(std::move(ipc_id)) {
 }
 
 void ControlPort::reset() {
@@ -13,6 +14,8 @@ void ControlPort::reset() {
   m_virtual_keys_down = { };
   m_virtual_key_aliases = { };
   m_controls.clear();
+  m_virtual_key_subscribers = { };
+  m_all_virtual_keys_subscribers.clear();
 }
 
 std::optional<Socket> ControlPort::listen() {
@@ -30,6 +33,13 @@ std::optional<Socket> ControlPort::accept() {
   return { };
 }
 
+void ControlPort::get_sockets(std::vector<Socket>* sockets) const {
+  if (m_host.listen_socket() != invalid_socket)
+    sockets->push_back(m_host.listen_socket());
+  for (const auto& [socket, control] : m_controls)
+    sockets->push_back(socket);
+}
+
 void ControlPort::set_virtual_key_aliases(
     std::vector<std::pair<std::string, Key>> aliases) {
   m_virtual_key_aliases = std::move(aliases);
@@ -38,10 +48,70 @@ void ControlPort::set_virtual_key_aliases(
 void ControlPort::on_virtual_key_state_changed(Key key, KeyState state) {
   if (is_virtual_key(key)) {
     m_virtual_keys_down[*key - *Key::first_virtual] = (state == KeyState::Down);
+    ++m_virtual_key_change_sequence;
     send_virtual_key_toggle_notification(key);
+    send_virtual_key_state_changes(key);
+  }
+}
+
+void ControlPort::send_virtual_key_state_changes(Key key) {
+  for (const auto& subscribers : { 
+      std::cref(m_virtual_key_subscribers[*key - *Key::first_virtual]),
+      std::cref(m_all_virtual_keys_subscribers) })
+    for (auto socket : subscribers.get())
+      if (auto it = m_controls.find(socket); it != m_controls.end())
+        send_virtual_key_state_change(it->second.connection, key);
+}
+
+bool ControlPort::send_virtual_key_state_change(Connection& connection, Key key) {
+  return connection.send_message([&](Serializer& s) {
+    s.write(MessageType::virtual_key_state_change);
+    s.write(key);
+    s.write(get_virtual_key_state(key));
+    s.write(m_virtual_key_change_sequence);
+  });
+}
+
+void ControlPort::on_virtual_key_states_subscribed(Connection& connection,
+    const std::vector<Key>& keys) {
+  auto control = get_control(connection);
+  if (!control)
+    return;
+
+  // subscribing without keys subscribes to all, then send current states
+  const auto socket = connection.socket();
+  if (keys.empty()) {
+    if (!std::exchange(control->subscribed_all_virtual_keys, true))
+      m_all_virtual_keys_subscribers.push_back(socket);
+    for (auto i = 0; i < virtual_key_count; ++i)
+      if (m_virtual_keys_down[i])
+        send_virtual_key_state_change(connection,
+          static_cast<Key>(*Key::first_virtual + i));
+    return;
+  }
+  for (auto key : keys) {
+    auto& subscribed = control->subscribed_virtual_keys;
+    if (std::find(subscribed.begin(), subscribed.end(), key) == subscribed.end()) {
+      subscribed.push_back(key);
+      m_virtual_key_subscribers[*key - *Key::first_virtual].push_back(socket);
+    }
+    send_virtual_key_state_change(connection, key);
   }
 }
 
+auto ControlPort::erase_control(ControlMap::iterator it) -> ControlMap::iterator {
+  const auto socket = it->first;
+  const auto unsubscribe = [&](std::vector<Socket>& subscribers) {
+    subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), socket),
+      subscribers.end());
+  };
+  for (auto key : it->second.subscribed_virtual_keys)
+    unsubscribe(m_virtual_key_subscribers[*key - *Key::first_virtual]);
+  if (it->second.subscribed_all_virtual_keys)
+    unsubscribe(m_all_virtual_keys_subscribers);
+  return m_controls.erase(it);
+}
+
 void ControlPort::send_virtual_key_toggle_notification(Key key) {
   for (auto& [socket, control] : m_controls)
     if (control.requested_virtual_key_toggle_notification == key) {
@@ -111,7 +181,7 @@ void ControlPort::disconnect_by_instance_id(const std::string& id) {
 
   for (auto it = m_controls.begin(); it != m_controls.end(); ) {
     if (it->second.instance_id == id) {
-      it = m_controls.erase(it);
+      it = erase_control(it);
     }
     else {
       ++it;
@@ -122,7 +192,7 @@ void ControlPort::disconnect_by_instance_id(const std::string& id) {
 void ControlPort::read_messages(MessageHandler& handler) {
   for (auto it = m_controls.begin(); it != m_controls.end(); ) {
     if (!read_messages(it->second.connection, handler)) {
-      it = m_controls.erase(it);
+      it = erase_control(it);
     }
     else {
       ++it;
@@ -130,6 +200,23 @@ void ControlPort::read_messages(MessageHandler& handler) {
   }
 }
 
+void ControlPort::read_messages(MessageHandler& handler,
+    const std::vector<Socket>& readable_sockets) {
+  for (auto socket : readable_sockets) {
+    if (socket == m_host.listen_socket()) {
+      // accept all pending connections
+      while (accept()) { }
+      continue;
+    }
+    // look up each socket, since a message of a previous one can have
+    // disconnected it already (see disconnect_by_instance_id)
+    const auto it = m_controls.find(socket);
+    if (it != m_controls.end() && 
+        !read_messages(it->second.connection, handler))
+      erase_control(it);
+  }
+}
+
 void ControlPort::on_next_key_info_requested(Connection& connection) {
   if (auto control = get_control(connection))
     control->requested_next_key_info = true;
@@ -148,6 +235,24 @@ bool ControlPort::reply_next_key_info(const std::string& key_info) {
   return requested;
 }
 
+void ControlPort::on_latency_report_requested(Connection& connection) {
+  if (auto control = get_control(connection))
+    control->requested_latency_report = true;
+}
+
+bool ControlPort::reply_latency_report(const std::string& report) {
+  auto requested = false;
+  for (auto& [socket, control] : m_controls)
+    if (std::exchange(control.requested_latency_report, false)) {
+      control.connection.send_message([&](Serializer& s) {
+        s.write(MessageType::latency_report);
+        s.write(report);
+      });
+      requested = true;
+    }
+  return requested;
+}
+
 bool ControlPort::read_messages(Connection& connection, 
     MessageHandler& handler) {
   return connection.read_messages(Duration::zero(), 
@@ -186,6 +291,25 @@ bool ControlPort::read_messages(Connection& connection,
           handler.on_next_key_info_requested_message();
           break;
         }
+        case MessageType::subscribe_virtual_key_states: {
+          auto keys = std::vector<Key>();
+          // count is not trusted, stop when message ends
+          const auto count = d.read<uint32_t>();
+          for (auto i = 0u; i < count && d.can_read(sizeof(uint32_t)); ++i)
+            if (const auto key = get_virtual_key(d.read_string()); key != Key::none)
+              keys.push_back(key);
+          // do not subscribe to all, when no key was found
+          if (count != 0 && keys.empty())
+            send_virtual_key_state(connection, Key::none);
+          else
+            on_virtual_key_states_subscribed(connection, keys);
+          break;
+        }
+        case MessageType::latency_report: {
+          on_latency_report_requested(connection);
+          handler.on_latency_report_requested_message(d.read<bool>());
+          break;
+        }
         case MessageType::inject_input: {
           const auto result = handler.on_inject_input_message(d.read_string());
           send_virtual_key_state(connection, Key::none, 
@@ -11,30 +11,42 @@
 
 class ControlPort {
 public:
-  ControlPort();
+  explicit ControlPort(std::string ipc_id = "keymapperctl");
   void reset();
   std::optional<Socket> listen();
   std::optional<Socket> accept();
+  void get_sockets(std::vector<Socket>* sockets) const;
   void set_virtual_key_aliases(std::vector<std::pair<std::string, Key>> aliases);
   void on_virtual_key_state_changed(Key key, KeyState state);
   bool reply_next_key_info(const std::string& key_info);
+  bool reply_latency_report(const std::string& report);
 
   struct MessageHandler {
     virtual void on_set_virtual_key_state_message(Key key, KeyState state) = 0;
     virtual bool on_set_config_file_message(std::string filename) = 0;
     virtual void on_next_key_info_requested_message() = 0;
+    virtual void on_latency_report_requested_message(bool chrome_trace) = 0;
     virtual bool on_inject_input_message(const std::string& string) = 0;
     virtual bool on_inject_output_message(const std::string& string) = 0;
   };
   void read_messages(MessageHandler& handler);
+  void read_messages(MessageHandler& handler,
+    const std::vector<Socket>& readable_sockets);
 
 private:
+  static constexpr auto virtual_key_count = 
+    *Key::last_virtual - *Key::first_virtual + 1;
+
   struct Control {
     Connection connection;
     std::string instance_id;
     Key requested_virtual_key_toggle_notification{ };
     bool requested_next_key_info{ };
+    bool requested_latency_report{ };
+    std::vector<Key> subscribed_virtual_keys;
+    bool subscribed_all_virtual_keys{ };
   };
+  using ControlMap = std::map<Socket, Control>;
 
   Control* get_control(const Connection& connection);
   Key get_virtual_key(const std::string_view name) const;
@@ -46,11 +58,21 @@ private:
   void on_virtual_key_toggle_notification_requested(
     Connection& connection, Key key);
   void on_next_key_info_requested(Connection& connection);
+  void on_latency_report_requested(Connection& connection);
   void on_set_instance_id(Connection& connection, std::string id);
   void disconnect_by_instance_id(const std::string& id);
+  void on_virtual_key_states_subscribed(Connection& connection,
+    const std::vector<Key>& keys);
+  void send_virtual_key_state_changes(Key key);
+  bool send_virtual_key_state_change(Connection& connection, Key key);
+  ControlMap::iterator erase_control(ControlMap::iterator it);
 
   Host m_host;
-  std::array<bool, *Key::last_virtual - *Key::first_virtual> m_virtual_keys_down{ };
+  std::array<bool, virtual_key_count> m_virtual_keys_down{ };
   std::vector<std::pair<std::string, Key>> m_virtual_key_aliases;
-  std::map<Socket, Control> m_controls;
+  ControlMap m_controls;
+  // subscribers of each virtual key's state changes
+  std::array<std::vector<Socket>, virtual_key_count> m_virtual_key_subscribers;
+  std::vector<Socket> m_all_virtual_keys_subscribers;
+  uint64_t m_virtual_key_change_sequence{ };
 };
@@ -0,0 +1,123 @@
+
+#include "FileWatcher.h"
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+  const auto directory_events = static_cast<uint32_t>(IN_CLOSE_WRITE |
+    IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+  const auto file_events = static_cast<uint32_t>(IN_CLOSE_WRITE |
+    IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF);
+
+  bool contains(const std::vector<std::string>& names, const char* name) {
+    return std::find(names.begin(), names.end(), name) != names.end();
+  }
+} // namespace
+
+FileWatcher::~FileWatcher() {
+  reset();
+}
+
+bool FileWatcher::watch(const std::vector<std::filesystem::path>& filenames) {
+  // keep descriptor, so no event is lost while watches are updated
+  if (m_fd < 0)
+    m_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_fd < 0)
+    return false;
+
+  // adding a watch again returns its descriptor
+  auto directories = decltype(m_directories)();
+  auto files = decltype(m_files)();
+  for (const auto& filename : filenames) {
+    auto directory = filename.parent_path();
+    if (directory.empty())
+      directory = ".";
+    const auto wd = ::inotify_add_watch(m_fd, directory.c_str(), directory_events);
+    if (wd >= 0) {
+      auto it = std::find_if(directories.begin(), directories.end(),
+        [&](const auto& entry) { return entry.first == wd; });
+      if (it == directories.end())
+        it = directories.insert(it, { wd, { } });
+      it->second.push_back(filename.filename().string());
+    }
+
+    // also notice writes to targets of symlinks
+    const auto file_wd = ::inotify_add_watch(m_fd, filename.c_str(), file_events);
+    if (file_wd >= 0)
+      files.push_back(file_wd);
+  }
+
+  // remove watches which are no longer needed
+  const auto is_watched = [&](int wd) {
+    return (std::count(files.begin(), files.end(), wd) ||
+      std::count_if(directories.begin(), directories.end(),
+        [&](const auto& entry) { return entry.first == wd; }));
+  };
+  for (const auto& [wd, names] : m_directories)
+    if (!is_watched(wd))
+      ::inotify_rm_watch(m_fd, wd);
+  for (auto wd : m_files)
+    if (!is_watched(wd))
+      ::inotify_rm_watch(m_fd, wd);
+
+  m_directories = std::move(directories);
+  m_files = std::move(files);
+  return true;
+}
+
+void FileWatcher::reset() {
+  if (m_fd >= 0)
+    ::close(std::exchange(m_fd, -1));
+  m_directories.clear();
+  m_files.clear();
+}
+
+bool FileWatcher::read_changes() {
+  if (m_fd < 0)
+    return false;
+
+  alignas(inotify_event) char buffer[4096];
+  auto changed = false;
+  for (;;) {
+    const auto size = ::read(m_fd, buffer, sizeof(buffer));
+    if (size <= 0)
+      break;
+    for (auto offset = ssize_t{ }; offset < size; ) {
+      const auto& event = *reinterpret_cast<const inotify_event*>(buffer + offset);
+      offset += static_cast<ssize_t>(sizeof(inotify_event) + event.len);
+
+      if ((event.mask & IN_Q_OVERFLOW) ||
+          std::count(m_files.begin(), m_files.end(), event.wd)) {
+        changed = true;
+      }
+      else if (event.len) {
+        const auto it = std::find_if(m_directories.begin(), m_directories.end(),
+          [&](const auto& entry) { return entry.first == event.wd; });
+        if (it != m_directories.end() && contains(it->second, event.name))
+          changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+#else // !defined(__linux__)
+
+FileWatcher::~FileWatcher() = default;
+
+bool FileWatcher::watch(const std::vector<std::filesystem::path>&) {
+  return false;
+}
+
+void FileWatcher::reset() {
+}
+
+bool FileWatcher::read_changes() {
+  return false;
+}
+
+#endif // !defined(__linux__)
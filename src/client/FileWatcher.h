@@ -0,0 +1,32 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Descriptor which becomes readable when one of the watched files is
+// written, created, replaced or removed. The directories are watched too,
+// so files which editors replace by renaming on save are not lost.
+// Only supported on Linux, otherwise the files need to be polled.
+class FileWatcher {
+public:
+  FileWatcher() = default;
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+  ~FileWatcher();
+
+  int fd() const { return m_fd; }
+  // replaces the watched files, returns false when not supported
+  bool watch(const std::vector<std::filesystem::path>& filenames);
+  void reset();
+  // returns true when a watched file changed since last call
+  bool read_changes();
+
+private:
+  int m_fd{ -1 };
+  // watch descriptor of a directory and the names watched in it
+  std::vector<std::pair<int, std::vector<std::string>>> m_directories;
+  // watch descriptors of the files themselves (following symlinks)
+  std::vector<int> m_files;
+};
@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 class FocusedWindow {
 public:
@@ -13,6 +14,8 @@ public:
   bool initialize();
   void shutdown();
   bool update();
+  // returns false when update needs to be polled
+  bool get_poll_fds(std::vector<int>* fds) const;
   const std::string& window_class() const;
   const std::string& window_title() const;
   const std::string& window_path() const;
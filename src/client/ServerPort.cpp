@@ -2,6 +2,13 @@
 #include "ServerPort.h"
 #include "common/MessageType.h"
 
+#if defined(__linux__)
+#include "runtime/StageImage.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 namespace {
   void write_key_sequence(Serializer& s, const KeySequence& sequence) {
     s.write(static_cast<uint32_t>(sequence.size()));
@@ -14,45 +21,48 @@ namespace {
     s.write(filter.invert);
   }
 
-  void write_contexts(Serializer& s, 
-      const std::vector<Config::Context>& contexts) {
-    s.write(static_cast<uint32_t>(contexts.size()));
-    for (const auto& context : contexts) {
-      // begin stage
-      s.write(context.begin_stage);
-
-      // inputs
-      s.write(static_cast<uint32_t>(context.inputs.size()));
-      for (const auto& input : context.inputs) {
-        write_key_sequence(s, input.input);
-        s.write(static_cast<int32_t>(input.output_index));
-      }
+  void write_context(Serializer& s, const Config::Context& context) {
+    // begin stage
+    s.write(context.begin_stage);
 
-      // outputs
-      s.write(static_cast<uint32_t>(context.outputs.size()));
-      for (const auto& output : context.outputs)
-        write_key_sequence(s, output);
+    // inputs
+    s.write(static_cast<uint32_t>(context.inputs.size()));
+    for (const auto& input : context.inputs) {
+      write_key_sequence(s, input.input);
+      s.write(static_cast<int32_t>(input.output_index));
+    }
 
-      // command outputs
-      s.write(static_cast<uint32_t>(context.command_outputs.size()));
-      for (const auto& command : context.command_outputs) {
-        write_key_sequence(s, command.output);
-        s.write(static_cast<int32_t>(command.index));
-      }
+    // outputs
+    s.write(static_cast<uint32_t>(context.outputs.size()));
+    for (const auto& output : context.outputs)
+      write_key_sequence(s, output);
 
-      // device filter
-      write_filter(s, context.device_filter);
-      
-      // device-id filter
-      write_filter(s, context.device_id_filter);
-      
-      // modifier filter
-      write_key_sequence(s, context.modifier_filter);
-      s.write(context.invert_modifier_filter);
-
-      // fallthrough
-      s.write(context.fallthrough);
+    // command outputs
+    s.write(static_cast<uint32_t>(context.command_outputs.size()));
+    for (const auto& command : context.command_outputs) {
+      write_key_sequence(s, command.output);
+      s.write(static_cast<int32_t>(command.index));
     }
+
+    // device filter
+    write_filter(s, context.device_filter);
+    
+    // device-id filter
+    write_filter(s, context.device_id_filter);
+    
+    // modifier filter
+    write_key_sequence(s, context.modifier_filter);
+    s.write(context.invert_modifier_filter);
+
+    // fallthrough
+    s.write(context.fallthrough);
+  }
+
+  void write_contexts(Serializer& s, 
+      const std::vector<Config::Context>& contexts) {
+    s.write(static_cast<uint32_t>(contexts.size()));
+    for (const auto& context : contexts)
+      write_context(s, context);
   }
 
   void write_grab_device_filters(Serializer& s, 
@@ -76,6 +86,59 @@ namespace {
     for (const auto& index : indices)
       s.write(static_cast<uint32_t>(index));
   }
+
+#if defined(__linux__)
+  using ContextIt = std::vector<Config::Context>::const_iterator;
+
+  // writes the images of all stages to a sealed memfd, which the server
+  // can map without deserializing the contexts
+  int write_config_image(const std::vector<Config::Context>& contexts) {
+    auto writers = std::vector<StageImageWriter<ContextIt>>();
+    auto begin = contexts.begin();
+    for (auto it = begin; it != contexts.end(); ++it)
+      if (std::next(it) == contexts.end() || std::next(it)->begin_stage) {
+        writers.emplace_back(begin, std::next(it));
+        begin = std::next(it);
+      }
+
+    auto size = sizeof(uint32_t);
+    for (const auto& writer : writers)
+      size += sizeof(uint32_t) + writer.size();
+
+    const auto fd = ::memfd_create("keymapper-config",
+      MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+      return -1;
+    const auto data = (::ftruncate(fd, static_cast<off_t>(size)) == 0 ?
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) :
+      MAP_FAILED);
+    if (data == MAP_FAILED) {
+      ::close(fd);
+      return -1;
+    }
+    auto it = static_cast<char*>(data);
+    const auto put_size = [&](size_t value) {
+      const auto size = static_cast<uint32_t>(value);
+      std::memcpy(it, &size, sizeof(size));
+      it += sizeof(size);
+    };
+    put_size(writers.size());
+    for (const auto& writer : writers) {
+      put_size(writer.size());
+      writer.write(it);
+      it += writer.size();
+    }
+    ::munmap(data, size);
+
+    // server only accepts images which can no longer be modified
+    if (::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+          F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+      ::close(fd);
+      return -1;
+    }
+    return fd;
+  }
+#endif // defined(__linux__)
 } // namespace
 
 ServerPort::ServerPort() 
@@ -92,6 +155,23 @@ void ServerPort::disconnect() {
 }
 
 bool ServerPort::send_config(const Config& config) {
+#if defined(__linux__)
+  if (const auto fd = write_config_image(config.contexts); fd >= 0) {
+    const auto succeeded = m_connection.send_message([&](Serializer& s) {
+      s.write(MessageType::configuration_image);
+      write_grab_device_filters(s, config.grab_device_filters);
+      // filters are not part of the image
+      s.write(static_cast<uint32_t>(config.contexts.size()));
+      for (const auto& context : config.contexts) {
+        write_filter(s, context.device_filter);
+        write_filter(s, context.device_id_filter);
+      }
+      write_directives(s, config.server_directives);
+    }, fd);
+    ::close(fd);
+    return succeeded;
+  }
+#endif
   return m_connection.send_message([&](Serializer& s) {
     s.write(MessageType::configuration);
     write_grab_device_filters(s, config.grab_device_filters);    
@@ -100,6 +180,18 @@ bool ServerPort::send_config(const Config& config) {
   });
 }
 
+bool ServerPort::send_config_update(const Config& config,
+    const std::vector<int>& context_indices) {
+  return m_connection.send_message([&](Serializer& s) {
+    s.write(MessageType::configuration_update);
+    s.write(static_cast<uint32_t>(context_indices.size()));
+    for (auto index : context_indices) {
+      s.write(static_cast<uint32_t>(index));
+      write_context(s, config.contexts[index]);
+    }
+  });
+}
+
 bool ServerPort::send_active_contexts(const std::vector<int>& indices) {
   return m_connection.send_message([&](Serializer& s) {
     s.write(MessageType::active_contexts);
@@ -127,6 +219,13 @@ bool ServerPort::send_request_next_key_info() {
   });
 }
 
+bool ServerPort::send_request_latency_report(bool chrome_trace) {
+  return m_connection.send_message([&](Serializer& s) {
+    s.write(MessageType::latency_report);
+    s.write(chrome_trace);
+  });
+}
+
 bool ServerPort::send_inject_input(const KeySequence& sequence) {
   return m_connection.send_message([&](Serializer& s) {
     s.write(MessageType::inject_input);
@@ -163,6 +262,10 @@ bool ServerPort::read_messages(MessageHandler& handler,
           handler.on_next_key_info_message(key, std::move(device_desc));
           break;
         }
+        case MessageType::latency_report: {
+          handler.on_latency_report_message(d.read_string());
+          break;
+        }
         default: break;
       }
     });
@@ -13,10 +13,13 @@ public:
   bool connect();
   void disconnect();
   bool send_config(const Config& config);
+  bool send_config_update(const Config& config,
+    const std::vector<int>& context_indices);
   bool send_active_contexts(const std::vector<int>& indices);
   bool send_validate_state();
   bool send_set_virtual_key_state(Key key, KeyState state);
   bool send_request_next_key_info();
+  bool send_request_latency_report(bool chrome_trace);
   bool send_inject_input(const KeySequence& sequence);
   bool send_inject_output(const KeySequence& sequence);
 
@@ -24,6 +27,7 @@ public:
     virtual void on_execute_action_message(int action_index) = 0;
     virtual void on_virtual_key_state_message(Key key, KeyState state) = 0;
     virtual void on_next_key_info_message(Key key, DeviceDesc device) = 0;
+    virtual void on_latency_report_message(const std::string& report) = 0;
   };
   bool read_messages(MessageHandler& handler, std::optional<Duration> timeout);
 
@@ -71,8 +71,18 @@ public:
     return true;
   }
 
+  int poll_fd() const override {
+    auto fd = -1;
+    if (!dbus_connection_get_unix_fd(m_connection, &fd))
+      return -1;
+    return fd;
+  }
+
   bool update() override {
-    dbus_connection_read_write_dispatch(m_connection, 0);
+    // dispatch all messages which were read, so fd is only readable on new ones
+    dbus_connection_read_write(m_connection, 0);
+    while (dbus_connection_dispatch(m_connection) == DBUS_DISPATCH_DATA_REMAINS) { }
+    dbus_connection_flush(m_connection);
     return std::exchange(m_updated, false);
   }
 
@@ -45,6 +45,16 @@ bool FocusedWindowImpl::update() {
   return false;
 }
 
+bool FocusedWindowImpl::get_poll_fds(std::vector<int>* fds) const {
+  for (const auto& system : m_systems) {
+    const auto fd = system->poll_fd();
+    if (fd < 0)
+      return false;
+    fds->push_back(fd);
+  }
+  return true;
+}
+
 //-------------------------------------------------------------------------
 
 FocusedWindow::FocusedWindow()
@@ -66,6 +76,10 @@ bool FocusedWindow::update() {
   return m_impl->update();
 }
 
+bool FocusedWindow::get_poll_fds(std::vector<int>* fds) const {
+  return m_impl->get_poll_fds(fds);
+}
+
 const std::string& FocusedWindow::window_class() const {
   return m_impl->window_class;
 }
@@ -14,6 +14,8 @@ class FocusedWindowSystem {
 public:
   virtual ~FocusedWindowSystem() = default;
   virtual bool update() = 0;
+  // readable when update might return true, -1 when it needs to be polled
+  virtual int poll_fd() const { return -1; }
 };
 
 class FocusedWindowImpl : public FocusedWindowData {
@@ -24,6 +26,7 @@ public:
   bool initialize();
   void shutdown();
   bool update();
+  bool get_poll_fds(std::vector<int>* fds) const;
 };
 
 std::string get_process_path_by_pid(int pid);
@@ -3,6 +3,7 @@
 
 #include "FocusedWindowImpl.h"
 #include <cstring>
+#include <poll.h>
 #include <wayland-client.h>
 #include "wlr-foreign-toplevel-management-unstable-v1-client-protocol.h"
 
@@ -45,8 +46,21 @@ public:
     return true;
   }
 
-  bool update() {
-    wl_display_roundtrip(m_display);
+  int poll_fd() const override {
+    return wl_display_get_fd(m_display);
+  }
+
+  bool update() override {
+    // read events without blocking
+    while (wl_display_prepare_read(m_display) != 0)
+      wl_display_dispatch_pending(m_display);
+    wl_display_flush(m_display);
+    auto pfd = pollfd{ wl_display_get_fd(m_display), POLLIN, 0 };
+    if (::poll(&pfd, 1, 0) > 0)
+      wl_display_read_events(m_display);
+    else
+      wl_display_cancel_read(m_display);
+    wl_display_dispatch_pending(m_display);
     return std::exchange(m_updated, false);
   }
 
@@ -18,6 +18,8 @@ private:
   Atom m_net_wm_pid_atom{ };
   Atom m_utf8_string_atom{ };
   Window m_focused_window{ };
+  Window m_observed_window{ };
+  bool m_property_changed{ true };
 
 public:
   explicit FocusedWindowX11(FocusedWindowData* data)
@@ -43,11 +45,51 @@ public:
     m_net_wm_pid_atom = XInternAtom(m_display, "_NET_WM_PID", False);
     m_utf8_string_atom = XInternAtom(m_display, "UTF8_STRING", False);
     XSetErrorHandler([](Display*, XErrorEvent*) { return 0; });
+    XSelectInput(m_display, m_root_window, PropertyChangeMask);
     return true;
   }
 
+  int poll_fd() const override {
+    return ConnectionNumber(m_display);
+  }
+
   bool update() override {
+    // property queries can read events, process until queue is empty
+    auto updated = false;
+    while (read_property_changes())
+      updated |= update_focused_window();
+    return updated;
+  }
+
+private:
+  bool read_property_changes() {
+    auto changed = std::exchange(m_property_changed, false);
+    while (XPending(m_display)) {
+      auto event = XEvent{ };
+      XNextEvent(m_display, &event);
+      if (event.type == PropertyNotify &&
+          (event.xproperty.atom == m_net_active_window_atom ||
+           event.xproperty.atom == m_net_wm_name_atom))
+        changed = true;
+    }
+    return changed;
+  }
+
+  void observe_window(Window window) {
+    if (window == m_observed_window)
+      return;
+    if (m_observed_window)
+      XSelectInput(m_display, m_observed_window, NoEventMask);
+    if (window)
+      XSelectInput(m_display, window, PropertyChangeMask);
+    m_observed_window = window;
+  }
+
+  bool update_focused_window() {
     const auto window = get_focused_window();
+    // get notified about title changes
+    observe_window(window);
+
     auto window_title = get_window_title(window);
     if (window == m_focused_window &&
         window_title == m_data.window_title)
@@ -65,7 +107,6 @@ public:
     return true;
   }
 
-private:
   Window get_focused_window() {
     auto type = Atom{ };
     auto format = 0;
@@ -31,3 +31,7 @@ void TrayIcon::update() {
   if (m_impl)
     m_impl->update();
 }
+
+bool TrayIcon::get_poll_fds(std::vector<int>* fds) {
+  return (!m_impl || m_impl->get_poll_fds(fds));
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 class TrayIcon {
 public:
@@ -19,6 +20,8 @@ public:
     virtual ~IImpl() = default;
     virtual bool initialize(Handler* handler, bool show_reload) = 0;
     virtual void update() = 0;
+    // returns false when update needs to be called periodically
+    virtual bool get_poll_fds(std::vector<int>*) { return false; }
   };
 
   TrayIcon();
@@ -27,7 +30,10 @@ public:
   ~TrayIcon();
 
   void initialize(Handler* handler, bool show_reload);
+  bool initialized() const { return static_cast<bool>(m_impl); }
   void update();
+  // returns false when update needs to be called periodically
+  bool get_poll_fds(std::vector<int>* fds);
 
 private:
   std::unique_ptr<IImpl> m_impl;
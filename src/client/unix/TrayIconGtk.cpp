@@ -3,6 +3,7 @@
 
 #include "TrayIcon.h"
 #include <gtk/gtk.h>
+#include <vector>
 #if __has_include(<libayatana-appindicator/app-indicator.h>)
 # include <libayatana-appindicator/app-indicator.h>
 #else
@@ -34,6 +35,7 @@ private:
   }
     
   AppIndicator* m_app_indicator{ };
+  std::vector<GPollFD> m_poll_fds;
 
 public:
   ~TrayIconGtk() {
@@ -81,6 +83,32 @@ public:
     while (gtk_events_pending())
       gtk_main_iteration();
   }
+
+  bool get_poll_fds(std::vector<int>* fds) override {
+    // query descriptors of GLib's sources, update dispatches when ready
+    const auto context = g_main_context_default();
+    if (!g_main_context_acquire(context))
+      return false;
+    auto max_priority = gint{ };
+    const auto ready = g_main_context_prepare(context, &max_priority);
+    auto timeout = gint{ };
+    auto count = gint{ };
+    while ((count = g_main_context_query(context, max_priority, &timeout,
+          m_poll_fds.data(), static_cast<gint>(m_poll_fds.size()))) >
+          static_cast<gint>(m_poll_fds.size()))
+      m_poll_fds.resize(static_cast<size_t>(count));
+    // complete iteration without dispatching
+    const auto checked = g_main_context_check(context, max_priority,
+      m_poll_fds.data(), count);
+    g_main_context_release(context);
+
+    for (auto i = 0; i < count; ++i)
+      if (m_poll_fds[i].events & G_IO_IN)
+        fds->push_back(static_cast<int>(m_poll_fds[i].fd));
+
+    // poll while a source is ready or has a timeout
+    return (!ready && !checked && timeout < 0);
+  }
 };
 
 std::unique_ptr<TrayIcon::IImpl> make_tray_icon_gtk() {
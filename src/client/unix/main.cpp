@@ -6,11 +6,16 @@
 #include "common/output.h"
 #include <sstream>
 #include <csignal>
+#include <cerrno>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
 #include <sys/wait.h>
 #include <pwd.h>
 
+extern char** environ;
+
 #if defined(ENABLE_COCOA)
 extern void showMessageBoxCocoa(const char* message, const char* title);
 #endif
@@ -29,6 +34,7 @@ namespace {
   
   const auto system_config_path = std::filesystem::path("/etc/");
   const auto update_interval = std::chrono::milliseconds(50);
+  const auto update_config_interval = std::chrono::milliseconds(500);
 
   Settings g_settings;
   bool g_shutdown;
@@ -84,8 +90,39 @@ namespace {
   }
 
   void catch_child([[maybe_unused]] int sig_num) {
-    auto child_status = 0;
-    ::wait(&child_status);
+    const auto saved_errno = errno;
+    while (::waitpid(-1, nullptr, WNOHANG) > 0) { }
+    errno = saved_errno;
+  }
+
+  // splits command into arguments, unless it needs a shell
+  std::vector<std::string> split_simple_command(const std::string& command) {
+    if (command.find_first_of("|&;<>()$`\\\"'*?[]#~{}!\n") != std::string::npos)
+      return { };
+    auto arguments = std::vector<std::string>();
+    auto ss = std::istringstream(command);
+    for (auto argument = std::string(); ss >> argument; )
+      arguments.push_back(argument);
+    // variable assignment
+    if (!arguments.empty() && arguments.front().find('=') != std::string::npos)
+      return { };
+    return arguments;
+  }
+
+  bool wait_until_readable(const std::vector<Socket>& sockets,
+      std::optional<Duration> timeout, std::vector<Socket>* readable_sockets) {
+    static auto fds = std::vector<pollfd>();
+    fds.clear();
+    for (auto socket : sockets)
+      fds.push_back({ static_cast<int>(socket), POLLIN, 0 });
+    const auto timeout_ms = (timeout ? static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(*timeout).count()) : -1);
+    const auto result = ::poll(fds.data(), fds.size(), timeout_ms);
+    readable_sockets->clear();
+    for (const auto& fd : fds)
+      if (fd.revents)
+        readable_sockets->push_back(static_cast<Socket>(fd.fd));
+    return (result >= 0 || errno == EINTR);
   }
 
   void main_loop() {
@@ -93,6 +130,13 @@ namespace {
     if (!g_settings.no_tray_icon)
       tray_icon.initialize(&g_state, !g_settings.auto_update_config);
       
+    // only poll config file when it cannot be watched
+    const auto poll_config =
+      (g_settings.auto_update_config && !g_state.watch_config());
+
+    auto sockets = std::vector<Socket>();
+    auto readable_sockets = std::vector<Socket>();
+    auto tray_fds = std::vector<int>();
     while (!g_shutdown) {
       if (g_settings.auto_update_config &&
           g_state.update_config(true))
@@ -103,11 +147,28 @@ namespace {
         if (!g_state.send_active_contexts())
           return;
 
-      if (!g_state.read_server_messages(update_interval))
+      // block until focused window changes or a message arrives,
+      // when something still needs to be polled, wake up periodically
+      sockets.clear();
+      tray_fds.clear();
+      auto timeout = std::optional<Duration>();
+      const auto tray_waitable = tray_icon.get_poll_fds(&tray_fds);
+      for (auto fd : tray_fds)
+        sockets.push_back(static_cast<Socket>(fd));
+      if (!g_state.get_wait_sockets(&sockets) || !tray_waitable)
+        timeout = update_interval;
+      else if (poll_config)
+        timeout = update_config_interval;
+      if (const auto config_timeout = g_state.get_config_change_timeout())
+        timeout = std::min(timeout.value_or(*config_timeout), *config_timeout);
+      if (!wait_until_readable(sockets, timeout, &readable_sockets))
         return;
 
-      g_state.accept_control_connection();
-      g_state.read_control_messages();
+      if (!g_state.read_server_messages(Duration::zero()))
+        return;
+
+      // only accept and read from the control sockets which are ready
+      g_state.read_control_messages(readable_sockets);
       tray_icon.update();
     }
   }
@@ -191,16 +252,38 @@ namespace {
 } // namespace
 
 bool execute_terminal_command(const std::string& command) {
-  if (fork() == 0) {
-    dup2(open("/dev/null", O_RDONLY), STDIN_FILENO);
-    if (!g_verbose_output) {
-      dup2(open("/dev/null", O_RDWR), STDOUT_FILENO);
-      dup2(open("/dev/null", O_RDWR), STDERR_FILENO);
-    }
-    execl("/bin/sh", "sh", "-c", command.c_str(), nullptr);
-    exit(1);
+  auto actions = posix_spawn_file_actions_t{ };
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+  if (!g_verbose_output) {
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
   }
-  return true;
+  auto attributes = posix_spawnattr_t{ };
+  posix_spawnattr_init(&attributes);
+  auto signals = sigset_t{ };
+  sigemptyset(&signals);
+  posix_spawnattr_setsigmask(&attributes, &signals);
+  posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK);
+
+  const auto spawn = [&](const std::vector<std::string>& arguments, bool search_path) {
+    auto argv = std::vector<char*>();
+    for (const auto& argument : arguments)
+      argv.push_back(const_cast<char*>(argument.c_str()));
+    argv.push_back(nullptr);
+    auto pid = pid_t{ };
+    return ((search_path ? ::posix_spawnp : ::posix_spawn)(&pid, argv[0],
+      &actions, &attributes, argv.data(), environ) == 0);
+  };
+
+  // only start shell when necessary, also when command is no executable
+  const auto arguments = split_simple_command(command);
+  const auto succeeded = (!arguments.empty() && spawn(arguments, true)) ||
+    spawn({ "/bin/sh", "-c", command }, false);
+
+  posix_spawnattr_destroy(&attributes);
+  posix_spawn_file_actions_destroy(&actions);
+  return succeeded;
 }
 
 int main(int argc, char* argv[]) {
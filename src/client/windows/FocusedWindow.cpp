@@ -74,6 +74,10 @@ bool FocusedWindow::update() {
   return m_impl->update();
 }
 
+bool FocusedWindow::get_poll_fds(std::vector<int>* fds) const {
+  return false;
+}
+
 const std::string& FocusedWindow::window_class() const {
   return m_impl->window_class();
 }
@@ -9,6 +9,7 @@
 
 #else // !defined(_WIN32)
 
+#include <algorithm>
 #include <utility>
 #include <unistd.h>
 #include <sys/socket.h>
@@ -48,7 +49,10 @@ Connection::Connection(Socket socket)
 Connection::Connection(Connection&& rhs) noexcept
   : m_socket_fd(std::exchange(rhs.m_socket_fd, invalid_socket)),
     m_serializer(std::move(rhs.m_serializer)),
-    m_deserializer(std::move(rhs.m_deserializer)) {
+    m_deserializer(std::move(rhs.m_deserializer)),
+    m_received_fds(std::move(rhs.m_received_fds)),
+    m_received_bytes(rhs.m_received_bytes),
+    m_message_end(rhs.m_message_end) {
 }
 
 Connection& Connection::operator=(Connection&& rhs) noexcept {
@@ -56,6 +60,9 @@ Connection& Connection::operator=(Connection&& rhs) noexcept {
   std::swap(m_socket_fd, tmp.m_socket_fd);
   std::swap(m_serializer, tmp.m_serializer);
   std::swap(m_deserializer, tmp.m_deserializer);
+  std::swap(m_received_fds, tmp.m_received_fds);
+  std::swap(m_received_bytes, tmp.m_received_bytes);
+  std::swap(m_message_end, tmp.m_message_end);
   return *this;
 }
 
@@ -70,16 +77,100 @@ void Connection::disconnect() {
   }
   m_serializer.buffer.clear();
   m_deserializer.buffer.clear();
+  close_received_fds();
+  m_received_bytes = 0;
+  m_message_end = 0;
+}
+
+int Connection::take_received_fd() {
+  // the ones of previous messages were already closed
+  if (m_received_fds.empty() ||
+      m_received_fds.front().position > m_message_end)
+    return -1;
+  const auto fd = m_received_fds.front().fd;
+  m_received_fds.erase(m_received_fds.begin());
+  return fd;
+}
+
+void Connection::close_received_fds(uint64_t up_to_position) {
+  auto it = m_received_fds.begin();
+  for (; it != m_received_fds.end() && it->position <= up_to_position; ++it) {
+#if !defined(_WIN32)
+    ::close(it->fd);
+#endif
+  }
+  m_received_fds.erase(m_received_fds.begin(), it);
 }
 
 bool Connection::wait_for_message(std::optional<Duration> timeout) {
   return block_until_readable(m_socket_fd, timeout);
 }
 
-bool Connection::send(const char* buffer, size_t length) {
+#if !defined(_WIN32)
+namespace {
+  ssize_t send_with_fd(int socket_fd, const char* buffer, size_t length,
+      int attach_fd) {
+    auto iov = iovec{ const_cast<char*>(buffer), length };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = { };
+    auto message = msghdr{ };
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    auto header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(header), &attach_fd, sizeof(int));
+    return ::sendmsg(socket_fd, &message, 0);
+  }
+
+  ssize_t recv_with_fds(int socket_fd, char* buffer, size_t length,
+      std::vector<int>& received_fds) {
+    auto iov = iovec{ buffer, length };
+    alignas(cmsghdr) char control[CMSG_SPACE(4 * sizeof(int))];
+    auto message = msghdr{ };
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+#if defined(MSG_CMSG_CLOEXEC)
+    const auto flags = MSG_CMSG_CLOEXEC;
+#else
+    const auto flags = 0;
+#endif
+    const auto result = ::recvmsg(socket_fd, &message, flags);
+    if (result > 0)
+      for (auto header = CMSG_FIRSTHDR(&message); header;
+           header = CMSG_NXTHDR(&message, header))
+        if (header->cmsg_level == SOL_SOCKET &&
+            header->cmsg_type == SCM_RIGHTS) {
+          const auto count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+          for (auto i = 0u; i < count; ++i) {
+            auto fd = 0;
+            std::memcpy(&fd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+            received_fds.push_back(fd);
+          }
+        }
+    return result;
+  }
+} // namespace
+#endif // !defined(_WIN32)
+
+bool Connection::send(const char* buffer, size_t length,
+    [[maybe_unused]] int attach_fd) {
   while (length != 0) {
+#if !defined(_WIN32)
+    // file descriptor is sent with the first byte
+    const auto result = (attach_fd >= 0 ?
+      send_with_fd(m_socket_fd, buffer, length, attach_fd) :
+      ::send(m_socket_fd, buffer, length, 0));
+    if (result > 0)
+      attach_fd = -1;
+#else
     const auto result = ::send(m_socket_fd, buffer,
       static_cast<int>(length), 0);
+#endif
     if (result == -1 && (errno == EINTR || errno == EWOULDBLOCK))
       continue;
     if (result <= 0)
@@ -93,8 +184,17 @@ bool Connection::send(const char* buffer, size_t length) {
 int Connection::recv(char* buffer, size_t length) {
   auto read = 0;
   while (length != 0) {
+#if defined(_WIN32)
     const auto result = ::recv(m_socket_fd, buffer,
       static_cast<int>(length), 0);
+#else
+    // a read ends with the data the descriptors were sent with
+    auto fds = std::vector<int>();
+    const auto result = recv_with_fds(m_socket_fd, buffer, length, fds);
+    for (auto fd : fds)
+      m_received_fds.push_back({ fd,
+        m_received_bytes + static_cast<uint64_t>(std::max(result, ssize_t{ })) });
+#endif
 #if defined(_WIN32)
     if (result == -1 && WSAGetLastError() == WSAEWOULDBLOCK)
       break;
@@ -109,6 +209,7 @@ int Connection::recv(char* buffer, size_t length) {
     length -= static_cast<size_t>(result);
     buffer += result;
     read += static_cast<int>(result);
+    m_received_bytes += static_cast<uint64_t>(result);
   }
   return read;
 }
@@ -6,6 +6,7 @@
 #include <vector>
 #include <optional>
 #include <type_traits>
+#include <utility>
 #include "Duration.h"
 
 #if defined(_WIN32)
@@ -64,6 +65,8 @@ public:
 
   std::string read_string() {
     const auto size = read<uint32_t>();
+    if (!can_read(size))
+      return { };
     auto result = std::string(size, ' ');
     read(result.data(), size);
     return result;
@@ -104,6 +107,12 @@ public:
 
   template<typename F> // void(Serializer&)
   bool send_message(F&& write_message) {
+    return send_message(std::forward<F>(write_message), -1);
+  }
+
+  // passes a file descriptor along with the message (not on Windows)
+  template<typename F> // void(Serializer&)
+  bool send_message(F&& write_message, int attach_fd) {
     // serialize messages to buffer
     auto& buffer = m_serializer.buffer;
     buffer.clear();
@@ -111,10 +120,14 @@ public:
 
     // send message size and buffer
     auto size = static_cast<Size>(buffer.size());
-    return send(reinterpret_cast<char*>(&size), sizeof(size)) &&
+    return send(reinterpret_cast<char*>(&size), sizeof(size), attach_fd) &&
            send(buffer.data(), buffer.size());
   }
 
+  // file descriptor received along with the message which is being
+  // deserialized, -1 when there is none
+  int take_received_fd();
+
   template<typename F> // void(Deserializer&)
   bool read_messages(std::optional<Duration> timeout, F&& deserialize) {
     // block until message can be read or timeout
@@ -136,7 +149,11 @@ public:
         break;
       }
       const auto end = m_deserializer.it + size;
+      m_message_end = m_received_bytes -
+        static_cast<uint64_t>(buffer.end() - end);
       deserialize(m_deserializer);
+      // close file descriptors the message did not expect
+      close_received_fds(m_message_end);
       if (m_deserializer.it != end)
         return false;
     }
@@ -146,11 +163,21 @@ public:
 
 private:
   bool wait_for_message(std::optional<Duration> timeout);
-  bool send(const char* buffer, size_t length);
+  bool send(const char* buffer, size_t length, int attach_fd = -1);
   int recv(char* buffer, size_t length);
   bool recv(std::vector<char>& buffer);
+  void close_received_fds(uint64_t up_to_position = ~uint64_t{ });
+
+  struct ReceivedFd {
+    int fd;
+    // position in stream after the data it was received with
+    uint64_t position;
+  };
 
   Socket m_socket_fd{ invalid_socket };
   Serializer m_serializer;
   Deserializer m_deserializer;
+  std::vector<ReceivedFd> m_received_fds;
+  uint64_t m_received_bytes{ };
+  uint64_t m_message_end{ };
 };
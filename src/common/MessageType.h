@@ -16,4 +16,9 @@ enum class MessageType : uint8_t {
   next_key_info,
   inject_input,
   inject_output,
+  configuration_update,
+  latency_report,
+  configuration_image,
+  subscribe_virtual_key_states,
+  virtual_key_state_change,
 };
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Lock-free queue for passing values from one producer thread to one
+// consumer thread. The slots are allocated once and reused.
+template<typename T, size_t Capacity>
+class SpscQueue {
+public:
+  bool push(T&& value) {
+    const auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+      return false;
+    m_slots[tail % Capacity] = std::move(value);
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T* value) {
+    const auto head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+      return false;
+    *value = std::move(m_slots[head % Capacity]);
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const {
+    return (m_head.load(std::memory_order_acquire) ==
+            m_tail.load(std::memory_order_acquire));
+  }
+
+private:
+  std::array<T, Capacity> m_slots{ };
+  alignas(64) std::atomic<size_t> m_head{ };
+  alignas(64) std::atomic<size_t> m_tail{ };
+};
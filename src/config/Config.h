@@ -54,4 +54,6 @@ struct Config {
   std::vector<GrabDeviceFilter> grab_device_filters;
   std::vector<std::string> server_directives;
   std::vector<std::filesystem::path> include_filenames;
+  // include paths depend on environment, so config cannot be cached
+  bool include_filenames_expanded{ };
 };
@@ -0,0 +1,439 @@
+#include "ConfigCache.h"
+#include "common/parse_regex.h"
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <type_traits>
+
+#if defined(_WIN32)
+# include "common/windows/win.h"
+#else
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+extern const char* current_system;
+
+namespace {
+  const auto cache_magic = uint32_t{ 0x434D4B00 };
+  // increment when layout of cache or semantics of parsing change
+  const auto cache_format = uint32_t{ 2 };
+
+  const char* const version = ""
+#if __has_include("common/_version.h")
+# include "common/_version.h"
+#endif
+  ;
+
+  // FNV-1a
+  class Hash {
+  public:
+    void add(const void* data, size_t size) {
+      const auto bytes = static_cast<const unsigned char*>(data);
+      for (auto i = size_t{ }; i < size; ++i) {
+        m_value ^= bytes[i];
+        m_value *= 0x100000001b3ull;
+      }
+    }
+
+    void add(std::string_view string) {
+      const auto size = static_cast<uint32_t>(string.size());
+      add(&size, sizeof(size));
+      add(string.data(), string.size());
+    }
+
+    uint64_t value() const { return m_value; }
+
+  private:
+    uint64_t m_value{ 0xcbf29ce484222325ull };
+  };
+
+  bool add_file(Hash& hash, const std::filesystem::path& filename) {
+    const auto& native = filename.native();
+    hash.add(native.data(), native.size() * sizeof(native[0]));
+
+    auto is = std::ifstream(filename, std::ios::in | std::ios::binary);
+    if (!is.good())
+      return false;
+    auto buffer = std::array<char, 4096>();
+    while (is.read(buffer.data(), buffer.size()) || is.gcount() > 0)
+      hash.add(buffer.data(), static_cast<size_t>(is.gcount()));
+    return !is.bad();
+  }
+
+  class Writer {
+  public:
+    template<typename T, typename = std::enable_if_t<std::is_trivially_copyable_v<T>>>
+    void write(const T& value) {
+      m_buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void write(std::string_view string) {
+      write(static_cast<uint32_t>(string.size()));
+      m_buffer.append(string.data(), string.size());
+    }
+
+    void write_path(const std::filesystem::path& path) {
+      const auto& native = path.native();
+      write(static_cast<uint32_t>(native.size()));
+      m_buffer.append(reinterpret_cast<const char*>(native.data()),
+        native.size() * sizeof(native[0]));
+    }
+
+    const std::string& buffer() const { return m_buffer; }
+
+  private:
+    std::string m_buffer;
+  };
+
+  class Reader {
+  public:
+    Reader(const char* begin, const char* end)
+      : m_it(begin), m_end(end) {
+    }
+
+    bool failed() const { return m_failed; }
+    bool at_end() const { return (m_it == m_end); }
+
+    template<typename T, typename = std::enable_if_t<std::is_trivially_copyable_v<T>>>
+    T read() {
+      auto value = T{ };
+      read(&value, sizeof(T));
+      return value;
+    }
+
+    template<typename T, typename = std::enable_if_t<std::is_trivially_copyable_v<T>>>
+    void read(T* value) {
+      read(value, sizeof(T));
+    }
+
+    // prevents huge allocations when the cache is corrupt
+    uint32_t read_count(size_t element_size = 1) {
+      const auto count = read<uint32_t>();
+      if (count * element_size > static_cast<size_t>(m_end - m_it)) {
+        m_failed = true;
+        return 0;
+      }
+      return count;
+    }
+
+    std::string read_string() {
+      auto string = std::string(read_count(), ' ');
+      read(string.data(), string.size());
+      return string;
+    }
+
+    std::filesystem::path read_path() {
+      using char_type = std::filesystem::path::value_type;
+      auto native = std::filesystem::path::string_type(
+        read_count(sizeof(char_type)), ' ');
+      read(native.data(), native.size() * sizeof(char_type));
+      return native;
+    }
+
+  private:
+    void read(void* data, size_t size) {
+      if (size > static_cast<size_t>(m_end - m_it)) {
+        m_failed = true;
+        return;
+      }
+      std::memcpy(data, m_it, size);
+      m_it += size;
+    }
+
+    const char* m_it;
+    const char* m_end;
+    bool m_failed{ };
+  };
+
+  class MappedFile {
+  public:
+    explicit MappedFile(const std::filesystem::path& filename);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const char* begin() const { return m_data; }
+    const char* end() const { return m_data + m_size; }
+    explicit operator bool() const { return (m_data != nullptr); }
+
+  private:
+    const char* m_data{ };
+    size_t m_size{ };
+  };
+
+#if defined(_WIN32)
+  MappedFile::MappedFile(const std::filesystem::path& filename) {
+    const auto file = CreateFileW(filename.c_str(), GENERIC_READ,
+      FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+      return;
+    auto size = LARGE_INTEGER{ };
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+      if (const auto mapping = CreateFileMappingW(file, NULL,
+            PAGE_READONLY, 0, 0, NULL)) {
+        m_data = static_cast<const char*>(
+          MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        m_size = static_cast<size_t>(size.QuadPart);
+        CloseHandle(mapping);
+      }
+    }
+    CloseHandle(file);
+  }
+
+  MappedFile::~MappedFile() {
+    if (m_data)
+      UnmapViewOfFile(m_data);
+  }
+#else // !defined(_WIN32)
+  MappedFile::MappedFile(const std::filesystem::path& filename) {
+    const auto fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return;
+    using stat_t = struct stat;
+    auto st = stat_t{ };
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      const auto data = ::mmap(nullptr, static_cast<size_t>(st.st_size),
+        PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        m_data = static_cast<const char*>(data);
+        m_size = static_cast<size_t>(st.st_size);
+      }
+    }
+    ::close(fd);
+  }
+
+  MappedFile::~MappedFile() {
+    if (m_data)
+      ::munmap(const_cast<char*>(m_data), m_size);
+  }
+#endif // !defined(_WIN32)
+
+  void write_key_sequence(Writer& w, const KeySequence& sequence) {
+    w.write(static_cast<uint32_t>(sequence.size()));
+    for (const auto& event : sequence)
+      w.write(event);
+  }
+
+  KeySequence read_key_sequence(Reader& r) {
+    auto sequence = KeySequence();
+    sequence.resize(r.read_count(sizeof(KeyEvent)));
+    for (auto& event : sequence)
+      r.read(&event);
+    return sequence;
+  }
+
+  void write_filter(Writer& w, const Filter& filter) {
+    w.write(filter.string);
+    w.write(filter.invert);
+  }
+
+  Filter read_filter(Reader& r) {
+    auto filter = Filter{ };
+    filter.string = r.read_string();
+    r.read(&filter.invert);
+    if (is_regex(filter.string))
+      filter.regex = parse_regex(filter.string);
+    return filter;
+  }
+
+  void write_config(Writer& w, const Config& config) {
+    w.write(static_cast<uint32_t>(config.contexts.size()));
+    for (const auto& context : config.contexts) {
+      write_filter(w, context.window_class_filter);
+      write_filter(w, context.window_title_filter);
+      write_filter(w, context.window_path_filter);
+      write_filter(w, context.device_filter);
+      write_filter(w, context.device_id_filter);
+      write_key_sequence(w, context.modifier_filter);
+
+      w.write(static_cast<uint32_t>(context.inputs.size()));
+      for (const auto& input : context.inputs) {
+        write_key_sequence(w, input.input);
+        w.write(static_cast<int32_t>(input.output_index));
+      }
+
+      w.write(static_cast<uint32_t>(context.outputs.size()));
+      for (const auto& output : context.outputs)
+        write_key_sequence(w, output);
+
+      w.write(static_cast<uint32_t>(context.command_outputs.size()));
+      for (const auto& command : context.command_outputs) {
+        write_key_sequence(w, command.output);
+        w.write(static_cast<int32_t>(command.index));
+      }
+
+      w.write(context.system_filter_matched);
+      w.write(context.invert_modifier_filter);
+      w.write(context.fallthrough);
+      w.write(context.begin_stage);
+    }
+
+    w.write(static_cast<uint32_t>(config.actions.size()));
+    for (const auto& action : config.actions)
+      w.write(action.terminal_command);
+
+    w.write(static_cast<uint32_t>(config.virtual_key_aliases.size()));
+    for (const auto& [name, key] : config.virtual_key_aliases) {
+      w.write(name);
+      w.write(key);
+    }
+
+    w.write(static_cast<uint32_t>(config.grab_device_filters.size()));
+    for (const auto& filter : config.grab_device_filters) {
+      write_filter(w, filter);
+      w.write(filter.by_id);
+    }
+
+    w.write(static_cast<uint32_t>(config.server_directives.size()));
+    for (const auto& directive : config.server_directives)
+      w.write(directive);
+  }
+
+  void read_config(Reader& r, Config& config) {
+    config.contexts.resize(r.read_count());
+    for (auto& context : config.contexts) {
+      context.window_class_filter = read_filter(r);
+      context.window_title_filter = read_filter(r);
+      context.window_path_filter = read_filter(r);
+      context.device_filter = read_filter(r);
+      context.device_id_filter = read_filter(r);
+      context.modifier_filter = read_key_sequence(r);
+
+      context.inputs.resize(r.read_count());
+      for (auto& input : context.inputs) {
+        input.input = read_key_sequence(r);
+        input.output_index = r.read<int32_t>();
+      }
+
+      context.outputs.resize(r.read_count());
+      for (auto& output : context.outputs)
+        output = read_key_sequence(r);
+
+      context.command_outputs.resize(r.read_count());
+      for (auto& command : context.command_outputs) {
+        command.output = read_key_sequence(r);
+        command.index = r.read<int32_t>();
+      }
+
+      r.read(&context.system_filter_matched);
+      r.read(&context.invert_modifier_filter);
+      r.read(&context.fallthrough);
+      r.read(&context.begin_stage);
+      if (r.failed())
+        return;
+    }
+
+    config.actions.resize(r.read_count());
+    for (auto& action : config.actions)
+      action.terminal_command = r.read_string();
+
+    config.virtual_key_aliases.resize(r.read_count());
+    for (auto& [name, key] : config.virtual_key_aliases) {
+      name = r.read_string();
+      r.read(&key);
+    }
+
+    config.grab_device_filters.resize(r.read_count());
+    for (auto& filter : config.grab_device_filters) {
+      static_cast<Filter&>(filter) = read_filter(r);
+      r.read(&filter.by_id);
+    }
+
+    config.server_directives.resize(r.read_count());
+    for (auto& directive : config.server_directives)
+      directive = r.read_string();
+  }
+} // namespace
+
+std::optional<uint64_t> get_config_hash(
+    const std::filesystem::path& config_filename,
+    const std::vector<std::filesystem::path>& include_filenames) {
+  auto hash = Hash();
+  hash.add(&cache_format, sizeof(cache_format));
+  hash.add(version);
+  hash.add(current_system);
+  if (!add_file(hash, config_filename))
+    return { };
+  for (const auto& include_filename : include_filenames)
+    if (!add_file(hash, include_filename))
+      return { };
+  return hash.value();
+}
+
+ConfigCache::ConfigCache(std::filesystem::path cache_filename)
+  : m_filename(std::move(cache_filename)) {
+}
+
+std::optional<Config> ConfigCache::read(
+    const std::filesystem::path& config_filename) const try {
+  if (m_filename.empty())
+    return { };
+  const auto file = MappedFile(m_filename);
+  if (!file)
+    return { };
+
+  auto r = Reader(file.begin(), file.end());
+  if (r.read<uint32_t>() != cache_magic ||
+      r.read<uint32_t>() != cache_format)
+    return { };
+
+  // the includes are needed to check that the cache is up to date
+  const auto hash = r.read<uint64_t>();
+  auto config = Config();
+  config.include_filenames.resize(r.read_count());
+  for (auto& include_filename : config.include_filenames)
+    include_filename = r.read_path();
+  if (r.failed() ||
+      get_config_hash(config_filename, config.include_filenames) != hash)
+    return { };
+
+  read_config(r, config);
+  if (r.failed() || !r.at_end())
+    return { };
+  return config;
+}
+catch (const std::exception&) {
+  // invalid regex or out of memory
+  return { };
+}
+
+bool ConfigCache::write(const std::filesystem::path& config_filename,
+    const Config& config) const {
+  if (m_filename.empty() || config.include_filenames_expanded)
+    return false;
+  const auto hash = get_config_hash(config_filename, config.include_filenames);
+  if (!hash)
+    return false;
+
+  auto w = Writer();
+  w.write(cache_magic);
+  w.write(cache_format);
+  w.write(*hash);
+  w.write(static_cast<uint32_t>(config.include_filenames.size()));
+  for (const auto& include_filename : config.include_filenames)
+    w.write_path(include_filename);
+  write_config(w, config);
+
+  // replace atomically, so a concurrent read never sees a partial file
+  auto error = std::error_code();
+  std::filesystem::create_directories(m_filename.parent_path(), error);
+  auto temp_filename = m_filename;
+  temp_filename += ".tmp";
+  {
+    auto os = std::ofstream(temp_filename,
+      std::ios::out | std::ios::binary | std::ios::trunc);
+    os.write(w.buffer().data(), static_cast<std::streamsize>(w.buffer().size()));
+    if (!os.good())
+      return false;
+  }
+  std::filesystem::rename(temp_filename, m_filename, error);
+  if (error) {
+    std::filesystem::remove(temp_filename, error);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Config.h"
+#include <optional>
+
+// The parsed configuration is cached in a binary file, which is only used
+// as long as the hash of the configuration file and all its includes match.
+// Configurations with include paths which needed expansion are not cached,
+// since these could resolve to other files in another environment.
+class ConfigCache {
+public:
+  explicit ConfigCache(std::filesystem::path cache_filename);
+
+  const std::filesystem::path& filename() const { return m_filename; }
+  std::optional<Config> read(const std::filesystem::path& config_filename) const;
+  bool write(const std::filesystem::path& config_filename,
+    const Config& config) const;
+
+private:
+  std::filesystem::path m_filename;
+};
+
+std::optional<uint64_t> get_config_hash(
+  const std::filesystem::path& config_filename,
+  const std::vector<std::filesystem::path>& include_filenames);
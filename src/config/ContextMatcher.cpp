@@ -0,0 +1,176 @@
+
+#include "ContextMatcher.h"
+#include "common/parse_regex.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace {
+  const auto max_cache_size = size_t{ 256 };
+
+  char to_lower(char c) {
+    return (c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c);
+  }
+
+  bool is_special_char(char c) {
+    return (std::strchr("\\^$.|?*+()[]{}", c) != nullptr);
+  }
+} // namespace
+
+ContextMatcher::CompiledFilter::CompiledFilter(Property property,
+    const Filter& filter)
+  : m_property(property),
+    m_string(filter.string),
+    m_substring(property != Property::window_class) {
+
+  if (filter.regex.has_value() && !compile(filter.string)) {
+    m_literals.clear();
+    m_regex = filter.regex;
+  }
+}
+
+bool ContextMatcher::CompiledFilter::compile(std::string_view regex) {
+  if (!is_regex(regex))
+    return false;
+  regex.remove_prefix(1);
+  if (regex.back() == 'i') {
+    regex.remove_suffix(1);
+    m_icase = true;
+  }
+  regex.remove_suffix(1);
+
+  auto literal = Literal{ };
+  literal.at_begin = (!regex.empty() && regex.front() == '^');
+  for (auto i = (literal.at_begin ? size_t{ 1 } : 0); i < regex.size(); ++i) {
+    const auto c = regex[i];
+    if (c == '\\') {
+      // only escaped special characters are literals
+      if (i + 1 == regex.size() ||
+          (!is_special_char(regex[i + 1]) && regex[i + 1] != '/'))
+        return false;
+      literal.text.push_back(regex[++i]);
+    }
+    else if (c == '$' && (i + 1 == regex.size() || regex[i + 1] == '|')) {
+      literal.at_end = true;
+    }
+    else if (c == '|') {
+      m_literals.push_back(std::exchange(literal, { }));
+      literal.at_begin = (i + 1 < regex.size() && regex[i + 1] == '^');
+      if (literal.at_begin)
+        ++i;
+    }
+    else if (is_special_char(c)) {
+      return false;
+    }
+    else {
+      // case folding is only done for ASCII
+      if (m_icase && static_cast<unsigned char>(c) >= 0x80)
+        return false;
+      literal.text.push_back(c);
+    }
+  }
+  m_literals.push_back(std::move(literal));
+
+  if (m_icase)
+    for (auto& literal : m_literals)
+      for (auto& c : literal.text)
+        c = to_lower(c);
+  return true;
+}
+
+bool ContextMatcher::CompiledFilter::matches(const Literal& literal,
+    std::string_view text) const {
+  const auto& string = literal.text;
+  const auto equal = [&](char a, char b) {
+    return (m_icase ? to_lower(a) == b : a == b);
+  };
+  if (string.size() > text.size())
+    return false;
+  if (literal.at_begin && literal.at_end)
+    return (string.size() == text.size() &&
+      std::equal(text.begin(), text.end(), string.begin(), equal));
+  if (literal.at_begin)
+    return std::equal(string.begin(), string.end(), text.begin(),
+      [&](char b, char a) { return equal(a, b); });
+  if (literal.at_end)
+    return std::equal(string.begin(), string.end(),
+      text.end() - static_cast<std::ptrdiff_t>(string.size()),
+      [&](char b, char a) { return equal(a, b); });
+  return std::search(text.begin(), text.end(),
+    string.begin(), string.end(), equal) != text.end();
+}
+
+bool ContextMatcher::CompiledFilter::matches(const std::string& text) const {
+  if (m_regex.has_value())
+    return std::regex_search(text, *m_regex);
+  if (!m_literals.empty())
+    return std::any_of(m_literals.begin(), m_literals.end(),
+      [&](const Literal& literal) { return matches(literal, text); });
+  return (m_substring ?
+    text.find(m_string) != std::string::npos :
+    text == m_string);
+}
+
+int ContextMatcher::add_filter(Property property, const Filter& filter) {
+  if (filter.string.empty())
+    return -1;
+  const auto it = std::find_if(m_filters.begin(), m_filters.end(),
+    [&](const CompiledFilter& f) {
+      return (f.property() == property && f.string() == filter.string);
+    });
+  if (it != m_filters.end())
+    return static_cast<int>(std::distance(m_filters.begin(), it));
+  m_filters.emplace_back(property, filter);
+  return static_cast<int>(m_filters.size()) - 1;
+}
+
+void ContextMatcher::set_contexts(
+    const std::vector<Config::Context>& contexts) {
+  m_filters.clear();
+  m_contexts.clear();
+  m_cache.clear();
+  for (const auto& context : contexts)
+    m_contexts.push_back({
+      ContextFilter{ add_filter(Property::window_class, context.window_class_filter),
+        context.window_class_filter.invert },
+      ContextFilter{ add_filter(Property::window_title, context.window_title_filter),
+        context.window_title_filter.invert },
+      ContextFilter{ add_filter(Property::window_path, context.window_path_filter),
+        context.window_path_filter.invert },
+    });
+}
+
+bool ContextMatcher::matches(const ContextFilter& filter,
+    const std::string& text, std::vector<signed char>& results) const {
+  if (filter.filter < 0)
+    return !filter.invert;
+  auto& result = results[filter.filter];
+  if (result < 0)
+    result = m_filters[filter.filter].matches(text);
+  return (result != 0) ^ filter.invert;
+}
+
+void ContextMatcher::match(const std::string& window_class,
+    const std::string& window_title, const std::string& window_path,
+    std::vector<int>* context_indices) {
+
+  if (m_cache.size() >= max_cache_size)
+    m_cache.clear();
+
+  // reuse results of class and path filters, title filters are reevaluated
+  auto& results = m_cache[{ window_class, window_path }];
+  if (results.empty())
+    results.resize(m_filters.size(), -1);
+  for (auto i = 0u; i < m_filters.size(); ++i)
+    if (m_filters[i].property() == Property::window_title)
+      results[i] = -1;
+
+  context_indices->clear();
+  for (auto i = 0; i < static_cast<int>(m_contexts.size()); ++i) {
+    const auto& [class_filter, title_filter, path_filter] = m_contexts[i];
+    if (matches(class_filter, window_class, results) &&
+        matches(title_filter, window_title, results) &&
+        matches(path_filter, window_path, results))
+      context_indices->push_back(i);
+  }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Config.h"
+#include <array>
+#include <map>
+
+// Matches the window filters of all contexts. Identical filters are
+// evaluated only once per window and the results of the class and path
+// filters are cached, since mostly the window title changes.
+class ContextMatcher {
+public:
+  void set_contexts(const std::vector<Config::Context>& contexts);
+  void match(const std::string& window_class,
+             const std::string& window_title,
+             const std::string& window_path,
+             std::vector<int>* context_indices);
+
+private:
+  enum class Property { window_class, window_title, window_path };
+
+  // matches the regex subset of literal alternatives, optionally
+  // anchored, without std::regex
+  class CompiledFilter {
+  public:
+    CompiledFilter(Property property, const Filter& filter);
+    Property property() const { return m_property; }
+    const std::string& string() const { return m_string; }
+    bool matches(const std::string& text) const;
+
+  private:
+    struct Literal {
+      std::string text;
+      bool at_begin;
+      bool at_end;
+    };
+
+    bool compile(std::string_view regex);
+    bool matches(const Literal& literal, std::string_view text) const;
+
+    Property m_property;
+    std::string m_string;
+    bool m_substring{ };
+    bool m_icase{ };
+    std::vector<Literal> m_literals;
+    std::optional<std::regex> m_regex;
+  };
+
+  struct ContextFilter {
+    // index of distinct filter, -1 when empty
+    int filter;
+    bool invert;
+  };
+
+  int add_filter(Property property, const Filter& filter);
+  bool matches(const ContextFilter& filter, const std::string& text,
+    std::vector<signed char>& results) const;
+
+  std::vector<CompiledFilter> m_filters;
+  std::vector<std::array<ContextFilter, 3>> m_contexts;
+  // filter results by window class and path
+  std::map<std::pair<std::string, std::string>,
+    std::vector<signed char>> m_cache;
+};
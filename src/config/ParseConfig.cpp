@@ -13,6 +13,9 @@
 #include <fstream>
 #include <utility>
 #include <charconv>
+#include <system_error>
+#include <thread>
+#include <atomic>
 
 #if defined(__linux)
 const char* current_system = "Linux";
@@ -27,6 +30,9 @@ const char* current_system = "MacOS";
 namespace {
   using namespace std::placeholders;
 
+  // limit for the text a macro expands to, to stop runaway expansion
+  const auto max_expansion_length = size_t{ 1 } << 20;
+
   template<typename It>
   std::string_view make_string_view(It begin, It end) {
     return (begin == end ? "" : 
@@ -192,10 +198,14 @@ Config ParseConfig::operator()(std::istream& is,
   m_filename = { };
   m_line_no = 0;
   m_include_level = 0;
+  m_prefetch_workers.clear();
+  m_prefetched_includes.clear();
   m_preprocess_level = 0;
   m_config = { };
   m_commands.clear();
   m_macros.clear();
+  m_preprocessed.clear();
+  m_macro_expansions.clear();
   m_logical_keys.clear();
   m_system_filter_matched = true;
   m_after_empty_context_block = false;
@@ -214,7 +224,11 @@ Config ParseConfig::operator()(std::istream& is,
   add_logical_key("Alt", Key::AltLeft, Key::AltRight);
   add_logical_key("Meta", Key::MetaLeft, Key::MetaRight);
   
-  parse_file(is);
+  auto lines = read_lines(is);
+  prefetch_includes(lines);
+  parse_file(std::move(lines));
+  m_prefetch_workers.clear();
+  m_prefetched_includes.clear();
 
   // check if there is a mapping for each command (to reduce typing errors)
   if (!m_allow_unmapped_commands)
@@ -263,15 +277,14 @@ void ParseConfig::error(std::string message) const {
   throw ConfigError(std::move(message));
 }
 
-void ParseConfig::parse_file(std::istream& is, std::string filename) {
-  auto prev_filename = std::exchange(m_filename, std::move(filename));
-  const auto prev_line_no = std::exchange(m_line_no, 0);
-
+auto ParseConfig::read_lines(std::istream& is) -> SourceLines {
+  auto lines = SourceLines();
+  auto line_no = 0;
   auto line = std::string();
   auto prev_line = std::string();
-  while (is.good() && !m_parsing_done) {
+  while (is.good()) {
     std::getline(is, line);
-    ++m_line_no;
+    ++line_no;
 
     // allow to break lines with '\'
     auto end = line.end();
@@ -284,6 +297,85 @@ void ParseConfig::parse_file(std::istream& is, std::string filename) {
       line = std::move(prev_line) + std::move(line);
       prev_line.clear();
     }
+    lines.emplace_back(line_no, std::move(line));
+  }
+  return lines;
+}
+
+std::optional<std::string> ParseConfig::get_include_filename(
+    It it, It end) const {
+  // only plain strings, which do not need to be preprocessed
+  skip_space(&it, end);
+  if (!skip(&it, end, "@"))
+    return { };
+  skip_space(&it, end);
+  if (!skip(&it, end, "include"))
+    return { };
+  skip_space(&it, end);
+  if (it == end || (*it != '"' && *it != '\''))
+    return { };
+  const auto begin = it++;
+  if (!skip_until(&it, end, *begin))
+    return { };
+  const auto string = std::string(std::next(begin), std::prev(it));
+  if (string.find_first_of("$`") != std::string::npos)
+    return { };
+  return (m_base_path / expand_path(string)).string();
+}
+
+void ParseConfig::prefetch_includes(const SourceLines& lines) {
+  using Request = std::pair<std::string, std::promise<std::optional<SourceLines>>>;
+  auto requests = std::make_shared<std::vector<Request>>();
+  for (const auto& [line_no, line] : lines) {
+    auto filename = get_include_filename(line.begin(), line.end());
+    if (!filename || m_prefetched_includes.count(*filename))
+      continue;
+    auto& request = requests->emplace_back(std::move(*filename),
+      std::promise<std::optional<SourceLines>>());
+    m_prefetched_includes.emplace(request.first, request.second.get_future());
+  }
+  if (requests->empty())
+    return;
+
+  // files are distributed among a few workers
+  const auto worker_count = std::clamp(std::thread::hardware_concurrency(),
+    1u, static_cast<unsigned int>(requests->size()));
+  auto next = std::make_shared<std::atomic<size_t>>();
+  for (auto i = 0u; i < worker_count; ++i) {
+    try {
+      m_prefetch_workers.push_back(std::async(std::launch::async,
+        [requests, next]() {
+          for (auto index = next->fetch_add(1); index < requests->size();
+               index = next->fetch_add(1)) {
+            auto& [filename, promise] = requests->at(index);
+            // read at once, splitting in memory is much faster
+            auto file = std::ifstream(filename, std::ios::binary);
+            if (!file.good()) {
+              promise.set_value(std::nullopt);
+              continue;
+            }
+            auto content = std::ostringstream();
+            content << file.rdbuf();
+            auto is = std::istringstream(std::move(content).str());
+            promise.set_value(read_lines(is));
+          }
+        }));
+    }
+    catch (const std::system_error&) {
+      // files without a worker are read when they are included
+      break;
+    }
+  }
+}
+
+void ParseConfig::parse_file(SourceLines lines, std::string filename) {
+  auto prev_filename = std::exchange(m_filename, std::move(filename));
+  const auto prev_line_no = std::exchange(m_line_no, 0);
+
+  for (auto& [line_no, line] : lines) {
+    if (m_parsing_done)
+      break;
+    m_line_no = line_no;
     parse_line(line);
   }
 
@@ -396,18 +488,37 @@ void ParseConfig::parse_directive(It it, const It end) {
   const auto ident = read_ident(&it, end);
   skip_space(&it, end);
   if (ident == "include") {
+    const auto string = read_string(&it, end);
+    const auto expanded = expand_path(string);
+    if (expanded != string)
+      m_config.include_filenames_expanded = true;
     auto filename =
-      m_config.include_filenames.emplace_back(m_base_path / 
-        expand_path(read_string(&it, end))).string();
-
-    auto is = std::ifstream(filename);
-    if (!is.good())
+      m_config.include_filenames.emplace_back(m_base_path / expanded).string();
+
+    // take lines read ahead, each include is parsed in declaration order
+    auto lines = std::optional<SourceLines>();
+    auto it = m_prefetched_includes.find(filename);
+    if (it != m_prefetched_includes.end() && it->second.valid()) {
+      try {
+        lines = it->second.get();
+      }
+      catch (const std::future_error&) {
+        // it was not read
+      }
+    }
+    if (!lines) {
+      auto is = std::ifstream(filename);
+      if (is.good())
+        lines = read_lines(is);
+    }
+    if (!lines)
       error("Opening include file '" + filename + "' failed");
 
     if (++m_include_level > 10)
       error("Recursive includes detected");
 
-    parse_file(is, std::move(filename));
+    prefetch_includes(*lines);
+    parse_file(std::move(*lines), std::move(filename));
 
     --m_include_level;
   }
@@ -436,7 +547,8 @@ void ParseConfig::parse_directive(It it, const It end) {
     m_parsing_done = true;
   }
   else if (ident == "macos-iso-keyboard" ||
-           ident == "macos-toggle-fn") {
+           ident == "macos-toggle-fn" ||
+           ident == "match-automaton") {
     if (read_optional_bool())
       m_config.server_directives.push_back(ident);
   }
@@ -677,7 +789,14 @@ KeySequence ParseConfig::parse_output(It it, It end) {
 
 void ParseConfig::parse_macro(std::string name, It it, It end) {
   if (m_system_filter_matched)
-    m_macros[std::move(name)] = preprocess(it, end, false);
+    set_macro(std::move(name), preprocess(it, end, false));
+}
+
+void ParseConfig::set_macro(std::string name, std::string value) {
+  // previous results might depend on the macro
+  m_preprocessed.clear();
+  m_macro_expansions.clear();
+  m_macros[std::move(name)] = std::move(value);
 }
 
 bool ParseConfig::parse_logical_key_definition(
@@ -752,6 +871,9 @@ std::string ParseConfig::apply_builtin_macro(const std::string& ident,
     const auto count = parse_int(arguments[1]);
     if (!count.has_value())
       error("Number expected");
+    if (*count > 0 && static_cast<size_t>(*count) >
+        max_expansion_length / (arguments[0].size() + 1))
+      error("Macro expansion of 'repeat' is too long");
     auto result = std::string();
     for (auto i = 0; i < *count; ++i) {
       result.append(arguments[0]);
@@ -827,14 +949,44 @@ std::string ParseConfig::preprocess(std::string expression) const {
   // simply substitute when expression is a single identifier
   auto it = expression.begin();
   const auto end = expression.end();
-  if (skip_ident(&it, end) && 
-      it == end) {
-    const auto macro = m_macros.find(expression);
-    if (macro != cend(m_macros))
-      return preprocess(macro->second);
+  const auto macro = (skip_ident(&it, end) && it == end ?
+    m_macros.find(expression) : cend(m_macros));
+  if (it == end && macro == cend(m_macros))
     return expression;
+
+  // lines are not memoized, only the expressions within
+  if (m_preprocess_level == 1 && macro == cend(m_macros))
+    return preprocess(expression.cbegin(), expression.cend());
+
+  if (auto cached = m_preprocessed.find(expression);
+      cached != m_preprocessed.end())
+    return cached->second;
+
+  auto result = (macro != cend(m_macros) ? preprocess(macro->second) :
+    preprocess(expression.cbegin(), expression.cend()));
+  return m_preprocessed.emplace(std::move(expression),
+    std::move(result)).first->second;
+}
+
+std::string ParseConfig::expand_macro(const std::string& ident,
+    const std::vector<std::string>& arguments) const {
+  auto key = ident;
+  for (const auto& argument : arguments) {
+    key.push_back('\0');
+    key.append(argument);
   }
-  return preprocess(expression.begin(), expression.end());
+  if (auto cached = m_macro_expansions.find(key);
+      cached != m_macro_expansions.end())
+    return cached->second;
+
+  const auto macro = m_macros.find(ident);
+  auto result = (macro != cend(m_macros) ?
+    substitute_arguments(macro->second, arguments) :
+    apply_builtin_macro(ident, arguments));
+  if (result.size() > max_expansion_length)
+    error("Macro expansion of '" + ident + "' is too long");
+  return m_macro_expansions.emplace(std::move(key),
+    std::move(result)).first->second;
 }
 
 std::string ParseConfig::preprocess(It it, const It end, 
@@ -866,14 +1018,8 @@ std::string ParseConfig::preprocess(It it, const It end,
         for (auto& argument : arguments)
           argument = preprocess(std::move(argument));
 
-        const auto macro = m_macros.find(ident);
-        if (macro != cend(m_macros)) {
-          ident = substitute_arguments(macro->second, arguments);
-        }
-        else {
-          ident = apply_builtin_macro(ident, arguments);
-        }
-        
+        ident = expand_macro(ident, arguments);
+
         // preprocess result again only if it does not contain new variables
         if (!contains_variable(ident)) {
           begin = it;
@@ -882,6 +1028,8 @@ std::string ParseConfig::preprocess(It it, const It end,
         }
         result.append(std::move(ident));
       }
+      if (result.size() > max_expansion_length)
+        error("Macro expansion is too long");
     }
     else if (skip_string(&it, end) ||
              skip_terminal_command(&it, end) ||
@@ -5,7 +5,10 @@
 #include "ParseKeySequence.h"
 #include <iosfwd>
 #include <filesystem>
+#include <future>
 #include <map>
+#include <optional>
+#include <unordered_map>
 
 class ParseConfig {
 public:
@@ -30,10 +33,16 @@ private:
     Key right;
   };
 
+  // lines joined at '\' with the number of their last line
+  using SourceLines = std::vector<std::pair<int, std::string>>;
+
   using It = std::string::const_iterator;
 
   [[noreturn]] void error(std::string message) const;
-  void parse_file(std::istream& is, std::string filename = "");
+  static SourceLines read_lines(std::istream& is);
+  std::optional<std::string> get_include_filename(It it, It end) const;
+  void prefetch_includes(const SourceLines& lines);
+  void parse_file(SourceLines lines, std::string filename = "");
   void parse_line(std::string& line);
   void parse_directive(It begin, It end);
   void parse_context(It begin, It end);
@@ -53,6 +62,9 @@ private:
   std::string preprocess(std::string expression) const;
   std::string apply_builtin_macro(const std::string& ident,
     const std::vector<std::string>& arguments) const;
+  std::string expand_macro(const std::string& ident,
+    const std::vector<std::string>& arguments) const;
+  void set_macro(std::string name, std::string value);
   Key add_logical_key(std::string name, Key left, Key right);
   void replace_logical_key(Key both, Key left, Key right);
   std::string read_filter_string(It* it, It end);
@@ -73,11 +85,17 @@ private:
   std::filesystem::path m_base_path;
   std::string m_filename;
   int m_include_level{ };
+  // include files are read by worker threads ahead of parsing
+  std::map<std::string, std::future<std::optional<SourceLines>>> m_prefetched_includes;
+  std::vector<std::future<void>> m_prefetch_workers;
   mutable int m_preprocess_level{ };
   int m_line_no{ };
   Config m_config;
   std::vector<Command> m_commands;
   std::map<std::string, std::string> m_macros;
+  // results of preprocessing and macro expansion, until a macro is defined
+  mutable std::unordered_map<std::string, std::string> m_preprocessed;
+  mutable std::unordered_map<std::string, std::string> m_macro_expansions;
   std::vector<LogicalKey> m_logical_keys;
   ParseKeySequence m_parse_sequence;
   bool m_system_filter_matched{ true };
@@ -1,10 +1,11 @@
 
 #include "get_key_name.h"
+#include <algorithm>
+#include <array>
 #include <cctype>
+#include <cstdint>
 #include <cstring>
 #include <string>
-#include <algorithm>
-#include <vector>
 #include <sstream>
 
 namespace {
@@ -20,208 +21,284 @@ namespace {
     }
     return Key::none;
   }
-} // namespace
 
-const char* get_key_name(const Key& key) {
-  switch (key) {
-    case Key::Escape:             return "Escape";
-    case Key::Digit1:             return "1";
-    case Key::Digit2:             return "2";
-    case Key::Digit3:             return "3";
-    case Key::Digit4:             return "4";
-    case Key::Digit5:             return "5";
-    case Key::Digit6:             return "6";
-    case Key::Digit7:             return "7";
-    case Key::Digit8:             return "8";
-    case Key::Digit9:             return "9";
-    case Key::Digit0:             return "0";
-    case Key::Minus:              return "Minus";
-    case Key::Equal:              return "Equal";
-    case Key::Backspace:          return "Backspace";
-    case Key::Tab:                return "Tab";
-    case Key::KeyQ:               return "Q";
-    case Key::KeyW:               return "W";
-    case Key::KeyE:               return "E";
-    case Key::KeyR:               return "R";
-    case Key::KeyT:               return "T";
-    case Key::KeyY:               return "Y";
-    case Key::KeyU:               return "U";
-    case Key::KeyI:               return "I";
-    case Key::KeyO:               return "O";
-    case Key::KeyP:               return "P";
-    case Key::BracketLeft:        return "BracketLeft";
-    case Key::BracketRight:       return "BracketRight";
-    case Key::Enter:              return "Enter";
-    case Key::ControlLeft:        return "ControlLeft";
-    case Key::KeyA:               return "A";
-    case Key::KeyS:               return "S";
-    case Key::KeyD:               return "D";
-    case Key::KeyF:               return "F";
-    case Key::KeyG:               return "G";
-    case Key::KeyH:               return "H";
-    case Key::KeyJ:               return "J";
-    case Key::KeyK:               return "K";
-    case Key::KeyL:               return "L";
-    case Key::Semicolon:          return "Semicolon";
-    case Key::Quote:              return "Quote";
-    case Key::Backquote:          return "Backquote";
-    case Key::ShiftLeft:          return "ShiftLeft";
-    case Key::Backslash:          return "Backslash";
-    case Key::KeyZ:               return "Z";
-    case Key::KeyX:               return "X";
-    case Key::KeyC:               return "C";
-    case Key::KeyV:               return "V";
-    case Key::KeyB:               return "B";
-    case Key::KeyN:               return "N";
-    case Key::KeyM:               return "M";
-    case Key::Comma:              return "Comma";
-    case Key::Period:             return "Period";
-    case Key::Slash:              return "Slash";
-    case Key::ShiftRight:         return "ShiftRight";
-    case Key::NumpadMultiply:     return "NumpadMultiply";
-    case Key::AltLeft:            return "AltLeft";
-    case Key::Space:              return "Space";
-    case Key::CapsLock:           return "CapsLock";
-    case Key::F1:                 return "F1";
-    case Key::F2:                 return "F2";
-    case Key::F3:                 return "F3";
-    case Key::F4:                 return "F4";
-    case Key::F5:                 return "F5";
-    case Key::F6:                 return "F6";
-    case Key::F7:                 return "F7";
-    case Key::F8:                 return "F8";
-    case Key::F9:                 return "F9";
-    case Key::F10:                return "F10";
-    case Key::NumLock:            return "NumLock";
-    case Key::ScrollLock:         return "ScrollLock";
-    case Key::Numpad7:            return "Numpad7";
-    case Key::Numpad8:            return "Numpad8";
-    case Key::Numpad9:            return "Numpad9";
-    case Key::NumpadSubtract:     return "NumpadSubtract";
-    case Key::Numpad4:            return "Numpad4";
-    case Key::Numpad5:            return "Numpad5";
-    case Key::Numpad6:            return "Numpad6";
-    case Key::NumpadAdd:          return "NumpadAdd";
-    case Key::Numpad1:            return "Numpad1";
-    case Key::Numpad2:            return "Numpad2";
-    case Key::Numpad3:            return "Numpad3";
-    case Key::Numpad0:            return "Numpad0";
-    case Key::NumpadDecimal:      return "NumpadDecimal";
-    case Key::IntlBackslash:      return "IntlBackslash";
-    case Key::F11:                return "F11";
-    case Key::F12:                return "F12";
-    case Key::IntlRo:             return "IntlRo";
-    case Key::Convert:            return "Convert";
-    case Key::KanaMode:           return "KanaMode";
-    case Key::NonConvert:         return "NonConvert";
-    case Key::NumpadEnter:        return "NumpadEnter";
-    case Key::ControlRight:       return "ControlRight";
-    case Key::NumpadDivide:       return "NumpadDivide";
-    case Key::PrintScreen:        return "PrintScreen";
-    case Key::AltRight:           return "AltRight";
-    case Key::Home:               return "Home";
-    case Key::ArrowUp:            return "ArrowUp";
-    case Key::PageUp:             return "PageUp";
-    case Key::ArrowLeft:          return "ArrowLeft";
-    case Key::ArrowRight:         return "ArrowRight";
-    case Key::End:                return "End";
-    case Key::ArrowDown:          return "ArrowDown";
-    case Key::PageDown:           return "PageDown";
-    case Key::Insert:             return "Insert";
-    case Key::Delete:             return "Delete";
-    case Key::Settings:           return "Settings";
-    case Key::BrightnessDown:     return "BrightnessDown";
-    case Key::BrightnessUp:       return "BrightnessUp";
-    case Key::DisplayToggleIntExt:return "DisplayToggleIntExt";
-    case Key::Prog3:              return "Prog3";
-    case Key::WLAN:               return "WLAN";
-    case Key::LaunchApp2:         return "LaunchApp2";
-    case Key::AudioVolumeMute:    return "AudioVolumeMute";
-    case Key::AudioVolumeDown:    return "AudioVolumeDown";
-    case Key::AudioVolumeUp:      return "AudioVolumeUp";
-    case Key::Power:              return "Power";
-    case Key::NumpadEqual:        return "NumpadEqual";
-    case Key::Pause:              return "Pause";
-    case Key::Cancel:             return "Cancel";
-    case Key::NumpadComma:        return "NumpadComma";
-    case Key::Lang1:              return "Lang1";
-    case Key::Lang2:              return "Lang2";
-    case Key::IntlYen:            return "IntlYen";
-    case Key::MetaLeft:           return "MetaLeft";
-    case Key::MetaRight:          return "MetaRight";
-    case Key::ContextMenu:        return "ContextMenu";
-    case Key::BrowserStop:        return "BrowserStop";
-    case Key::LaunchApp1:         return "LaunchApp1";
-    case Key::BrowserSearch:      return "BrowserSearch";
-    case Key::BrowserFavorites:   return "BrowserFavorites";
-    case Key::BrowserBack:        return "BrowserBack";
-    case Key::BrowserForward:     return "BrowserForward";
-    case Key::MediaTrackNext:     return "MediaTrackNext";
-    case Key::MediaPlayPause:     return "MediaPlayPause";
-    case Key::MediaTrackPrevious: return "MediaTrackPrevious";
-    case Key::MediaStop:          return "MediaStop";
-    case Key::MediaRewind:        return "MediaRewind";
-    case Key::MediaPlay:          return "MediaPlay";
-    case Key::MediaPause:         return "MediaPause";
-    case Key::MediaFastForward:   return "MediaFastForward";
-    case Key::BrowserRefresh:     return "BrowserRefresh";
-    case Key::BrowserHome:        return "BrowserHome";
-    case Key::LaunchMail:         return "LaunchMail";
-    case Key::LaunchMediaPlayer:  return "LaunchMediaPlayer";
-    case Key::Again:              return "Again";
-    case Key::Props:              return "Props";
-    case Key::Undo:               return "Undo";
-    case Key::Select:             return "Select";
-    case Key::Copy:               return "Copy";
-    case Key::Open:               return "Open";
-    case Key::Paste:              return "Paste";
-    case Key::Find:               return "Find";
-    case Key::Cut:                return "Cut";
-    case Key::Help:               return "Help";
-    case Key::Sleep:              return "Sleep";
-    case Key::WakeUp:             return "WakeUp";
-    case Key::Eject:              return "Eject";
-    case Key::Fn:                 return "Fn";
-    case Key::F13:                return "F13";
-    case Key::F14:                return "F14";
-    case Key::F15:                return "F15";
-    case Key::F16:                return "F16";
-    case Key::F17:                return "F17";
-    case Key::F18:                return "F18";
-    case Key::F19:                return "F19";
-    case Key::F20:                return "F20";
-    case Key::F21:                return "F21";
-    case Key::F22:                return "F22";
-    case Key::F23:                return "F23";
-    case Key::F24:                return "F24";
+  struct KeyName {
+    Key key;
+    std::string_view name;
+  };
+
+  constexpr KeyName key_names[] = {
+    { Key::Escape, "Escape" },
+    { Key::Digit1, "1" },
+    { Key::Digit2, "2" },
+    { Key::Digit3, "3" },
+    { Key::Digit4, "4" },
+    { Key::Digit5, "5" },
+    { Key::Digit6, "6" },
+    { Key::Digit7, "7" },
+    { Key::Digit8, "8" },
+    { Key::Digit9, "9" },
+    { Key::Digit0, "0" },
+    { Key::Minus, "Minus" },
+    { Key::Equal, "Equal" },
+    { Key::Backspace, "Backspace" },
+    { Key::Tab, "Tab" },
+    { Key::KeyQ, "Q" },
+    { Key::KeyW, "W" },
+    { Key::KeyE, "E" },
+    { Key::KeyR, "R" },
+    { Key::KeyT, "T" },
+    { Key::KeyY, "Y" },
+    { Key::KeyU, "U" },
+    { Key::KeyI, "I" },
+    { Key::KeyO, "O" },
+    { Key::KeyP, "P" },
+    { Key::BracketLeft, "BracketLeft" },
+    { Key::BracketRight, "BracketRight" },
+    { Key::Enter, "Enter" },
+    { Key::ControlLeft, "ControlLeft" },
+    { Key::KeyA, "A" },
+    { Key::KeyS, "S" },
+    { Key::KeyD, "D" },
+    { Key::KeyF, "F" },
+    { Key::KeyG, "G" },
+    { Key::KeyH, "H" },
+    { Key::KeyJ, "J" },
+    { Key::KeyK, "K" },
+    { Key::KeyL, "L" },
+    { Key::Semicolon, "Semicolon" },
+    { Key::Quote, "Quote" },
+    { Key::Backquote, "Backquote" },
+    { Key::ShiftLeft, "ShiftLeft" },
+    { Key::Backslash, "Backslash" },
+    { Key::KeyZ, "Z" },
+    { Key::KeyX, "X" },
+    { Key::KeyC, "C" },
+    { Key::KeyV, "V" },
+    { Key::KeyB, "B" },
+    { Key::KeyN, "N" },
+    { Key::KeyM, "M" },
+    { Key::Comma, "Comma" },
+    { Key::Period, "Period" },
+    { Key::Slash, "Slash" },
+    { Key::ShiftRight, "ShiftRight" },
+    { Key::NumpadMultiply, "NumpadMultiply" },
+    { Key::AltLeft, "AltLeft" },
+    { Key::Space, "Space" },
+    { Key::CapsLock, "CapsLock" },
+    { Key::F1, "F1" },
+    { Key::F2, "F2" },
+    { Key::F3, "F3" },
+    { Key::F4, "F4" },
+    { Key::F5, "F5" },
+    { Key::F6, "F6" },
+    { Key::F7, "F7" },
+    { Key::F8, "F8" },
+    { Key::F9, "F9" },
+    { Key::F10, "F10" },
+    { Key::NumLock, "NumLock" },
+    { Key::ScrollLock, "ScrollLock" },
+    { Key::Numpad7, "Numpad7" },
+    { Key::Numpad8, "Numpad8" },
+    { Key::Numpad9, "Numpad9" },
+    { Key::NumpadSubtract, "NumpadSubtract" },
+    { Key::Numpad4, "Numpad4" },
+    { Key::Numpad5, "Numpad5" },
+    { Key::Numpad6, "Numpad6" },
+    { Key::NumpadAdd, "NumpadAdd" },
+    { Key::Numpad1, "Numpad1" },
+    { Key::Numpad2, "Numpad2" },
+    { Key::Numpad3, "Numpad3" },
+    { Key::Numpad0, "Numpad0" },
+    { Key::NumpadDecimal, "NumpadDecimal" },
+    { Key::IntlBackslash, "IntlBackslash" },
+    { Key::F11, "F11" },
+    { Key::F12, "F12" },
+    { Key::IntlRo, "IntlRo" },
+    { Key::Convert, "Convert" },
+    { Key::KanaMode, "KanaMode" },
+    { Key::NonConvert, "NonConvert" },
+    { Key::NumpadEnter, "NumpadEnter" },
+    { Key::ControlRight, "ControlRight" },
+    { Key::NumpadDivide, "NumpadDivide" },
+    { Key::PrintScreen, "PrintScreen" },
+    { Key::AltRight, "AltRight" },
+    { Key::Home, "Home" },
+    { Key::ArrowUp, "ArrowUp" },
+    { Key::PageUp, "PageUp" },
+    { Key::ArrowLeft, "ArrowLeft" },
+    { Key::ArrowRight, "ArrowRight" },
+    { Key::End, "End" },
+    { Key::ArrowDown, "ArrowDown" },
+    { Key::PageDown, "PageDown" },
+    { Key::Insert, "Insert" },
+    { Key::Delete, "Delete" },
+    { Key::Settings, "Settings" },
+    { Key::BrightnessDown, "BrightnessDown" },
+    { Key::BrightnessUp, "BrightnessUp" },
+    { Key::DisplayToggleIntExt, "DisplayToggleIntExt" },
+    { Key::Prog3, "Prog3" },
+    { Key::WLAN, "WLAN" },
+    { Key::LaunchApp2, "LaunchApp2" },
+    { Key::AudioVolumeMute, "AudioVolumeMute" },
+    { Key::AudioVolumeDown, "AudioVolumeDown" },
+    { Key::AudioVolumeUp, "AudioVolumeUp" },
+    { Key::Power, "Power" },
+    { Key::NumpadEqual, "NumpadEqual" },
+    { Key::Pause, "Pause" },
+    { Key::Cancel, "Cancel" },
+    { Key::NumpadComma, "NumpadComma" },
+    { Key::Lang1, "Lang1" },
+    { Key::Lang2, "Lang2" },
+    { Key::IntlYen, "IntlYen" },
+    { Key::MetaLeft, "MetaLeft" },
+    { Key::MetaRight, "MetaRight" },
+    { Key::ContextMenu, "ContextMenu" },
+    { Key::BrowserStop, "BrowserStop" },
+    { Key::LaunchApp1, "LaunchApp1" },
+    { Key::BrowserSearch, "BrowserSearch" },
+    { Key::BrowserFavorites, "BrowserFavorites" },
+    { Key::BrowserBack, "BrowserBack" },
+    { Key::BrowserForward, "BrowserForward" },
+    { Key::MediaTrackNext, "MediaTrackNext" },
+    { Key::MediaPlayPause, "MediaPlayPause" },
+    { Key::MediaTrackPrevious, "MediaTrackPrevious" },
+    { Key::MediaStop, "MediaStop" },
+    { Key::MediaRewind, "MediaRewind" },
+    { Key::MediaPlay, "MediaPlay" },
+    { Key::MediaPause, "MediaPause" },
+    { Key::MediaFastForward, "MediaFastForward" },
+    { Key::BrowserRefresh, "BrowserRefresh" },
+    { Key::BrowserHome, "BrowserHome" },
+    { Key::LaunchMail, "LaunchMail" },
+    { Key::LaunchMediaPlayer, "LaunchMediaPlayer" },
+    { Key::Again, "Again" },
+    { Key::Props, "Props" },
+    { Key::Undo, "Undo" },
+    { Key::Select, "Select" },
+    { Key::Copy, "Copy" },
+    { Key::Open, "Open" },
+    { Key::Paste, "Paste" },
+    { Key::Find, "Find" },
+    { Key::Cut, "Cut" },
+    { Key::Help, "Help" },
+    { Key::Sleep, "Sleep" },
+    { Key::WakeUp, "WakeUp" },
+    { Key::Eject, "Eject" },
+    { Key::Fn, "Fn" },
+    { Key::F13, "F13" },
+    { Key::F14, "F14" },
+    { Key::F15, "F15" },
+    { Key::F16, "F16" },
+    { Key::F17, "F17" },
+    { Key::F18, "F18" },
+    { Key::F19, "F19" },
+    { Key::F20, "F20" },
+    { Key::F21, "F21" },
+    { Key::F22, "F22" },
+    { Key::F23, "F23" },
+    { Key::F24, "F24" },
 
-    case Key::ButtonLeft:         return "ButtonLeft";
-    case Key::ButtonRight:        return "ButtonRight";
-    case Key::ButtonMiddle:       return "ButtonMiddle";
-    case Key::ButtonBack:         return "ButtonBack";
-    case Key::ButtonForward:      return "ButtonForward";
-    case Key::WheelUp:            return "WheelUp";
-    case Key::WheelDown:          return "WheelDown";
-    case Key::WheelLeft:          return "WheelLeft";
-    case Key::WheelRight:         return "WheelRight";
+    { Key::ButtonLeft, "ButtonLeft" },
+    { Key::ButtonRight, "ButtonRight" },
+    { Key::ButtonMiddle, "ButtonMiddle" },
+    { Key::ButtonBack, "ButtonBack" },
+    { Key::ButtonForward, "ButtonForward" },
+    { Key::WheelUp, "WheelUp" },
+    { Key::WheelDown, "WheelDown" },
+    { Key::WheelLeft, "WheelLeft" },
+    { Key::WheelRight, "WheelRight" },
+
+    { Key::any, "Any" },
+    { Key::ContextActive, "ContextActive" },
+  };
+
+  // only used for looking up keys by name
+  constexpr KeyName key_aliases[] = {
+    { Key::Shift, "Shift" },
+    { Key::Control, "Control" },
+    { Key::Alt, "Alt" },
+    { Key::Meta, "Meta" },
+    { Key::MetaLeft, "OSLeft" },
+    { Key::MetaRight, "OSRight" },
+  };
+  constexpr auto key_name_count = std::size(key_names) + std::size(key_aliases);
+  static_assert(key_name_count < 0xFF, "too many key names");
+
+  constexpr const KeyName& get_key_name_entry(size_t index) {
+    return (index < std::size(key_names) ? key_names[index] :
+      key_aliases[index - std::size(key_names)]);
+  }
 
-    case Key::any:                return "Any";
-    case Key::ContextActive:      return "ContextActive";
+  // perfect hash of the key names, with a seed which is searched at
+  // compile time so that no two names end up in the same slot
+  constexpr auto name_slot_bits = 12;
 
-    case Key::none:
-    case Key::timeout:
-    case Key::last_keyboard_key:
-    case Key::first_virtual:
-    case Key::last_virtual:
-    case Key::first_logical:
-    case Key::last_logical:
-    case Key::first_action:
-    case Key::last_action:
-    case Key::Control:
-    case Key::Alt:
-    case Key::Meta:
-      break;
+  constexpr size_t get_name_slot(std::string_view name, uint32_t seed) {
+    auto hash = 2166136261u ^ seed;
+    for (auto c : name)
+      hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    return (hash * 0x9E3779B1u) >> (32 - name_slot_bits);
   }
+
+  struct NameTable {
+    uint32_t seed;
+    // index + 1 of key name entry, 0 when empty
+    std::array<uint8_t, size_t{ 1 } << name_slot_bits> slots;
+  };
+
+  constexpr NameTable generate_name_table() {
+    for (auto seed = uint32_t{ 1 }; seed < 10000; ++seed) {
+      auto table = NameTable{ seed, { } };
+      auto collision = false;
+      for (auto i = size_t{ }; i < key_name_count && !collision; ++i) {
+        auto& slot = table.slots[get_name_slot(get_key_name_entry(i).name, seed)];
+        collision = (slot != 0);
+        slot = static_cast<uint8_t>(i + 1);
+      }
+      if (!collision)
+        return table;
+    }
+    return { };
+  }
+
+  constexpr auto name_table = generate_name_table();
+  static_assert(name_table.seed != 0, "key names have to be unique");
+
+  // key names sorted by key, for looking up names by key
+  constexpr auto sorted_key_names = []() {
+    auto sorted = std::array<KeyName, std::size(key_names)>{ };
+    for (auto i = size_t{ }; i < sorted.size(); ++i) {
+      auto j = i;
+      for (; j > 0 && sorted[j - 1].key > key_names[i].key; --j)
+        sorted[j] = sorted[j - 1];
+      sorted[j] = key_names[i];
+    }
+    return sorted;
+  }();
+
+  constexpr bool keys_unique() {
+    for (auto i = size_t{ 1 }; i < sorted_key_names.size(); ++i)
+      if (sorted_key_names[i - 1].key == sorted_key_names[i].key)
+        return false;
+    return true;
+  }
+  static_assert(keys_unique(), "keys have to be unique");
+
+  Key find_key_by_name(std::string_view name) {
+    const auto index = name_table.slots[get_name_slot(name, name_table.seed)];
+    if (index && get_key_name_entry(index - 1u).name == name)
+      return get_key_name_entry(index - 1u).key;
+    return Key::none;
+  }
+} // namespace
+
+const char* get_key_name(const Key& key) {
+  const auto it = std::lower_bound(sorted_key_names.begin(),
+    sorted_key_names.end(), key,
+    [](const KeyName& key_name, Key key) { return key_name.key < key; });
+  if (it != sorted_key_names.end() && it->key == key)
+    return it->name.data();
   return nullptr;
 }
 
@@ -235,9 +312,6 @@ bool remove_prefix(std::string_view& name, const char(&literal)[SizeZ]) {
 }
 
 Key get_key_by_name(std::string_view name) {
-  if (name == "Any")
-    return Key::any;
-
   if (auto key = try_parse_key_code(name); key != Key::none)
     return key;
 
@@ -260,45 +334,6 @@ Key get_key_by_name(std::string_view name) {
       return Key::none;
   }
 
-  // generate vector of all key name/key pairs, sorted by name
-  static const auto s_key_map =
-    []() {
-      auto map = std::vector<std::pair<std::string_view, Key>>();
-      map.reserve(200);
-
-      for (auto key_code = 1; key_code < 0xFFFF; ++key_code) {
-        const auto key = static_cast<Key>(key_code);
-        if (auto name = get_key_name(key))
-          map.emplace_back(name, key);
-      }
-      std::sort(begin(map), end(map),
-        [](const auto& a, const auto& b) { return a.first < b.first; });
-
-      return map;
-    }();
-
-  // binary search for key name
-  const auto it = std::lower_bound(cbegin(s_key_map), cend(s_key_map), name,
-    [](const auto& kv, const auto& name) { return kv.first < name; });
-  if (it != cend(s_key_map) && it->first == name)
-    return it->second;
-
-  // common logical keys
-  if (name == "Shift")
-    return Key::Shift;
-  if (name == "Control")
-    return Key::Control;
-  if (name == "Alt")
-    return Key::Alt;
-  if (name == "Meta")
-    return Key::Meta;
-
-  // allow some aliases
-  if (name == "OSLeft")
-    return Key::MetaLeft;
-  if (name == "OSRight")
-    return Key::MetaRight;
-
-  return Key::none;
+  return find_key_by_name(name);
 }
 
@@ -52,6 +52,13 @@ bool ClientPort::send_request_next_key_info() {
   });
 }
 
+bool ClientPort::send_request_latency_report(bool chrome_trace) {
+  return m_connection.send_message([&](Serializer& s) {
+    s.write(MessageType::latency_report);
+    s.write(chrome_trace);
+  });
+}
+
 bool ClientPort::send_inject_input(const std::string& string) {
   return m_connection.send_message([&](Serializer& s) {
     s.write(MessageType::inject_input);
@@ -78,6 +85,16 @@ bool ClientPort::send_type_string(const std::string& string) {
   });
 }
 
+bool ClientPort::send_subscribe_virtual_key_states(
+    const std::vector<std::string>& names) {
+  return m_connection.send_message([&](Serializer& s) {
+    s.write(MessageType::subscribe_virtual_key_states);
+    s.write(static_cast<uint32_t>(names.size()));
+    for (const auto& name : names)
+      s.write(std::string_view(name));
+  });
+}
+
 bool ClientPort::read_virtual_key_state(std::optional<Duration> timeout, 
     std::optional<KeyState>* result) {
   return m_connection.read_messages(timeout,
@@ -95,6 +112,47 @@ bool ClientPort::read_virtual_key_state(std::optional<Duration> timeout,
     });
 }
 
+bool ClientPort::read_virtual_key_states(std::optional<Duration> timeout, 
+    std::vector<KeyState>* results) {
+  return m_connection.read_messages(timeout,
+    [&](Deserializer& d) {
+      switch (d.read<MessageType>()) {
+        case MessageType::virtual_key_state: {
+          d.read<Key>();
+          results->push_back(d.read<KeyState>());
+          break;
+        }
+        default: 
+          break;
+      }
+    });
+}
+
+bool ClientPort::read_virtual_key_state_changes(std::optional<Duration> timeout, 
+    std::vector<VirtualKeyStateChange>* results) {
+  return m_connection.read_messages(timeout,
+    [&](Deserializer& d) {
+      switch (d.read<MessageType>()) {
+        case MessageType::virtual_key_state_change: {
+          auto& change = results->emplace_back();
+          change.key = d.read<Key>();
+          change.state = d.read<KeyState>();
+          change.sequence = d.read<uint64_t>();
+          break;
+        }
+        case MessageType::virtual_key_state: {
+          auto& change = results->emplace_back();
+          change.key = d.read<Key>();
+          change.state = d.read<KeyState>();
+          change.sequence = 0;
+          break;
+        }
+        default: 
+          break;
+      }
+    });
+}
+
 bool ClientPort::read_next_key_info(std::optional<Duration> timeout, 
     std::string* result) {
   return m_connection.read_messages(timeout,
@@ -110,3 +168,19 @@ bool ClientPort::read_next_key_info(std::optional<Duration> timeout,
       }
     });
 }
+
+bool ClientPort::read_latency_report(std::optional<Duration> timeout, 
+    std::string* result) {
+  return m_connection.read_messages(timeout,
+    [&](Deserializer& d) {
+      switch (d.read<MessageType>()) {
+        case MessageType::latency_report: {
+          if (result)
+            *result = d.read_string();
+          break;
+        }
+        default: 
+          break;
+      }
+    });
+}
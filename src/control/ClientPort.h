@@ -4,6 +4,13 @@
 #include "common/Host.h"
 #include "common/MessageType.h"
 #include <memory>
+#include <vector>
+
+struct VirtualKeyStateChange {
+  Key key;
+  KeyState state;
+  uint64_t sequence;
+};
 
 class ClientPort {
 public:
@@ -15,13 +22,22 @@ public:
   bool send_set_instance_id(std::string_view id);
   bool send_set_config_file(const std::string& filename);
   bool send_request_next_key_info();
+  bool send_request_latency_report(bool chrome_trace);
   bool send_inject_input(const std::string& string);
   bool send_inject_output(const std::string& string);
   bool send_type_string(const std::string& string);
+  bool send_subscribe_virtual_key_states(const std::vector<std::string>& names);
   bool read_virtual_key_state(std::optional<Duration> timeout, 
     std::optional<KeyState>* result);
+  bool read_virtual_key_states(std::optional<Duration> timeout, 
+    std::vector<KeyState>* results);
+  // returns a state of Not, when no key was found
+  bool read_virtual_key_state_changes(std::optional<Duration> timeout, 
+    std::vector<VirtualKeyStateChange>* results);
   bool read_next_key_info(std::optional<Duration> timeout, 
     std::string* result);
+  bool read_latency_report(std::optional<Duration> timeout, 
+    std::string* result);
 
 private:
   Host m_host;
@@ -1,7 +1,9 @@
 
 #include "Settings.h"
 #include "common/output.h"
+#include <cctype>
 #include <optional>
+#include <utility>
 
 #if defined(_WIN32)
 
@@ -57,12 +59,25 @@ bool interpret_commandline(Settings& settings, int argc, char* argv[]) {
     else if (argument == T("--stdout")) {
       settings.requests.push_back({ RequestType::stdout_result });
     }
+    else if (argument == T("--stdin")) {
+      settings.read_stdin = true;
+    }
     else if (argument == T("--restart")) {
       settings.requests.push_back({ RequestType::restart, "", timeout });
     }
     else if (argument == T("--next-key-info")) {
       settings.requests.push_back({ RequestType::next_key_info, "", timeout });
     }    
+    else if (argument == T("--latency-report")) {
+      settings.requests.push_back({ RequestType::latency_report, "", timeout });
+    }
+    else if (argument == T("--latency-trace")) {
+      settings.requests.push_back({ RequestType::latency_report, "trace", timeout });
+    }
+    else if (argument == T("--subscribe")) {
+      settings.requests.push_back({ RequestType::subscribe,
+        read_sequence(), timeout });
+    }
     else if (argument == T("--set-config")) {
       if (++i >= argc)
         return false;
@@ -114,9 +129,69 @@ bool interpret_commandline(Settings& settings, int argc, char* argv[]) {
         to_utf8(argv[i]), timeout });
     }
   }
-  if (settings.requests.empty())
+  if (settings.requests.empty() && !settings.read_stdin)
+    return false;
+
+  return true;
+}
+
+bool interpret_request_line(const std::string& line,
+    std::vector<Request>* requests) {
+  // split into arguments, quotes group words
+  auto arguments = std::vector<std::string>{ "keymapperctl" };
+  auto in_argument = false;
+  auto quote = char{ };
+  for (auto c : line) {
+    if (quote) {
+      if (c == quote)
+        quote = { };
+      else
+        arguments.back().push_back(c);
+      continue;
+    }
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      in_argument = false;
+      continue;
+    }
+    if (!std::exchange(in_argument, true))
+      arguments.emplace_back();
+    if (c == '"' || c == '\'')
+      quote = c;
+    else
+      arguments.back().push_back(c);
+  }
+  if (quote || arguments.size() < 2)
     return false;
 
+#if defined(_WIN32)
+  auto wide_arguments = std::vector<std::wstring>();
+  for (const auto& argument : arguments)
+    wide_arguments.push_back(utf8_to_wide(argument));
+  auto argv = std::vector<wchar_t*>();
+  for (auto& argument : wide_arguments)
+    argv.push_back(argument.data());
+#else
+  auto argv = std::vector<char*>();
+  for (auto& argument : arguments)
+    argv.push_back(argument.data());
+#endif
+
+  auto settings = Settings{ };
+  try {
+    if (!interpret_commandline(settings, static_cast<int>(argv.size()),
+          argv.data()) || settings.read_stdin)
+      return false;
+  }
+  catch (const std::exception&) {
+    // invalid number
+    return false;
+  }
+
+  for (const auto& request : settings.requests)
+    if (request.type == RequestType::restart)
+      return false;
+
+  *requests = std::move(settings.requests);
   return true;
 }
 
@@ -129,6 +204,8 @@ Usage: keymapperctl [--operation]
   --output <sequence>   injects an output key sequence.
   --type "string"       types a string of characters.
   --next-key-info       outputs information about the next key press.
+  --latency-report      outputs histograms of the input latency.
+  --latency-trace       outputs the input latency in Chrome trace format.
   --set-config "file"   sets a new configuration.
   --is-pressed <key>    sets the result code 0 when a virtual key is down.
   --is-released <key>   sets the result code 0 when a virtual key is up.
@@ -138,10 +215,12 @@ Usage: keymapperctl [--operation]
   --wait-pressed <key>  waits until a virtual key is pressed.
   --wait-released <key> waits until a virtual key is released.
   --wait-toggled <key>  waits until a virtual key is toggled.
+  --subscribe [<key>]   outputs every state change of virtual keys.
   --timeout <millisecs> sets a timeout for the following operation.
   --wait <millisecs>    unconditionally waits a given amount of time.
   --instance <id>       replaces another keymapperctl process with the same id.
   --restart             starts processing the first operation again.
+  --stdin               reads further operations from stdin line by line.
   --stdout              outputs the result code.
   -h, --help            print this help.
 
@@ -23,6 +23,8 @@ enum class RequestType {
   inject_input,
   inject_output,
   type_string,
+  latency_report,
+  subscribe,
 };
 
 struct Request {
@@ -33,6 +35,7 @@ struct Request {
 
 struct Settings {
   std::vector<Request> requests;
+  bool read_stdin{ };
 };
 
 #if defined(_WIN32)
@@ -40,4 +43,6 @@ bool interpret_commandline(Settings& settings, int argc, wchar_t* argv[]);
 #else
 bool interpret_commandline(Settings& settings, int argc, char* argv[]);
 #endif
+bool interpret_request_line(const std::string& line,
+  std::vector<Request>* requests);
 void print_help_message();
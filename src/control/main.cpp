@@ -1,8 +1,11 @@
 
 #include "control/Settings.h"
 #include "control/ClientPort.h"
-#include <thread>
+#include <deque>
 #include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <thread>
 
 namespace {
   enum Result : int {
@@ -32,13 +35,6 @@ namespace {
     return { Result::yes, state };
   }
 
-  SendResult set_key_state(std::string_view key, KeyState state, 
-      std::optional<Duration> timeout) {
-    if (!g_client.send_set_virtual_key_state(key, state))
-      return { Result::connection_failed };
-    return read_virtual_key_state(timeout);
-  }
-
   SendResult get_key_state(std::string_view key, 
       std::optional<Duration>timeout) {
     if (!g_client.send_get_virtual_key_state(key))
@@ -78,6 +74,32 @@ namespace {
     return to_result(read_virtual_key_state(timeout));
   }
   
+  // outputs the virtual key state changes until the connection is lost
+  Result subscribe(const std::string& keys, std::optional<Duration> timeout) {
+    auto names = std::vector<std::string>();
+    auto ss = std::istringstream(keys);
+    for (auto name = std::string(); ss >> name; )
+      names.push_back(name);
+    if (!g_client.send_subscribe_virtual_key_states(names))
+      return Result::connection_failed;
+
+    auto changes = std::vector<VirtualKeyStateChange>();
+    for (;;) {
+      changes.clear();
+      if (!g_client.read_virtual_key_state_changes(timeout, &changes))
+        return Result::connection_failed;
+      for (const auto& change : changes) {
+        if (change.state == KeyState::Not)
+          return Result::key_not_found;
+        std::printf("Virtual%d %s %llu\n",
+          *change.key - *Key::first_virtual,
+          (change.state == KeyState::Down ? "pressed" : "released"),
+          static_cast<unsigned long long>(change.sequence));
+      }
+      std::fflush(stdout);
+    }
+  }
+
   Result request_next_key_info(std::optional<Duration>timeout) {
     if (!g_client.send_request_next_key_info())
       return Result::connection_failed;
@@ -91,56 +113,97 @@ namespace {
     return Result::yes;
   }
 
-  Result inject_input(const std::string& string, std::optional<Duration>timeout) {
-    if (!g_client.send_inject_input(string))
+  Result request_latency_report(bool chrome_trace, 
+      std::optional<Duration>timeout) {
+    if (!g_client.send_request_latency_report(chrome_trace))
       return Result::connection_failed;
-    return to_result(read_virtual_key_state(timeout));
+    auto report = std::string();
+    if (!g_client.read_latency_report(timeout, &report))
+      return Result::connection_failed;
+    if (report.empty())
+      return Result::timeout;
+    std::fputs(report.c_str(), stdout);
+    std::fflush(stdout);
+    return Result::yes;
   }
 
-  Result inject_output(const std::string& string, std::optional<Duration>timeout) {
-    if (!g_client.send_inject_output(string))
-      return Result::connection_failed;
-    return to_result(read_virtual_key_state(timeout));
+  // requests which are answered with a virtual key state
+  bool is_key_state_request(RequestType type) {
+    switch (type) {
+      case RequestType::press:
+      case RequestType::release:
+      case RequestType::toggle:
+      case RequestType::is_pressed:
+      case RequestType::is_released:
+      case RequestType::inject_input:
+      case RequestType::inject_output:
+      case RequestType::type_string:
+        return true;
+      default:
+        return false;
+    }
   }
 
-  Result type_string(const std::string& string, std::optional<Duration>timeout) {
-    if (!g_client.send_type_string(string))
-      return Result::connection_failed;
-    return to_result(read_virtual_key_state(timeout));
+  bool send_key_state_request(const Request& request) {
+    switch (request.type) {
+      case RequestType::press:
+        return g_client.send_set_virtual_key_state(request.string, KeyState::Down);
+      case RequestType::release:
+        return g_client.send_set_virtual_key_state(request.string, KeyState::Up);
+      case RequestType::toggle:
+        return g_client.send_set_virtual_key_state(request.string, KeyState::Not);
+      case RequestType::is_pressed:
+      case RequestType::is_released:
+        return g_client.send_get_virtual_key_state(request.string);
+      case RequestType::inject_input:
+        return g_client.send_inject_input(request.string);
+      case RequestType::inject_output:
+        return g_client.send_inject_output(request.string);
+      case RequestType::type_string:
+        return g_client.send_type_string(request.string);
+      default:
+        return false;
+    }
   }
 
-  Result make_request(const Request& request, const Result& last_result) {
+  Result to_result(const Request& request, KeyState state) {
     switch (request.type) {
       case RequestType::press:
       case RequestType::release:
-      case RequestType::toggle: {
-        const auto [result, state] = set_key_state(request.string,
-            (request.type == RequestType::press ? KeyState::Down :
-             request.type == RequestType::release ? KeyState::Up :
-             KeyState::Not), request.timeout);
-        if (result == Result::yes) {
-          if (state == KeyState::Up || state == KeyState::Down)
-            return Result::yes;
-          return Result::key_not_found;
-        }
-        return result;
-      }
+      case RequestType::toggle:
+        if (state == KeyState::Up || state == KeyState::Down)
+          return Result::yes;
+        return Result::key_not_found;
 
       case RequestType::is_pressed:
-      case RequestType::is_released: {
-        const auto [result, state] = get_key_state(request.string, request.timeout);
-        if (result == Result::yes) {
-          if (state == KeyState::Down)
-            return (request.type == RequestType::is_pressed ?
-              Result::yes : Result::no);
-          
-          if (state == KeyState::Up)
-            return (request.type == RequestType::is_released ?
-              Result::yes : Result::no);
-          
-          return Result::key_not_found;
-        }
-        return result;
+      case RequestType::is_released:
+        if (state == KeyState::Down)
+          return (request.type == RequestType::is_pressed ?
+            Result::yes : Result::no);
+        if (state == KeyState::Up)
+          return (request.type == RequestType::is_released ?
+            Result::yes : Result::no);
+        return Result::key_not_found;
+
+      default:
+        return (state == KeyState::Down ? Result::yes : Result::no);
+    }
+  }
+
+  Result make_request(const Request& request, const Result& last_result) {
+    switch (request.type) {
+      case RequestType::press:
+      case RequestType::release:
+      case RequestType::toggle:
+      case RequestType::is_pressed:
+      case RequestType::is_released:
+      case RequestType::inject_input:
+      case RequestType::inject_output:
+      case RequestType::type_string: {
+        if (!send_key_state_request(request))
+          return Result::connection_failed;
+        const auto [result, state] = read_virtual_key_state(request.timeout);
+        return (result == Result::yes ? to_result(request, *state) : result);
       }
 
       case RequestType::wait_pressed:
@@ -178,15 +241,61 @@ namespace {
       case RequestType::next_key_info:
         return request_next_key_info(request.timeout);
 
-      case RequestType::inject_input:
-        return inject_input(request.string, request.timeout);
+      case RequestType::latency_report:
+        return request_latency_report(!request.string.empty(), request.timeout);
 
-      case RequestType::inject_output:
-        return inject_output(request.string, request.timeout);
+      case RequestType::subscribe:
+        return subscribe(request.string, request.timeout);
+    }
+    return last_result;
+  }
 
-      case RequestType::type_string:
-        return type_string(request.string, request.timeout);
+  // requests read from stdin are sent without waiting for the reply,
+  // until the result is needed or a request needs to wait
+  Result process_stdin_requests(Result last_result) {
+    auto pending = std::deque<Request>();
+    auto states = std::vector<KeyState>();
+
+    // replies arrive in order of the requests
+    const auto read_replies = [&](std::optional<Duration> timeout) {
+      states.clear();
+      if (!g_client.read_virtual_key_states(timeout, &states))
+        return false;
+      for (auto state : states) {
+        if (pending.empty())
+          break;
+        last_result = to_result(pending.front(), state);
+        pending.pop_front();
+      }
+      return true;
+    };
+
+    auto line = std::string();
+    auto requests = std::vector<Request>();
+    while (std::getline(std::cin, line)) {
+      if (!interpret_request_line(line, &requests)) {
+        if (line.find_first_not_of(" \t\r") != std::string::npos)
+          std::fprintf(stderr, "invalid request '%s'\n", line.c_str());
+        continue;
+      }
+      for (const auto& request : requests) {
+        if (is_key_state_request(request.type)) {
+          if (!send_key_state_request(request))
+            return Result::connection_failed;
+          pending.push_back(request);
+          if (!read_replies(Duration::zero()))
+            return Result::connection_failed;
+          continue;
+        }
+        while (!pending.empty())
+          if (!read_replies(pending.front().timeout))
+            return Result::connection_failed;
+        last_result = make_request(request, last_result);
+      }
     }
+    while (!pending.empty())
+      if (!read_replies(pending.front().timeout))
+        return Result::connection_failed;
     return last_result;
   }
 } // namespace
@@ -202,7 +311,8 @@ int main(int argc, char* argv[]) {
   }
 
   auto result = Result::connection_failed;
-  auto connect_timeout = g_settings.requests.front().timeout;
+  auto connect_timeout = (!g_settings.requests.empty() ?
+    g_settings.requests.front().timeout : std::nullopt);
 
 RESTART:
   if (result == Result::connection_failed)
@@ -225,5 +335,12 @@ RESTART:
       result = make_request(request, result);
     }
 
+  if (g_settings.read_stdin) {
+    if (g_settings.requests.empty())
+      result = Result::yes;
+    if (result != Result::connection_failed)
+      result = process_stdin_requests(result);
+  }
+
   return result;
 }
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "KeyEvent.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KEY_SEARCH_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define KEY_SEARCH_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Linear searches for keys and events in the short sequences a Stage
+// keeps. A KeyEvent is 4 bytes starting with its key, so a 128 bit
+// register compares 4 events or 8 keys at once. Both vector paths assume
+// little endian, which all targets of SSE2 and NEON are.
+namespace key_search {
+  static_assert(sizeof(Key) == 2 && offsetof(KeyEvent, key) == 0,
+    "unexpected KeyEvent layout");
+
+  inline uint32_t to_bits(const KeyEvent& event) {
+    auto bits = uint32_t{ };
+    std::memcpy(&bits, &event, sizeof(bits));
+    return bits;
+  }
+
+  inline int lowest_bit(unsigned int mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+  }
+
+  inline int highest_bit(unsigned int mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return static_cast<int>(index);
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+  }
+
+#if defined(KEY_SEARCH_SSE2)
+  using Pattern = __m128i;
+
+  inline Pattern event_pattern(uint32_t bits) {
+    return _mm_set1_epi32(static_cast<int>(bits));
+  }
+
+  // one bit per event, for which the masked bits are equal
+  inline unsigned int match_events(const KeyEvent* events,
+      Pattern pattern, Pattern mask) {
+    const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(events));
+    return static_cast<unsigned int>(_mm_movemask_ps(_mm_castsi128_ps(
+      _mm_cmpeq_epi32(_mm_and_si128(block, mask), pattern))));
+  }
+
+  inline bool contains_key_8(const Key* keys, Key key) {
+    const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+    return (_mm_movemask_epi8(_mm_cmpeq_epi16(block,
+      _mm_set1_epi16(static_cast<short>(key)))) != 0);
+  }
+#elif defined(KEY_SEARCH_NEON)
+  using Pattern = uint32x4_t;
+
+  inline Pattern event_pattern(uint32_t bits) {
+    return vdupq_n_u32(bits);
+  }
+
+  inline unsigned int match_events(const KeyEvent* events,
+      Pattern pattern, Pattern mask) {
+    const auto block = vld1q_u32(reinterpret_cast<const uint32_t*>(events));
+    const auto equal = vceqq_u32(vandq_u32(block, mask), pattern);
+    const uint32_t weights[] = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(equal, vld1q_u32(weights)));
+  }
+
+  inline bool contains_key_8(const Key* keys, Key key) {
+    const auto block = vld1q_u16(reinterpret_cast<const uint16_t*>(keys));
+    return (vmaxvq_u16(vceqq_u16(block,
+      vdupq_n_u16(static_cast<uint16_t>(key)))) != 0);
+  }
+#endif
+
+  // scalar versions, also used for the remainders
+  inline const KeyEvent* find_key_scalar(const KeyEvent* begin,
+      const KeyEvent* end, Key key) {
+    for (; begin != end; ++begin)
+      if (begin->key == key)
+        return begin;
+    return end;
+  }
+
+  inline const KeyEvent* rfind_key_scalar(const KeyEvent* begin,
+      const KeyEvent* end, Key key) {
+    for (auto it = end; it != begin; )
+      if ((--it)->key == key)
+        return it;
+    return end;
+  }
+
+  inline const KeyEvent* find_event_scalar(const KeyEvent* begin,
+      const KeyEvent* end, const KeyEvent& event) {
+    for (; begin != end; ++begin)
+      if (*begin == event)
+        return begin;
+    return end;
+  }
+
+  inline bool contains_key_scalar(const Key* begin, const Key* end, Key key) {
+    for (; begin != end; ++begin)
+      if (*begin == key)
+        return true;
+    return false;
+  }
+
+#if defined(KEY_SEARCH_SSE2) || defined(KEY_SEARCH_NEON)
+  inline Pattern key_pattern(Key key) {
+    return event_pattern(static_cast<uint32_t>(key));
+  }
+
+  inline Pattern key_mask() {
+    return event_pattern(0xFFFF);
+  }
+#endif
+
+  inline const KeyEvent* find_key(const KeyEvent* begin,
+      const KeyEvent* end, Key key) {
+#if defined(KEY_SEARCH_SSE2) || defined(KEY_SEARCH_NEON)
+    const auto pattern = key_pattern(key);
+    const auto mask = key_mask();
+    for (; end - begin >= 4; begin += 4)
+      if (const auto matches = match_events(begin, pattern, mask))
+        return begin + lowest_bit(matches);
+#endif
+    return find_key_scalar(begin, end, key);
+  }
+
+  inline const KeyEvent* rfind_key(const KeyEvent* begin,
+      const KeyEvent* end, Key key) {
+#if defined(KEY_SEARCH_SSE2) || defined(KEY_SEARCH_NEON)
+    const auto pattern = key_pattern(key);
+    const auto mask = key_mask();
+    auto it = end;
+    for (; it - begin >= 4; it -= 4)
+      if (const auto matches = match_events(it - 4, pattern, mask))
+        return it - 4 + highest_bit(matches);
+    const auto found = rfind_key_scalar(begin, it, key);
+    return (found != it ? found : end);
+#else
+    return rfind_key_scalar(begin, end, key);
+#endif
+  }
+
+  inline const KeyEvent* find_event(const KeyEvent* begin,
+      const KeyEvent* end, const KeyEvent& event) {
+#if defined(KEY_SEARCH_SSE2) || defined(KEY_SEARCH_NEON)
+    const auto pattern = event_pattern(to_bits(event));
+    const auto mask = event_pattern(~uint32_t{ });
+    for (; end - begin >= 4; begin += 4)
+      if (const auto matches = match_events(begin, pattern, mask))
+        return begin + lowest_bit(matches);
+#endif
+    return find_event_scalar(begin, end, event);
+  }
+
+  inline bool contains_key(const Key* begin, const Key* end, Key key) {
+#if defined(KEY_SEARCH_SSE2) || defined(KEY_SEARCH_NEON)
+    for (; end - begin >= 8; begin += 8)
+      if (contains_key_8(begin, key))
+        return true;
+#endif
+    return contains_key_scalar(begin, end, key);
+  }
+} // namespace key_search
+
+// overloads for containers
+template<typename C>
+typename C::const_iterator find_key(const C& sequence, Key key) {
+  const auto data = sequence.data();
+  return sequence.begin() + (key_search::find_key(data,
+    data + sequence.size(), key) - data);
+}
+
+template<typename C>
+typename C::const_iterator rfind_key(const C& sequence, Key key) {
+  const auto data = sequence.data();
+  return sequence.begin() + (key_search::rfind_key(data,
+    data + sequence.size(), key) - data);
+}
+
+template<typename C>
+bool contains_event(const C& sequence, const KeyEvent& event) {
+  const auto data = sequence.data();
+  const auto end = data + sequence.size();
+  return (key_search::find_event(data, end, event) != end);
+}
+
+inline bool contains_key(const std::vector<Key>& keys, Key key) {
+  return key_search::contains_key(keys.data(), keys.data() + keys.size(), key);
+}
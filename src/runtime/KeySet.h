@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Key.h"
+#include <array>
+#include <cstdint>
+
+// Set of keys with one bit for each possible key, so that membership
+// is tested and updated in constant time. Several keys of one word
+// can be tested at once by masking.
+class KeySet {
+public:
+  using Word = uint64_t;
+  static constexpr size_t word_bits = 64;
+  static constexpr size_t word_count = (size_t{ 1 } << 16) / word_bits;
+
+  static size_t word_index(Key key) {
+    return static_cast<size_t>(key) / word_bits;
+  }
+  static Word bit(Key key) {
+    return Word{ 1 } << (static_cast<size_t>(key) % word_bits);
+  }
+
+  bool contains(Key key) const {
+    return (m_words[word_index(key)] & bit(key)) != 0;
+  }
+  void set(Key key, bool value) {
+    auto& word = m_words[word_index(key)];
+    word = (value ? word | bit(key) : word & ~bit(key));
+  }
+  Word word(size_t index) const {
+    return m_words[index];
+  }
+  void clear() {
+    m_words.fill(0);
+  }
+
+private:
+  std::array<Word, word_count> m_words{ };
+};
@@ -0,0 +1,359 @@
+#include "MatchAutomaton.h"
+#include <cassert>
+#include <algorithm>
+
+namespace {
+  const auto matches_none = KeyEvent(Key::none, KeyState::Up);
+
+  enum class Step {
+    no_match,
+    might_match,
+    timeout,
+    next_sequence_event,
+    next_expression_event,
+    next_both_events,
+  };
+
+  // a single iteration of MatchKeySequence's loop (without NoMightMatch)
+  Step match_event(const KeyEvent& se, const KeyEvent& ee,
+      std::vector<KeyEvent>& async, std::vector<Key>& not_keys,
+      std::vector<Key>& any_key_matches) {
+    const auto async_state =
+      (se.state == KeyState::Up ? KeyState::UpAsync : KeyState::DownAsync);
+
+    // undo adding to Not keys
+    if (ee.state == KeyState::Down)
+      not_keys.erase(
+        std::remove(not_keys.begin(), not_keys.end(), ee.key), not_keys.end());
+
+    // check if key must not be down
+    if ((se.state == KeyState::Down ||
+         se.state == KeyState::DownMatched) &&
+        std::count(not_keys.begin(), not_keys.end(), se.key))
+      return Step::no_match;
+
+    if (ee.state == KeyState::DownAsync ||
+        ee.state == KeyState::UpAsync) {
+      async.push_back(ee);
+      return Step::next_expression_event;
+    }
+
+    if (ee.state == KeyState::Not && ee.key != Key::timeout) {
+      // add to Not keys
+      not_keys.push_back(ee.key);
+      return Step::next_expression_event;
+    }
+
+    if (ee.key == Key::any && ee.state == KeyState::Up &&
+        se.key != Key::none && se.state == KeyState::Up) {
+      // -Any only matches releases of presses unified with Any
+      if (!std::count(any_key_matches.begin(), any_key_matches.end(), se.key))
+        return Step::no_match;
+      return Step::next_both_events;
+    }
+
+    if (unifiable(se, ee)) {
+      // direct match
+      if (ee.key == Key::any && se.state == KeyState::Down)
+        any_key_matches.push_back(se.key);
+
+      // remove from async
+      async.erase(std::remove_if(async.begin(), async.end(),
+        [&](const KeyEvent& e) { return (se.key == e.key); }),
+        async.end());
+      return Step::next_both_events;
+    }
+
+    // when a timeout is encountered and sequence ended
+    if (ee.key == Key::timeout && se == matches_none)
+      return Step::timeout;
+
+    // try to match sequence event with async
+    auto it = std::find_if(async.begin(), async.end(),
+      [&](const KeyEvent& e) {
+        return (e.state == async_state && unifiable(se.key, e.key));
+      });
+    if (it != async.end()) {
+      // mark async as matched
+      it->state = se.state;
+      return Step::next_sequence_event;
+    }
+
+    // ignore already matched events in sequence
+    if (se.state == KeyState::DownMatched)
+      return Step::next_sequence_event;
+
+    // try to match expression event with async
+    it = std::find_if(async.begin(), async.end(),
+      [&](const KeyEvent& e) { return unifiable(ee, e); });
+    if (it != async.end()) {
+      async.erase(it);
+      return Step::next_expression_event;
+    }
+
+    if (ee.state == KeyState::Down) {
+      // look for unmatched async up and async down
+      it = std::find(async.begin(), async.end(),
+        KeyEvent(ee.key, KeyState::DownAsync));
+      if (it != async.end() &&
+          it != async.begin() &&
+          *std::prev(it) == KeyEvent(ee.key, KeyState::UpAsync))
+        return Step::next_expression_event;
+    }
+
+    // no match with async
+    return (se == matches_none ? Step::might_match : Step::no_match);
+  }
+
+  bool advances_sequence(Step step) {
+    return (step == Step::next_sequence_event ||
+            step == Step::next_both_events);
+  }
+
+  bool advances_expression(Step step) {
+    return (step == Step::next_expression_event ||
+            step == Step::next_both_events);
+  }
+} // namespace
+
+MatchAutomaton::MatchAutomaton(
+    const std::vector<ConstKeySequenceRange>& expressions) {
+  // root node
+  m_nodes.emplace_back();
+
+  for (auto i = 0; i < static_cast<int>(expressions.size()); ++i) {
+    const auto& expression = expressions[i];
+    assert(!expression.empty());
+    const auto supported = std::none_of(expression.begin(), expression.end(),
+      [](const KeyEvent& e) { return (e.state == KeyState::NoMightMatch); });
+    m_supported.push_back(supported);
+    if (!supported)
+      continue;
+
+    auto node = 0;
+    for (const auto& event : expression)
+      node = add_child(node, event);
+    m_nodes[node].expressions.push_back(i);
+  }
+  collect_subtree(0);
+  m_results.resize(expressions.size(), Result{ MatchResult::no_match });
+  reserve_buffers(expressions);
+}
+
+int MatchAutomaton::add_child(int node, const KeyEvent& event) {
+  for (auto child : m_nodes[node].children)
+    if (m_nodes[child].event == event)
+      return child;
+
+  const auto child = static_cast<int>(m_nodes.size());
+  m_nodes.emplace_back().event = event;
+  m_nodes[node].children.push_back(child);
+  return child;
+}
+
+void MatchAutomaton::collect_subtree(int node) {
+  m_nodes[node].subtree_begin = static_cast<int>(m_subtree_expressions.size());
+  m_subtree_expressions.insert(m_subtree_expressions.end(),
+    m_nodes[node].expressions.begin(), m_nodes[node].expressions.end());
+  for (auto child : m_nodes[node].children)
+    collect_subtree(child);
+  m_nodes[node].subtree_end = static_cast<int>(m_subtree_expressions.size());
+}
+
+void MatchAutomaton::reserve_buffers(
+    const std::vector<ConstKeySequenceRange>& expressions) {
+  // buffers of a branch cannot exceed the size of its expression
+  auto max_size = size_t{ };
+  auto any_key_matches = size_t{ };
+  for (const auto& expression : expressions) {
+    max_size = std::max(max_size, expression.size());
+    if (std::any_of(expression.begin(), expression.end(),
+          [](const KeyEvent& e) { return (e.key == Key::any); }))
+      any_key_matches += expression.size();
+  }
+
+  // there cannot be more branches than positions in the trie
+  const auto positions = m_nodes.size() + static_cast<size_t>(
+    std::count_if(m_nodes.begin(), m_nodes.end(),
+      [](const Node& node) { return !node.expressions.empty(); }));
+  m_pending.reserve(positions, max_size);
+  m_suspended.reserve(positions, max_size);
+  m_cursor.async.reserve(max_size);
+  m_cursor.not_keys.reserve(max_size);
+  m_cursor.any_key_matches.reserve(max_size);
+  m_results_set.reserve(expressions.size());
+  m_any_key_matches.reserve(any_key_matches);
+  m_sequence.reserve(max_size + 16);
+}
+
+void MatchAutomaton::CursorStack::reserve(size_t count, size_t buffer_size) {
+  m_cursors.reserve(count);
+  while (m_cursors.size() < count) {
+    auto& cursor = m_cursors.emplace_back();
+    cursor.async.reserve(buffer_size);
+    cursor.not_keys.reserve(buffer_size);
+    cursor.any_key_matches.reserve(buffer_size);
+  }
+}
+
+void MatchAutomaton::CursorStack::swap(CursorStack& other) {
+  m_cursors.swap(other.m_cursors);
+  std::swap(m_size, other.m_size);
+}
+
+auto MatchAutomaton::CursorStack::push(const Cursor& cursor) -> Cursor& {
+  if (m_size == m_cursors.size())
+    m_cursors.push_back(cursor);
+  else
+    m_cursors[m_size] = cursor;
+  return m_cursors[m_size++];
+}
+
+void MatchAutomaton::CursorStack::pop(Cursor* cursor) {
+  assert(m_size > 0);
+  *cursor = m_cursors[--m_size];
+}
+
+void MatchAutomaton::advance_expression(Cursor& cursor,
+    CursorStack* branches) {
+  // continue with children and end of expressions ending at node
+  const auto& node = m_nodes[cursor.node];
+  const auto branch_count = node.children.size() +
+    (node.expressions.empty() ? 0 : 1);
+  assert(branch_count > 0);
+
+  const auto set_branch = [&](Cursor& branch, size_t index) {
+    branch.at_end = (index == node.children.size());
+    if (!branch.at_end)
+      branch.node = node.children[index];
+  };
+  for (auto i = size_t{ 1 }; i < branch_count; ++i)
+    set_branch(branches->push(cursor), i);
+  set_branch(cursor, 0);
+}
+
+void MatchAutomaton::set_result(int expression, MatchResult result,
+    const std::vector<Key>& any_key_matches) {
+  const auto begin = static_cast<int>(m_any_key_matches.size());
+  m_any_key_matches.insert(m_any_key_matches.end(),
+    any_key_matches.begin(), any_key_matches.end());
+  const auto end = static_cast<int>(m_any_key_matches.size());
+  m_results[expression] = { result, { }, begin, end };
+  m_results_set.push_back(expression);
+}
+
+void MatchAutomaton::set_subtree_result(int node, MatchResult result,
+    const KeyEvent& input_timeout_event) {
+  for (auto i = m_nodes[node].subtree_begin; i < m_nodes[node].subtree_end; ++i) {
+    const auto expression = m_subtree_expressions[i];
+    m_results[expression] = { result, input_timeout_event, 0, 0 };
+    m_results_set.push_back(expression);
+  }
+}
+
+void MatchAutomaton::match(ConstKeySequenceRange sequence) {
+  assert(!sequence.empty());
+
+  // continue when sequence only grew since last call
+  const auto continues = (!m_sequence.empty() &&
+    m_sequence.size() <= sequence.size() &&
+    std::equal(m_sequence.begin(), m_sequence.end(), sequence.begin()));
+  if (continues && m_sequence.size() == sequence.size())
+    return;
+
+  for (auto expression : m_results_set)
+    m_results[expression] = { MatchResult::no_match };
+  m_results_set.clear();
+  m_any_key_matches.clear();
+
+  m_pending.clear();
+  if (continues) {
+    m_pending.swap(m_suspended);
+  }
+  else {
+    m_suspended.clear();
+    if (!m_nodes.front().children.empty()) {
+      auto& root = m_cursor;
+      root.node = 0;
+      root.at_end = false;
+      root.sequence_pos = 0;
+      root.async.clear();
+      root.not_keys.clear();
+      root.any_key_matches.clear();
+      advance_expression(root, &m_pending);
+      m_pending.push(root);
+    }
+  }
+  match_sequence(sequence);
+  m_sequence.assign(sequence.begin(), sequence.end());
+
+  for (const auto& cursor : m_suspended)
+    match_sequence_end(cursor);
+}
+
+void MatchAutomaton::match_sequence(ConstKeySequenceRange sequence) {
+  auto& cursor = m_cursor;
+  while (!m_pending.empty()) {
+    m_pending.pop(&cursor);
+
+    for (;;) {
+      // suspend branch until sequence grows
+      if (cursor.sequence_pos == sequence.size()) {
+        m_suspended.push(cursor);
+        break;
+      }
+      const auto& se = sequence[cursor.sequence_pos];
+      const auto& ee = (cursor.at_end ? matches_none :
+        m_nodes[cursor.node].event);
+      const auto step = match_event(se, ee, cursor.async,
+        cursor.not_keys, cursor.any_key_matches);
+      if (step == Step::no_match)
+        break;
+      assert(step != Step::might_match && step != Step::timeout);
+
+      if (advances_sequence(step))
+        ++cursor.sequence_pos;
+      if (advances_expression(step))
+        advance_expression(cursor, &m_pending);
+    }
+  }
+}
+
+void MatchAutomaton::match_sequence_end(const Cursor& suspended) {
+  auto& cursor = m_cursor;
+  m_pending.push(suspended);
+  while (!m_pending.empty()) {
+    m_pending.pop(&cursor);
+
+    for (;;) {
+      if (cursor.at_end) {
+        for (auto expression : m_nodes[cursor.node].expressions)
+          set_result(expression, MatchResult::match, cursor.any_key_matches);
+        break;
+      }
+      const auto& ee = m_nodes[cursor.node].event;
+      const auto step = match_event(matches_none, ee, cursor.async,
+        cursor.not_keys, cursor.any_key_matches);
+      if (step == Step::might_match || step == Step::timeout) {
+        set_subtree_result(cursor.node, MatchResult::might_match,
+          (step == Step::timeout ? ee : KeyEvent{ }));
+        break;
+      }
+      if (!advances_expression(step))
+        break;
+      advance_expression(cursor, &m_pending);
+    }
+  }
+}
+
+MatchResult MatchAutomaton::get_result(int index,
+    std::vector<Key>* any_key_matches, KeyEvent* input_timeout_event) const {
+  assert(m_supported[index]);
+  const auto& result = m_results[index];
+  any_key_matches->assign(
+    m_any_key_matches.begin() + result.any_key_matches_begin,
+    m_any_key_matches.begin() + result.any_key_matches_end);
+  if (result.result == MatchResult::might_match)
+    *input_timeout_event = result.input_timeout_event;
+  return result.result;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "MatchKeySequence.h"
+
+// Matches a sequence against a list of expressions at once, yielding the
+// same results as MatchKeySequence. The expressions are stored in a trie,
+// so common prefixes are matched only once, and the matching state at the
+// end of the sequence is kept, so a sequence which only grew since the
+// last call is matched incrementally.
+class MatchAutomaton {
+public:
+  explicit MatchAutomaton(const std::vector<ConstKeySequenceRange>& expressions);
+
+  // expressions with NoMightMatch need to be matched by MatchKeySequence
+  bool is_supported(int index) const { return m_supported[index]; }
+
+  void match(ConstKeySequenceRange sequence);
+  MatchResult get_result(int index, std::vector<Key>* any_key_matches,
+    KeyEvent* input_timeout_event) const;
+
+private:
+  struct Node {
+    KeyEvent event;
+    std::vector<int> children;
+    // expressions ending at this node
+    std::vector<int> expressions;
+    // range of expressions ending in this subtree
+    int subtree_begin;
+    int subtree_end;
+  };
+
+  // matching state of a branch before next expression event is matched
+  struct Cursor {
+    int node;
+    bool at_end;
+    size_t sequence_pos;
+    std::vector<KeyEvent> async;
+    std::vector<Key> not_keys;
+    std::vector<Key> any_key_matches;
+  };
+
+  // keeps popped cursors, so their buffers can be reused
+  class CursorStack {
+  public:
+    bool empty() const { return (m_size == 0); }
+    std::vector<Cursor>::const_iterator begin() const { return m_cursors.begin(); }
+    std::vector<Cursor>::const_iterator end() const { return m_cursors.begin() + m_size; }
+    void clear() { m_size = 0; }
+    void reserve(size_t count, size_t buffer_size);
+    void swap(CursorStack& other);
+    Cursor& push(const Cursor& cursor);
+    void pop(Cursor* cursor);
+
+  private:
+    std::vector<Cursor> m_cursors;
+    size_t m_size{ };
+  };
+
+  struct Result {
+    MatchResult result;
+    KeyEvent input_timeout_event;
+    int any_key_matches_begin;
+    int any_key_matches_end;
+  };
+
+  int add_child(int node, const KeyEvent& event);
+  void collect_subtree(int node);
+  void reserve_buffers(const std::vector<ConstKeySequenceRange>& expressions);
+  void advance_expression(Cursor& cursor, CursorStack* branches);
+  void set_subtree_result(int node, MatchResult result,
+    const KeyEvent& input_timeout_event);
+  void set_result(int expression, MatchResult result,
+    const std::vector<Key>& any_key_matches);
+  void match_sequence(ConstKeySequenceRange sequence);
+  void match_sequence_end(const Cursor& cursor);
+
+  std::vector<Node> m_nodes;
+  std::vector<bool> m_supported;
+  std::vector<int> m_subtree_expressions;
+
+  // the sequence and the branches which reached its end
+  KeySequence m_sequence;
+  CursorStack m_suspended;
+
+  std::vector<Result> m_results;
+  std::vector<int> m_results_set;
+  std::vector<Key> m_any_key_matches;
+
+  // temporary buffer
+  CursorStack m_pending;
+  Cursor m_cursor{ };
+};
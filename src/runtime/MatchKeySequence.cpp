@@ -1,5 +1,6 @@
 
 #include "MatchKeySequence.h"
+#include "KeySearch.h"
 #include <cassert>
 #include <algorithm>
 
@@ -12,42 +13,42 @@ namespace {
     return (a == b);
   }
 
-  bool unifiable(Key a, Key b) {
-    if (a == Key::none || b == Key::none)
-      return false;
-    if (a == b)
-      return true;
-    // do not let Any match timeout
-    if (a == Key::timeout || b == Key::timeout)
-      return false;
-    if (a == Key::any && is_keyboard_key(b))
-      return true;
-    if (b == Key::any && is_keyboard_key(a))
-      return true;
-    return false;
-  }
-
   // not commutative, first parameter needs to be input sequence
   bool timeout_unifiable(const KeyEvent& se, const KeyEvent& ee) {
     const auto time_reached = (se.value >= ee.value);
     const auto is_not = (is_not_timeout(se.state) || is_not_timeout(ee.state));
     return (is_not ? !time_reached : time_reached);
   }
-
-  bool unifiable(const KeyEvent& a, const KeyEvent& b) {
-    // do not let Any match again
-    if (a.key == Key::any && b.state == KeyState::DownMatched)
-      return false;
-    if (b.key == Key::any && a.state == KeyState::DownMatched)
-      return false;
-    if (!unifiable(a.key, b.key))
-      return false;
-    if (a.key == Key::timeout)
-      return timeout_unifiable(a, b);
-    return unifiable(a.state, b.state);
-  }
 } // namespace
 
+bool unifiable(Key a, Key b) {
+  if (a == Key::none || b == Key::none)
+    return false;
+  if (a == b)
+    return true;
+  // do not let Any match timeout
+  if (a == Key::timeout || b == Key::timeout)
+    return false;
+  if (a == Key::any && is_keyboard_key(b))
+    return true;
+  if (b == Key::any && is_keyboard_key(a))
+    return true;
+  return false;
+}
+
+bool unifiable(const KeyEvent& a, const KeyEvent& b) {
+  // do not let Any match again
+  if (a.key == Key::any && b.state == KeyState::DownMatched)
+    return false;
+  if (b.key == Key::any && a.state == KeyState::DownMatched)
+    return false;
+  if (!unifiable(a.key, b.key))
+    return false;
+  if (a.key == Key::timeout)
+    return timeout_unifiable(a, b);
+  return unifiable(a.state, b.state);
+}
+
 MatchResult MatchKeySequence::operator()(ConstKeySequenceRange expression,
                                          ConstKeySequenceRange sequence,
                                          std::vector<Key>* any_key_matches,
@@ -78,7 +79,7 @@ MatchResult MatchKeySequence::operator()(ConstKeySequenceRange expression,
     // check if key must not be down
     if ((se.state == KeyState::Down || 
          se.state == KeyState::DownMatched) &&
-        std::count(m_not_keys.begin(), m_not_keys.end(), se.key))
+        contains_key(m_not_keys, se.key))
       return MatchResult::no_match;
 
     if (ee.state == KeyState::DownAsync ||
@@ -94,7 +95,7 @@ MatchResult MatchKeySequence::operator()(ConstKeySequenceRange expression,
     else if (ee.key == Key::any && ee.state == KeyState::Up &&
              se.key != Key::none && se.state == KeyState::Up) {
       // -Any only matches releases of presses unified with Any
-      if (!std::count(any_key_matches->begin(), any_key_matches->end(), se.key))
+      if (!contains_key(*any_key_matches, se.key))
         return MatchResult::no_match;
       ++s;
       ++e;
@@ -108,9 +109,11 @@ MatchResult MatchKeySequence::operator()(ConstKeySequenceRange expression,
         any_key_matches->push_back(se.key);
 
       // remove from async
-      m_async.erase(std::remove_if(begin(m_async), end(m_async),
-        [&](const KeyEvent& e) { return (se.key == e.key); }), 
-        end(m_async));
+      const auto it = find_key(m_async, se.key);
+      if (it != m_async.end())
+        m_async.erase(std::remove_if(m_async.begin() + (it - m_async.cbegin()),
+          end(m_async), [&](const KeyEvent& e) { return (se.key == e.key); }),
+          end(m_async));
     }
     else if (ee.key == Key::timeout && se == matches_none) {
       // when a timeout is encountered and sequence ended
@@ -185,7 +188,7 @@ MatchResult MatchKeySequence::operator()(ConstKeySequenceRange expression,
         else {
           // also ignore Ups of ignored Downs
           if (se.state == KeyState::Up &&
-              std::count(m_ignore_ups.begin(), m_ignore_ups.end(), se.key)) {
+              contains_key(m_ignore_ups, se.key)) {
             ++s;
             continue;
           }
@@ -201,3 +204,9 @@ MatchResult MatchKeySequence::operator()(ConstKeySequenceRange expression,
   return MatchResult::match;
 }
 
+
+void MatchKeySequence::reserve(size_t capacity) {
+  m_async.reserve(capacity);
+  m_not_keys.reserve(capacity);
+  m_ignore_ups.reserve(capacity);
+}
@@ -4,6 +4,10 @@
 
 enum class MatchResult { no_match, might_match, match };
 
+// first parameter needs to be from input sequence
+bool unifiable(Key a, Key b);
+bool unifiable(const KeyEvent& a, const KeyEvent& b);
+
 class MatchKeySequence {
 public:
   MatchResult operator()(
@@ -12,6 +16,8 @@ public:
     std::vector<Key>* any_key_matches,
     KeyEvent* input_timeout_event) const;
 
+  void reserve(size_t capacity);
+
 private:
   // temporary buffer
   mutable std::vector<KeyEvent> m_async;
@@ -13,7 +13,13 @@ MultiStage::MultiStage(std::vector<StagePtr> stages)
   : m_stages(std::move(stages)) {
 
   for (const auto& stage : m_stages)
-    m_context_count += stage->contexts().size();
+    m_context_count += stage->context_count();
+
+  // reserve buffers, so they do not need to grow while updating
+  const auto capacity = 64;
+  m_output_buffer.reserve(capacity);
+  m_input_buffer.reserve(capacity);
+  m_context_active_buffer.reserve(capacity);
 }
 
 bool MultiStage::has_mouse_mappings() const {
@@ -64,7 +70,7 @@ KeySequence MultiStage::set_active_client_contexts(const std::vector<int>& indic
       }
 
     const auto indices_begin = context_offset;
-    const auto indices_end = context_offset + static_cast<int>(stage->contexts().size());
+    const auto indices_end = context_offset + static_cast<int>(stage->context_count());
     context_offset = indices_end;
     m_indices_buffer.clear();
     for (auto index : indices)
@@ -75,7 +81,7 @@ KeySequence MultiStage::set_active_client_contexts(const std::vector<int>& indic
       output.begin(), output.end());
     stage->reuse_buffer(std::move(output));
   }
-  return m_output_buffer;
+  return std::move(m_output_buffer);
 }
 
 KeySequence MultiStage::update(KeyEvent event, int device_index) {  
@@ -131,3 +137,20 @@ bool MultiStage::should_exit() const {
     return false;
   return m_stages.front()->should_exit();
 }
+
+void MultiStage::set_match_automaton_enabled(bool enabled) {
+  for (auto& stage : m_stages)
+    stage->set_match_automaton_enabled(enabled);
+}
+
+bool MultiStage::replace_context(int context_index, Stage::Context context) {
+  for (auto& stage : m_stages) {
+    const auto context_count = static_cast<int>(stage->context_count());
+    if (context_index >= 0 && context_index < context_count) {
+      stage->replace_context(context_index, std::move(context));
+      return true;
+    }
+    context_index -= context_count;
+  }
+  return false;
+}
@@ -23,6 +23,8 @@ public:
   void reuse_buffer(KeySequence&& buffer);
   void validate_state(const std::function<bool(Key)>& is_down);
   bool should_exit() const;
+  void set_match_automaton_enabled(bool enabled);
+  bool replace_context(int context_index, Stage::Context context);
 
 private:
   size_t m_context_count{ };
@@ -1,5 +1,6 @@
 
 #include "Stage.h"
+#include "KeySearch.h"
 #include <cassert>
 #include <algorithm>
 #include <array>
@@ -9,19 +10,6 @@
 namespace {
   const auto exit_sequence = std::array{ Key::ShiftLeft, Key::Escape, Key::K };
 
-  KeySequence::const_iterator find_key(const KeySequence& sequence, Key key) {
-    return std::find_if(begin(sequence), end(sequence),
-      [&](const auto& ev) { return ev.key == key; });
-  }
-
-  KeySequence::const_iterator rfind_key(const KeySequence& sequence, Key key) {
-    auto it = std::find_if(rbegin(sequence), rend(sequence),
-      [&](const auto& ev) { return ev.key == key; });
-    if (it != rend(sequence))
-      return std::next(it).base();
-    return end(sequence);
-  }
-
   template<typename It, typename T>
   bool contains(It begin, It end, const T& v) {
     return std::find(begin, end, v) != end;
@@ -45,58 +33,52 @@ namespace {
       [](const KeyEvent& e) { return (e.state == KeyState::Down); });
   }
 
-  // sort outputs by growing negative index (to allow binary search)
-  std::vector<Stage::Context> sort_command_outputs(
-      std::vector<Stage::Context> contexts) {
-    for (auto& context : contexts)
-      std::sort(begin(context.command_outputs), end(context.command_outputs),
-        [](const Stage::CommandOutput& a, const Stage::CommandOutput& b) { 
-          return a.index > b.index; 
-        });
-    return contexts;
+  // sort outputs by index (to allow binary search)
+  void sort_command_outputs(Stage::Context& context) {
+    std::sort(begin(context.command_outputs), end(context.command_outputs),
+      [](const Stage::CommandOutput& a, const Stage::CommandOutput& b) { 
+        return a.index < b.index; 
+      });
   }
 
-  bool has_mouse_mappings(const KeySequence& sequence) {
+  bool has_mouse_mappings(ConstKeySequenceRange sequence) {
     return std::any_of(begin(sequence), end(sequence),
       [](const KeyEvent& event) {
         return is_mouse_button(event.key) || is_mouse_wheel(event.key);
       });
   }
 
-  bool has_mouse_mappings(const std::vector<Stage::Context>& contexts) {
-    for (const auto& context : contexts) {
-      if (has_mouse_mappings(context.modifier_filter))
-        return true;
-      for (const auto& input : context.inputs)
-        if (has_mouse_mappings(input.input))
-          return true;
-    }
-    return false;
+  bool is_no_might_match_mapping(ConstKeySequenceRange sequence) {
+    return (!sequence.empty() && 
+      sequence[0].state == KeyState::NoMightMatch);
   }
 
-  bool has_device_filter(const Stage::Context& context) {
-    return (context.device_filter ||
-            context.device_id_filter);
-  }
+  // collects the keys one of which the first not yet matched event of
+  // a sequence needs to have, for the input to match or might match
+  bool get_first_keys(ConstKeySequenceRange input, std::vector<Key>* keys) {
+    keys->clear();
+    if (is_no_might_match_mapping(input))
+      return false;
 
-  bool has_device_filter(const std::vector<Stage::Context>& contexts) {
-    for (const auto& context : contexts)
-      if (has_device_filter(context))
-        return true;
-    return false;
-  }
+    for (const auto& event : input) {
+      if (event.key == Key::any)
+        return false;
 
-  bool is_no_might_match_mapping(const KeySequence& sequence) {
-    return (!sequence.empty() && 
-      sequence.front().state == KeyState::NoMightMatch);
-  }
+      // Not keys are only checked, never matched
+      if (event.state == KeyState::Not && event.key != Key::timeout)
+        continue;
+
+      // events can be skipped, when an async event with the key preceded
+      const auto preceded_by_async = contains_key(*keys, event.key);
+      if (!preceded_by_async)
+        keys->push_back(event.key);
 
-  bool has_no_might_match_mapping(const std::vector<Stage::Context>& contexts) {
-    for (const auto& context : contexts)
-      for (const auto& input : context.inputs)
-        if (is_no_might_match_mapping(input.input))
-          return true;
-    return false;
+      if (event.state != KeyState::UpAsync &&
+          event.state != KeyState::DownAsync &&
+          !preceded_by_async)
+        break;
+    }
+    return true;
   }
 
   const KeyEvent* find_last_down_event(ConstKeySequenceRange sequence) {
@@ -116,34 +98,484 @@ namespace {
     return last;
   }
 
-  KeyEvent get_trigger_event(const Trigger& trigger) {
-    if (const auto* event = std::get_if<KeyEvent>(&trigger))
-      return *event;
+  ConstKeySequenceRange without_first(ConstKeySequenceRange sequence) {
+    return { std::next(sequence.begin()), sequence.end() };
+  }
 
-    if (const auto* key = std::get_if<Key>(&trigger))
-      return KeyEvent{ *key, KeyState::Down };
+  template<typename T>
+  uint32_t to_offset(const T& size) {
+    return static_cast<uint32_t>(size);
+  }
 
-    const auto& input = *std::get<const KeySequence*>(trigger);
-    if (auto event = find_last_non_optional(input))
-      return *event;
+  template<typename T>
+  bool within(const T& span, uint32_t offset) {
+    return (offset >= span.begin && offset < span.end);
+  }
 
-    return input.back();
+  // replaces a range of a table, returns by how much the rest moved
+  template<typename Table>
+  int replace_range(Table& table, const StageSpan& span, const Table& elements) {
+    const auto size = static_cast<size_t>(span.end - span.begin);
+    const auto common = std::min(size, elements.size());
+    const auto it = std::copy_n(elements.begin(), common,
+      table.begin() + span.begin);
+    if (size > common)
+      table.erase(it, it + static_cast<std::ptrdiff_t>(size - common));
+    else
+      table.insert(it, elements.begin() + 
+        static_cast<std::ptrdiff_t>(common), elements.end());
+    return static_cast<int>(elements.size()) - static_cast<int>(size);
   }
 
-  Key get_trigger_key(const Trigger& trigger) {
-    return get_trigger_event(trigger).key;
+  void shift_span(StageSpan& span, int delta) {
+    span.begin += static_cast<uint32_t>(delta);
+    span.end += static_cast<uint32_t>(delta);
   }
 
-  ConstKeySequenceRange without_first(ConstKeySequenceRange sequence) {
-    return { std::next(sequence.begin()), sequence.end() };
+  // finds the context a table entry or event belongs to
+  template<typename T>
+  int find_context(const std::vector<T>& spans, uint32_t offset) {
+    const auto it = std::find_if(spans.begin(), spans.end(),
+      [&](const T& span) { return within(span, offset); });
+    return (it != spans.end() ? static_cast<int>(it - spans.begin()) : -1);
   }
 } // namespace
 
-Stage::Stage(std::vector<Context> contexts)
-  : m_contexts(sort_command_outputs(std::move(contexts))),
-    m_has_mouse_mappings(::has_mouse_mappings(m_contexts)),
-    m_has_device_filter(::has_device_filter(m_contexts)),
-    m_has_no_might_match_mapping(::has_no_might_match_mapping(m_contexts)) {
+Stage::Stage(std::vector<Context> contexts) {
+  set_contexts(std::move(contexts));
+}
+
+void Stage::set_contexts(std::vector<Context> contexts) {
+  // allocate pool and tables at once
+  auto event_count = size_t{ };
+  auto input_count = size_t{ };
+  auto output_count = size_t{ };
+  auto command_output_count = size_t{ };
+  for (const auto& context : contexts) {
+    event_count += context.modifier_filter.size();
+    for (const auto& input : context.inputs)
+      event_count += input.input.size();
+    for (const auto& output : context.outputs)
+      event_count += output.size();
+    for (const auto& command : context.command_outputs)
+      event_count += command.output.size();
+    input_count += context.inputs.size();
+    output_count += context.outputs.size();
+    command_output_count += context.command_outputs.size();
+  }
+  const auto reset = [](auto& vector, size_t size) {
+    vector.clear();
+    vector.reserve(size);
+  };
+  reset(m_events, event_count);
+  reset(m_inputs, input_count);
+  reset(m_input_output_indices, input_count);
+  reset(m_outputs, output_count);
+  reset(m_command_outputs, command_output_count);
+  reset(m_command_output_indices, command_output_count);
+  reset(m_context_events, contexts.size());
+  reset(m_context_inputs, contexts.size());
+  reset(m_context_outputs, contexts.size());
+  reset(m_context_command_outputs, contexts.size());
+  reset(m_context_modifier_filters, contexts.size());
+  reset(m_context_flags, contexts.size());
+  reset(m_context_matching_device_bits, contexts.size());
+  reset(m_context_device_filters, contexts.size());
+  reset(m_input_indices, contexts.size());
+
+  const auto add_events = [&](const KeySequence& sequence) {
+    const auto begin = to_offset(m_events.size());
+    m_events.insert(m_events.end(), sequence.begin(), sequence.end());
+    return Span{ begin, to_offset(m_events.size()) };
+  };
+  for (auto& context : contexts) {
+    sort_command_outputs(context);
+    const auto events_begin = to_offset(m_events.size());
+    const auto inputs_begin = to_offset(m_inputs.size());
+    const auto outputs_begin = to_offset(m_outputs.size());
+    const auto command_outputs_begin = to_offset(m_command_outputs.size());
+    for (const auto& input : context.inputs) {
+      m_inputs.push_back(add_events(input.input));
+      m_input_output_indices.push_back(input.output_index);
+    }
+    for (const auto& output : context.outputs)
+      m_outputs.push_back(add_events(output));
+    for (const auto& command : context.command_outputs) {
+      m_command_outputs.push_back(add_events(command.output));
+      m_command_output_indices.push_back(command.index);
+    }
+    m_context_modifier_filters.push_back(add_events(context.modifier_filter));
+    m_context_events.push_back({ events_begin, to_offset(m_events.size()) });
+    m_context_inputs.push_back({ inputs_begin, to_offset(m_inputs.size()) });
+    m_context_outputs.push_back({ outputs_begin, to_offset(m_outputs.size()) });
+    m_context_command_outputs.push_back({ command_outputs_begin,
+      to_offset(m_command_outputs.size()) });
+    m_context_flags.push_back({ context.invert_modifier_filter,
+      context.fallthrough });
+    m_context_matching_device_bits.push_back(context.matching_device_bits);
+    m_context_device_filters.push_back({ std::move(context.device_filter),
+      std::move(context.device_id_filter) });
+  }
+  initialize();
+}
+
+Stage::Stage(const StageImage& image) {
+  // copy tables at once
+  const auto& header = *image.header;
+  m_events.assign(image.events, image.events + header.event_count);
+  m_inputs.assign(image.inputs, image.inputs + header.input_count);
+  m_input_output_indices.assign(image.input_output_indices,
+    image.input_output_indices + header.input_count);
+  m_outputs.assign(image.outputs, image.outputs + header.output_count);
+  m_command_outputs.assign(image.command_outputs,
+    image.command_outputs + header.command_output_count);
+  m_command_output_indices.assign(image.command_output_indices,
+    image.command_output_indices + header.command_output_count);
+
+  const auto count = header.context_count;
+  m_context_events.reserve(count);
+  m_context_inputs.reserve(count);
+  m_context_outputs.reserve(count);
+  m_context_command_outputs.reserve(count);
+  m_context_modifier_filters.reserve(count);
+  m_context_flags.reserve(count);
+  m_context_matching_device_bits.resize(count, uint64_t{ all_device_bits });
+  m_context_device_filters.reserve(count);
+  m_input_indices.reserve(count);
+  for (auto i = 0u; i < count; ++i) {
+    const auto& context = image.contexts[i];
+    m_context_events.push_back(context.events);
+    m_context_inputs.push_back(context.inputs);
+    m_context_outputs.push_back(context.outputs);
+    m_context_command_outputs.push_back(context.command_outputs);
+    m_context_modifier_filters.push_back(context.modifier_filter);
+    m_context_flags.push_back({
+      (context.flags & StageImage::invert_modifier_filter_flag) != 0,
+      (context.flags & StageImage::fallthrough_flag) != 0 });
+    m_context_device_filters.push_back({
+      (i < image.device_filters.size() ? image.device_filters[i] : Filter{ }),
+      (i < image.device_id_filters.size() ? image.device_id_filters[i] : Filter{ }) });
+  }
+  initialize();
+}
+
+void Stage::set_context(int context_index, Context context) {
+  // pack events and tables of context, starting where the old ones began
+  sort_command_outputs(context);
+  const auto events_begin = m_context_events[context_index].begin;
+  auto events = KeySequence();
+  auto inputs = std::vector<Span>();
+  auto input_output_indices = std::vector<int>();
+  auto outputs = std::vector<Span>();
+  auto command_outputs = std::vector<Span>();
+  auto command_output_indices = std::vector<int>();
+  const auto add_events = [&](const KeySequence& sequence) {
+    const auto begin = events_begin + to_offset(events.size());
+    events.insert(events.end(), sequence.begin(), sequence.end());
+    return Span{ begin, events_begin + to_offset(events.size()) };
+  };
+  for (const auto& input : context.inputs) {
+    inputs.push_back(add_events(input.input));
+    input_output_indices.push_back(input.output_index);
+  }
+  for (const auto& output : context.outputs)
+    outputs.push_back(add_events(output));
+  for (const auto& command : context.command_outputs) {
+    command_outputs.push_back(add_events(command.output));
+    command_output_indices.push_back(command.index);
+  }
+  const auto modifier_filter = add_events(context.modifier_filter);
+
+  // replace ranges of context in pool and tables
+  const auto events_delta = replace_range(m_events,
+    m_context_events[context_index], events);
+  replace_range(m_input_output_indices, 
+    m_context_inputs[context_index], input_output_indices);
+  const auto inputs_delta = replace_range(m_inputs,
+    m_context_inputs[context_index], inputs);
+  const auto outputs_delta = replace_range(m_outputs,
+    m_context_outputs[context_index], outputs);
+  replace_range(m_command_output_indices,
+    m_context_command_outputs[context_index], command_output_indices);
+  const auto command_outputs_delta = replace_range(m_command_outputs,
+    m_context_command_outputs[context_index], command_outputs);
+
+  // update spans of context and move those of the following contexts
+  const auto update_spans = [&](std::vector<Span>& spans, 
+      size_t size, int delta) {
+    auto& span = spans[static_cast<size_t>(context_index)];
+    span.end = span.begin + to_offset(size);
+    for (auto it = std::next(&span); it != spans.data() + spans.size(); ++it)
+      shift_span(*it, delta);
+  };
+  update_spans(m_context_events, events.size(), events_delta);
+  update_spans(m_context_inputs, inputs.size(), inputs_delta);
+  update_spans(m_context_outputs, outputs.size(), outputs_delta);
+  update_spans(m_context_command_outputs, command_outputs.size(),
+    command_outputs_delta);
+  m_context_modifier_filters[context_index] = modifier_filter;
+  if (events_delta) {
+    for (auto i = context_index + 1; i < static_cast<int>(context_count()); ++i)
+      shift_span(m_context_modifier_filters[i], events_delta);
+    for (auto [table, context_spans] : {
+          std::pair(&m_inputs, &m_context_inputs),
+          std::pair(&m_outputs, &m_context_outputs),
+          std::pair(&m_command_outputs, &m_context_command_outputs) })
+      for (auto i = (*context_spans)[context_index].end; i < table->size(); ++i)
+        shift_span((*table)[i], events_delta);
+  }
+
+  m_context_flags[context_index] = { context.invert_modifier_filter,
+    context.fallthrough };
+  m_context_matching_device_bits[context_index] = context.matching_device_bits;
+  m_context_device_filters[context_index] = { std::move(context.device_filter),
+    std::move(context.device_id_filter) };
+
+  // update data derived from context
+  auto masks = std::vector<ModifierMask>();
+  add_modifier_masks(modifier_filter, &masks);
+  const auto masks_delta = replace_range(m_modifier_masks,
+    m_context_modifier_masks[context_index], masks);
+  update_spans(m_context_modifier_masks, masks.size(), masks_delta);
+  m_input_indices[context_index] = create_input_index(context_index);
+  update_mapping_flags();
+  reserve_buffers();
+}
+
+void Stage::update_mapping_flags() {
+  m_has_mouse_mappings = false;
+  m_has_no_might_match_mapping = false;
+  for (const auto& modifier_filter : m_context_modifier_filters)
+    m_has_mouse_mappings |= ::has_mouse_mappings(events(modifier_filter));
+  for (const auto& input : m_inputs) {
+    m_has_mouse_mappings |= ::has_mouse_mappings(events(input));
+    m_has_no_might_match_mapping |= is_no_might_match_mapping(events(input));
+  }
+  m_has_device_filter = false;
+  for (auto i = 0; i < static_cast<int>(context_count()); ++i)
+    m_has_device_filter |= has_device_filter(i);
+}
+
+void Stage::add_modifier_masks(const Span& modifier_filter,
+    std::vector<ModifierMask>* masks) const {
+  // compile modifier filter to masks
+  const auto begin = masks->size();
+  for (const auto& modifier : events(modifier_filter)) {
+    const auto index = static_cast<uint32_t>(KeySet::word_index(modifier.key));
+    auto it = std::find_if(masks->begin() + static_cast<std::ptrdiff_t>(begin),
+      masks->end(), [&](const ModifierMask& mask) {
+        return mask.word_index == index;
+      });
+    if (it == masks->end())
+      it = masks->insert(it, { index, 0, 0 });
+    (modifier.state != KeyState::Not ? it->required : it->forbidden) |=
+      KeySet::bit(modifier.key);
+  }
+}
+
+auto Stage::create_input_index(int context_index) const -> InputIndex {
+  // index inputs by the keys a matching sequence can start with
+  auto index = InputIndex();
+  auto keys = std::vector<Key>();
+  const auto& inputs = m_context_inputs[context_index];
+  for (auto j = 0; j < static_cast<int>(inputs.end - inputs.begin); ++j) {
+    if (get_first_keys(events(context_input(context_index, j)), &keys)) {
+      for (auto key : keys)
+        index.by_key.emplace_back(key, j);
+    }
+    else {
+      index.unindexed.push_back(j);
+    }
+  }
+  std::sort(index.by_key.begin(), index.by_key.end());
+  return index;
+}
+
+void Stage::initialize() {
+  update_mapping_flags();
+  m_modifier_masks.clear();
+  m_context_modifier_masks.clear();
+  m_input_indices.clear();
+  for (auto i = 0; i < static_cast<int>(context_count()); ++i) {
+    const auto begin = to_offset(m_modifier_masks.size());
+    add_modifier_masks(m_context_modifier_filters[i], &m_modifier_masks);
+    m_context_modifier_masks.push_back({ begin, to_offset(m_modifier_masks.size()) });
+    m_input_indices.push_back(create_input_index(i));
+  }
+  reserve_buffers();
+}
+
+auto Stage::get_context(int context_index) const -> Context {
+  const auto to_sequence = [&](const Span& span) {
+    const auto range = events(span);
+    auto sequence = KeySequence();
+    sequence.assign(range.begin(), range.end());
+    return sequence;
+  };
+  auto context = Context();
+  const auto& inputs = m_context_inputs[context_index];
+  for (auto i = inputs.begin; i < inputs.end; ++i)
+    context.inputs.push_back({ to_sequence(m_inputs[i]),
+      m_input_output_indices[i] });
+  const auto& outputs = m_context_outputs[context_index];
+  for (auto i = outputs.begin; i < outputs.end; ++i)
+    context.outputs.push_back(to_sequence(m_outputs[i]));
+  const auto& command_outputs = m_context_command_outputs[context_index];
+  for (auto i = command_outputs.begin; i < command_outputs.end; ++i)
+    context.command_outputs.push_back({ to_sequence(m_command_outputs[i]),
+      m_command_output_indices[i] });
+  const auto& device_filters = m_context_device_filters[context_index];
+  context.device_filter = device_filters.device_filter;
+  context.device_id_filter = device_filters.device_id_filter;
+  context.modifier_filter = to_sequence(m_context_modifier_filters[context_index]);
+  context.matching_device_bits = m_context_matching_device_bits[context_index];
+  context.invert_modifier_filter = m_context_flags[context_index].invert_modifier_filter;
+  context.fallthrough = m_context_flags[context_index].fallthrough;
+  return context;
+}
+
+ConstKeySequenceRange Stage::events(const Span& span) const {
+  return { m_events.begin() + span.begin, m_events.begin() + span.end };
+}
+
+auto Stage::context_input(int context_index, int input_index) const -> const Span& {
+  return m_inputs[m_context_inputs[context_index].begin + 
+    static_cast<uint32_t>(input_index)];
+}
+
+bool Stage::has_device_filter(int context_index) const {
+  const auto& filters = m_context_device_filters[context_index];
+  return (filters.device_filter || filters.device_id_filter);
+}
+
+KeyEvent Stage::get_trigger_event(const Trigger& trigger) const {
+  if (const auto* event = std::get_if<KeyEvent>(&trigger))
+    return *event;
+
+  if (const auto* key = std::get_if<Key>(&trigger))
+    return KeyEvent{ *key, KeyState::Down };
+
+  const auto input = events(*std::get<const Span*>(trigger));
+  if (auto event = find_last_non_optional(input))
+    return *event;
+
+  return input[input.size() - 1];
+}
+
+Key Stage::get_trigger_key(const Trigger& trigger) const {
+  return get_trigger_event(trigger).key;
+}
+
+void Stage::reserve_buffers() {
+  // reserve buffers, so they do not need to grow while matching
+  auto max_sequence_size = size_t{ };
+  for (const auto* table : { &m_inputs, &m_outputs, &m_command_outputs })
+    for (const auto& span : *table)
+      max_sequence_size = std::max(max_sequence_size, 
+        static_cast<size_t>(span.end - span.begin));
+  const auto capacity = max_sequence_size + 16;
+  m_sequence.reserve(capacity);
+  m_history.reserve(capacity * 4);
+  m_match.reserve(capacity * 4);
+  m_active_contexts.reserve(context_count());
+  m_prev_active_contexts.reserve(context_count());
+  m_lookup_keys.reserve(capacity);
+  for (const auto& inputs : m_context_inputs)
+    m_input_candidates.reserve(inputs.end - inputs.begin);
+  m_output_down.reserve(capacity);
+  m_output_on_release.reserve(capacity);
+  m_output_buffer.reserve(capacity);
+  m_any_key_matches.reserve(capacity);
+  m_history_any_key_matches.reserve(capacity);
+}
+
+void Stage::replace_context(int context_index, Context context) {
+  assert(context_index >= 0 &&
+         context_index < static_cast<int>(context_count()));
+
+  // keep output down, but stop referring to the replaced inputs,
+  // remember position of the others, which can move
+  const auto replaced_inputs = m_context_inputs[context_index];
+  auto output_down_inputs = std::vector<std::pair<size_t, uint32_t>>();
+  for (auto i = size_t{ }; i < m_output_down.size(); ++i) {
+    auto& trigger = m_output_down[i].trigger;
+    if (const auto input = std::get_if<const Span*>(&trigger)) {
+      const auto index = to_offset(*input - m_inputs.data());
+      if (within(replaced_inputs, index))
+        trigger = get_trigger_event(trigger);
+      else
+        output_down_inputs.emplace_back(i, index);
+    }
+  }
+
+  // cancel what is still to be output from the replaced outputs,
+  // remember position of the others within their context
+  struct Position {
+    int context_index;
+    uint32_t offset;
+  };
+  auto output_on_release_positions = std::vector<Position>();
+  m_output_on_release.erase(
+    std::remove_if(begin(m_output_on_release), end(m_output_on_release),
+      [&](const OutputOnRelease& output) {
+        return within(m_context_events[context_index], output.sequence.begin) &&
+          output.sequence.begin != output.sequence.end;
+      }),
+    end(m_output_on_release));
+  for (const auto& output : m_output_on_release) {
+    const auto& sequence = output.sequence;
+    const auto index = (sequence.begin != sequence.end ?
+      find_context(m_context_events, sequence.begin) : -1);
+    output_on_release_positions.push_back({ index, (index < 0 ? 0 :
+      sequence.begin - m_context_events[index].begin) });
+  }
+
+  auto matched_output = std::optional<Position>();
+  auto matched_command_output = false;
+  if (m_current_timeout && m_current_timeout->matched_output) {
+    const auto output = m_current_timeout->matched_output;
+    matched_command_output = (output < m_outputs.data() ||
+      output >= m_outputs.data() + m_outputs.size());
+    const auto& table = (matched_command_output ? m_command_outputs : m_outputs);
+    const auto& spans = (matched_command_output ? 
+      m_context_command_outputs : m_context_outputs);
+    const auto offset = to_offset(output - table.data());
+    const auto index = find_context(spans, offset);
+    if (index == context_index)
+      m_current_timeout.reset();
+    else
+      matched_output = Position{ index, offset - spans[index].begin };
+  }
+
+  set_context(context_index, std::move(context));
+
+  const auto inputs_delta = m_context_inputs[context_index].end - 
+    replaced_inputs.end;
+  for (auto [i, index] : output_down_inputs)
+    m_output_down[i].trigger = &m_inputs[index < replaced_inputs.end ? 
+      index : index + inputs_delta];
+
+  for (auto i = size_t{ }; i < m_output_on_release.size(); ++i) {
+    auto& sequence = m_output_on_release[i].sequence;
+    const auto [index, offset] = output_on_release_positions[i];
+    const auto size = sequence.end - sequence.begin;
+    sequence.begin = (index < 0 ? 0 : m_context_events[index].begin + offset);
+    sequence.end = sequence.begin + size;
+  }
+  if (matched_output) {
+    const auto [index, offset] = *matched_output;
+    m_current_timeout->matched_output = (matched_command_output ?
+      &m_command_outputs[m_context_command_outputs[index].begin + offset] :
+      &m_outputs[m_context_outputs[index].begin + offset]);
+  }
+
+  if (!m_match_automata.empty()) {
+    auto expressions = std::vector<ConstKeySequenceRange>();
+    const auto& inputs = m_context_inputs[context_index];
+    for (auto i = inputs.begin; i < inputs.end; ++i)
+      expressions.push_back(events(m_inputs[i]));
+    m_match_automata[context_index] = MatchAutomaton(expressions);
+  }
 }
 
 bool Stage::is_clear() const {
@@ -164,38 +596,42 @@ std::vector<Key> Stage::get_output_keys_down() const {
 }
 
 void Stage::evaluate_device_filters(const std::vector<DeviceDesc>& device_descs) {
-  for (auto& context : m_contexts)
-    if (has_device_filter(context)) {
-      context.matching_device_bits = { };
-      auto bit = decltype(context.matching_device_bits){ 1 };
+  for (auto i = 0; i < static_cast<int>(context_count()); ++i) {
+    auto& matching_device_bits = m_context_matching_device_bits[i];
+    if (has_device_filter(i)) {
+      const auto& filters = m_context_device_filters[i];
+      matching_device_bits = { };
+      auto bit = uint64_t{ 1 };
       for (const auto& device_desc : device_descs) {
-        if (context.device_filter.matches(device_desc.name, false) &&
-            context.device_id_filter.matches(device_desc.id, false))
-          context.matching_device_bits |= bit;
+        if (filters.device_filter.matches(device_desc.name, false) &&
+            filters.device_id_filter.matches(device_desc.id, false))
+          matching_device_bits |= bit;
         bit <<= 1;
       }
     }
     else {
-      context.matching_device_bits = all_device_bits;
+      matching_device_bits = all_device_bits;
     }
+  }
 }
 
-bool Stage::device_matches_filter(const Context& context, int device_index) const {
+bool Stage::device_matches_filter(int context_index, int device_index) const {
   if (device_index == any_device_index)
     return true;
 
   // no-device only matches contexts with default device
+  const auto matching_device_bits = m_context_matching_device_bits[context_index];
   if (device_index == no_device_index)
-    return (context.matching_device_bits == all_device_bits);
+    return (matching_device_bits == all_device_bits);
 
-  return ((context.matching_device_bits >> device_index) & 1);
+  return ((matching_device_bits >> device_index) & 1);
 }
 
 KeySequence Stage::set_active_client_contexts(const std::vector<int> &indices) {
   // order of active contexts is relevant
   assert(std::is_sorted(begin(indices), end(indices)));
   for ([[maybe_unused]] auto i : indices)
-    assert(i >= 0 && i < static_cast<int>(m_contexts.size()));
+    assert(i >= 0 && i < static_cast<int>(context_count()));
 
   m_active_client_contexts = indices;
   update_active_contexts();
@@ -207,11 +643,12 @@ KeySequence Stage::set_active_client_contexts(const std::vector<int> &indices) {
   return std::move(m_output_buffer);
 }
 
-bool Stage::match_context_modifier_filter(const KeySequence& modifiers) {
-  for (const auto& modifier : modifiers) {
-    const auto pressed = (find_key(m_sequence, modifier.key) != m_sequence.end());
-    const auto should_be_pressed = (modifier.state != KeyState::Not);
-    if (pressed != should_be_pressed)
+bool Stage::match_context_modifier_filter(int context_index) const {
+  const auto& masks = m_context_modifier_masks[context_index];
+  for (auto i = masks.begin; i < masks.end; ++i) {
+    const auto& mask = m_modifier_masks[i];
+    const auto word = m_sequence_keys.word(mask.word_index);
+    if ((word & mask.required) != mask.required || (word & mask.forbidden))
       return false;
   }
   return true;
@@ -223,9 +660,9 @@ void Stage::update_active_contexts() {
   // evaluate modifier and device filter of contexts which were set active by client
   m_active_contexts.clear();
   for (auto index : m_active_client_contexts) {
-    const auto& context = m_contexts[index];
-    if ((match_context_modifier_filter(context.modifier_filter) ^ context.invert_modifier_filter) &&
-        ((!context.device_filter && !context.device_id_filter) || context.matching_device_bits)) {
+    const auto invert_modifier_filter = m_context_flags[index].invert_modifier_filter;
+    if ((match_context_modifier_filter(index) ^ invert_modifier_filter) &&
+        (!has_device_filter(index) || m_context_matching_device_bits[index])) {
       index = fallthrough_context(index);
       if (m_active_contexts.empty() || m_active_contexts.back() != index)
         m_active_contexts.push_back(index);
@@ -264,16 +701,17 @@ void Stage::update_active_contexts() {
 }
 
 void Stage::on_context_active_event(const KeyEvent& event, int context_index) {
-  const auto& context = m_contexts[context_index];
-  const auto& inputs = context.inputs;
-  const auto it = std::find_if(inputs.begin(), inputs.end(),
-    [&](const Input& input) { 
-      return (input.input.front().key == Key::ContextActive); 
+  const auto& inputs = m_context_inputs[context_index];
+  const auto it = std::find_if(m_inputs.begin() + inputs.begin, 
+    m_inputs.begin() + inputs.end,
+    [&](const Span& input) { 
+      return (m_events[input.begin].key == Key::ContextActive); 
     });
-  if (it != inputs.end()) {
+  if (it != m_inputs.begin() + inputs.end) {
     if (event.state == KeyState::Down) {
-      if (auto output = find_output(context, it->output_index))
-        apply_output(*output, event, context_index);
+      const auto output_index = m_input_output_indices[it - m_inputs.begin()];
+      if (auto output = find_output(context_index, output_index))
+        apply_output(events(*output), event, context_index);
     }
     else {
       continue_output_on_release(event, context_index);
@@ -293,7 +731,7 @@ void Stage::cancel_inactive_output_on_release() {
 }
 
 int Stage::fallthrough_context(int context_index) const {
-  while (m_contexts[context_index].fallthrough)
+  while (m_context_flags[context_index].fallthrough)
     ++context_index;
   return context_index;
 }
@@ -327,6 +765,20 @@ bool Stage::should_exit() const {
   return (m_exit_sequence_position == exit_sequence.size());
 }
 
+void Stage::set_match_automaton_enabled(bool enabled) {
+  m_match_automata.clear();
+  if (!enabled)
+    return;
+
+  auto expressions = std::vector<ConstKeySequenceRange>();
+  for (const auto& inputs : m_context_inputs) {
+    expressions.clear();
+    for (auto i = inputs.begin; i < inputs.end; ++i)
+      expressions.push_back(events(m_inputs[i]));
+    m_match_automata.emplace_back(expressions);
+  }
+}
+
 KeySequence Stage::update(const KeyEvent event, int device_index) {
   advance_exit_sequence(event);
   apply_input(event, device_index);
@@ -348,6 +800,7 @@ void Stage::validate_state(const std::function<bool(Key)>& is_down) {
           !is_down(event.key); 
       }),
     end(m_sequence));
+  update_sequence_keys();
 
   m_output_down.erase(
     std::remove_if(begin(m_output_down), end(m_output_down),
@@ -358,37 +811,88 @@ void Stage::validate_state(const std::function<bool(Key)>& is_down) {
     end(m_output_down));
 }
 
-const KeySequence* Stage::find_output(const Context& context, int output_index) const {
+auto Stage::find_output(int context_index, int output_index) const -> const Span* {
   if (output_index >= 0) {
-    assert(output_index < static_cast<int>(context.outputs.size()));
-    return &context.outputs[output_index];
+    const auto& outputs = m_context_outputs[context_index];
+    assert(output_index < static_cast<int>(outputs.end - outputs.begin));
+    return &m_outputs[outputs.begin + static_cast<uint32_t>(output_index)];
   }
 
   // search for last override of command output
   for (auto i = static_cast<int>(m_active_contexts.size()) - 1; i >= 0; --i) {
     // binary search for command outputs of context
-    const auto context_index = fallthrough_context(m_active_contexts[i]);
-    const auto& command_outputs = m_contexts[context_index].command_outputs;
-    const auto it = std::lower_bound(
-      command_outputs.rbegin(), command_outputs.rend(), output_index,
-      [](const CommandOutput& a, int index) { return a.index < index; });
-    if (it != command_outputs.rend() && it->index == output_index)
-      return &it->output;
+    const auto index = fallthrough_context(m_active_contexts[i]);
+    const auto& command_outputs = m_context_command_outputs[index];
+    const auto begin = m_command_output_indices.begin() + command_outputs.begin;
+    const auto end = m_command_output_indices.begin() + command_outputs.end;
+    const auto it = std::lower_bound(begin, end, output_index);
+    if (it != end && *it == output_index)
+      return &m_command_outputs[it - m_command_output_indices.begin()];
   }
   return nullptr;
 }
 
+bool Stage::set_lookup_keys(ConstKeySequenceRange sequence) {
+  // keys of already matched events and of the first one which is not
+  m_lookup_keys.clear();
+  for (const auto& event : sequence) {
+    m_lookup_keys.push_back(event.key);
+    if (event.state != KeyState::DownMatched)
+      return true;
+  }
+  // only already matched events, index cannot be used
+  return false;
+}
+
+const std::vector<int>& Stage::get_input_candidates(int context_index, 
+    bool use_index) {
+  const auto& inputs = m_context_inputs[context_index];
+  auto& candidates = m_input_candidates;
+  candidates.clear();
+  if (!use_index) {
+    for (auto i = 0; i < static_cast<int>(inputs.end - inputs.begin); ++i)
+      candidates.push_back(i);
+    return candidates;
+  }
+
+  const auto& index = m_input_indices[context_index];
+  for (auto key : m_lookup_keys) {
+    auto it = std::lower_bound(index.by_key.begin(), index.by_key.end(), key,
+      [](const std::pair<Key, int>& entry, Key key) { return entry.first < key; });
+    for (; it != index.by_key.end() && it->first == key; ++it)
+      candidates.push_back(it->second);
+  }
+  candidates.insert(candidates.end(), 
+    index.unindexed.begin(), index.unindexed.end());
+
+  // restore order of inputs
+  if (m_lookup_keys.size() > 1 || !index.unindexed.empty()) {
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()),
+      candidates.end());
+  }
+  return candidates;
+}
+
 auto Stage::match_input(bool first_iteration, 
     ConstKeySequenceRange sequence, int device_index, 
     bool is_key_up_event) -> MatchInputResult {
 
+  // only match inputs which can start with one of the sequence's keys
+  const auto use_index = set_lookup_keys(sequence);
+
   for (auto context_index : m_active_contexts) {
-    const auto& context = m_contexts[context_index];
-    if (!device_matches_filter(context, device_index))
+    if (!device_matches_filter(context_index, device_index))
       continue;
 
-    for (const auto& context_input : context.inputs) {
-      const auto& input = context_input.input;
+    // whole sequence is matched incrementally by automaton,
+    // but only once an indexed candidate needs it
+    const auto use_automaton = (first_iteration && !m_match_automata.empty());
+    auto automaton = std::add_pointer_t<MatchAutomaton>{ };
+
+    for (auto input_index : get_input_candidates(context_index, use_index)) {
+      const auto& input_span = context_input(context_index, input_index);
+      const auto input = events(input_span);
       const auto no_might_match_mapping = 
         is_no_might_match_mapping(input);
 
@@ -406,10 +910,18 @@ auto Stage::match_input(bool first_iteration,
       const auto accept_might_match = 
         (first_iteration && !no_might_match_mapping);
 
+      if (use_automaton && !automaton &&
+          m_match_automata[context_index].is_supported(input_index)) {
+        automaton = &m_match_automata[context_index];
+        automaton->match(sequence);
+      }
+
       auto input_timeout_event = KeyEvent{ };
-      const auto result = m_match(input,
-        (no_might_match_mapping ? m_history : sequence),
-        &m_any_key_matches, &input_timeout_event);
+      const auto result = (automaton && automaton->is_supported(input_index) ?
+        automaton->get_result(input_index, 
+          &m_any_key_matches, &input_timeout_event) :
+        m_match(input, (no_might_match_mapping ? m_history : sequence),
+          &m_any_key_matches, &input_timeout_event));
 
       if (accept_might_match && result == MatchResult::might_match) {
         
@@ -430,20 +942,22 @@ auto Stage::match_input(bool first_iteration,
             }
           }
         }
-        return { MatchResult::might_match, nullptr, &input, context_index };
+        return { MatchResult::might_match, nullptr, &input_span, context_index };
       }
 
-      if (result == MatchResult::match)
-        if (auto output = find_output(context, context_input.output_index))
-          return { MatchResult::match, output, &input, context_index };
+      if (result == MatchResult::match) {
+        const auto output_index = m_input_output_indices[
+          m_context_inputs[context_index].begin + static_cast<uint32_t>(input_index)];
+        if (auto output = find_output(context_index, output_index))
+          return { MatchResult::match, output, &input_span, context_index };
+      }
     }
   }
-  return { MatchResult::no_match, nullptr, nullptr, 0 };
+  return { MatchResult::no_match, nullptr, Key::none, 0 };
 }
 
 bool Stage::is_physically_pressed(Key key) const {
-  const auto it = rfind_key(m_sequence, key);
-  return (it != cend(m_sequence) && it->state != KeyState::Up);
+  return m_pressed_keys.contains(key);
 }
 
 void Stage::apply_input(const KeyEvent event, int device_index) {
@@ -475,18 +989,19 @@ void Stage::apply_input(const KeyEvent event, int device_index) {
 
   if (event.state == KeyState::Down) {
     // merge key repeats
-    const auto it = rfind_key(m_sequence, event.key);
-    if (it != end(m_sequence) && it->state != KeyState::Up) {
+    if (m_pressed_keys.contains(event.key)) {
       // ignore key repeat while sequence might match
       if (m_sequence_might_match)
         return;
 
-      m_sequence.erase(it);
+      m_sequence.erase(rfind_key(m_sequence, event.key));
     }
   }
 
   // add to sequence
   m_sequence.push_back(event);
+  m_sequence_keys.set(event.key, true);
+  m_pressed_keys.set(event.key, event.state != KeyState::Up);
 
   // add to history
   if (m_has_no_might_match_mapping && 
@@ -516,7 +1031,7 @@ void Stage::apply_input(const KeyEvent event, int device_index) {
       const auto it = find_key(m_sequence, event.key);
       assert(it != end(m_sequence));
       if (it->state == KeyState::DownMatched)
-        m_sequence.erase(it);
+        erase_from_sequence(it);
     }
   }
 
@@ -602,15 +1117,16 @@ void Stage::apply_input(const KeyEvent event, int device_index) {
 
         // do not change trigger of hold back output
         // when trigger is also released (might need some more work)
-        const auto keep_trivial_trigger = (output->size() == 1 && 
-            output->front() == get_trigger_event(trigger) &&
-            contains(m_sequence, KeyEvent(get_trigger_key(trigger), KeyState::Up)));
+        const auto output_events = events(*output);
+        const auto keep_trivial_trigger = (output_events.size() == 1 && 
+            output_events[0] == get_trigger_event(trigger) &&
+            contains_event(m_sequence, KeyEvent(get_trigger_key(trigger), KeyState::Up)));
 
         if (!keep_trivial_trigger)
           trigger = event;
       }
 
-      apply_output(*output, trigger, context_index);
+      apply_output(events(*output), trigger, context_index);
 
       // release new output when triggering input was released
       if (event.state == KeyState::Up) {
@@ -656,31 +1172,30 @@ bool Stage::continue_output_on_release(const KeyEvent& event, int context_index)
       return false;
 
     // trigger released - output rest of sequence
-    apply_output(it->sequence, event, it->context_index);
+    apply_output(events(it->sequence), event, it->context_index);
     m_output_on_release.erase(it);
   }
   return true;
 }
 
 void Stage::release_triggered(Key key, int context_index) {
-  // sort output to release to the right
-  const auto it = std::stable_partition(begin(m_output_down), end(m_output_down),
-    [&](const OutputDown& k) { 
-      if (get_trigger_key(k.trigger) == key) {
-        if (key == Key::ContextActive)
-          return (k.context_index != context_index);
-        return false;
-      }
-      return true;
-    });
-  std::for_each(
-    std::make_reverse_iterator(end(m_output_down)),
-    std::make_reverse_iterator(it),
+  const auto is_triggered = [&](const OutputDown& k) {
+    if (get_trigger_key(k.trigger) != key)
+      return false;
+    if (key == Key::ContextActive)
+      return (k.context_index == context_index);
+    return true;
+  };
+
+  // release output in reverse order
+  std::for_each(m_output_down.rbegin(), m_output_down.rend(),
     [&](const OutputDown& k) {
-      if (!k.temporarily_released)
+      if (is_triggered(k) && !k.temporarily_released)
         m_output_buffer.push_back({ k.key, KeyState::Up });
     });
-  m_output_down.erase(it, end(m_output_down));
+  m_output_down.erase(
+    std::remove_if(begin(m_output_down), end(m_output_down), is_triggered),
+    end(m_output_down));
 
   // also reset current timeout
   if (m_current_timeout && m_current_timeout->trigger == key)
@@ -708,14 +1223,15 @@ void Stage::apply_output(ConstKeySequenceRange sequence,
       const auto trigger_event = get_trigger_event(trigger);
       if (trigger_event.state == KeyState::Down) {
         // send rest of sequence when trigger is released
-        const auto rest = ConstKeySequenceRange(std::next(it), sequence.end());
+        const auto rest = Span{ to_offset(std::next(it) - m_events.begin()),
+          to_offset(sequence.end() - m_events.begin()) };
         m_output_on_release.push_back({ trigger_event.key, rest, context_index });
         break;
       }
     }
     else if (event.state == KeyState::Not && is_virtual_key(event.key)) {
       // !Virtual inserts a Virtual down to toggle when not already pressed
-      if (find_key(m_sequence, event.key) != m_sequence.end())
+      if (m_sequence_keys.contains(event.key))
         update_output({ event.key, KeyState::Down }, trigger, context_index);
     }
     else{
@@ -734,7 +1250,7 @@ void Stage::forward_from_sequence() {
       if (up != end(m_sequence)) {
         // erase Down when Up is following
         update_output(event, event.key);
-        m_sequence.erase(it);
+        erase_from_sequence(it);
         return;
       }
       else if (event.state == KeyState::Down) {
@@ -749,12 +1265,34 @@ void Stage::forward_from_sequence() {
     else if (event.state == KeyState::Up) {
       // remove remaining Up
       release_triggered(event.key);
-      m_sequence.erase(it);
+      erase_from_sequence(it);
       return;
     }
   }
 }
 
+void Stage::erase_from_sequence(KeySequence::const_iterator it) {
+  const auto key = it->key;
+  m_sequence.erase(it);
+  update_sequence_key(key);
+}
+
+void Stage::update_sequence_key(Key key) {
+  const auto it = rfind_key(m_sequence, key);
+  const auto contained = (it != m_sequence.end());
+  m_sequence_keys.set(key, contained);
+  m_pressed_keys.set(key, contained && it->state != KeyState::Up);
+}
+
+void Stage::update_sequence_keys() {
+  m_sequence_keys.clear();
+  m_pressed_keys.clear();
+  for (const auto& event : m_sequence) {
+    m_sequence_keys.set(event.key, true);
+    m_pressed_keys.set(event.key, event.state != KeyState::Up);
+  }
+}
+
 void Stage::update_output(const KeyEvent& event, const Trigger& trigger, int context_index) {
   const auto it = std::find_if(begin(m_output_down), end(m_output_down),
     [&](const OutputDown& down_key) { return down_key.key == event.key; });
@@ -875,7 +1413,7 @@ void Stage::finish_sequence(ConstKeySequenceRange sequence) {
         continue;
       }
     }
-    m_sequence.erase(it);
+    erase_from_sequence(it);
     --length;
   }
 }
@@ -884,25 +1422,27 @@ void Stage::clean_up_history() {
   // remove all events from beginning of history which
   // prevent all no-might-match mappings from matching
   auto input_timeout_event = KeyEvent{ };
-  auto any_key_matches = std::vector<Key>{ };
+  auto& any_key_matches = m_history_any_key_matches;
   while (!m_history.empty()) {
     const auto event = m_history.front();
     assert(event.state == KeyState::Down);
 
     // do not remove Down without Up
     const auto up_event = KeyEvent{ event.key, KeyState::Up, event.value };
-    if (!contains(m_history, up_event))
+    if (!contains_event(m_history, up_event))
       return;
 
-    for (auto context_index : m_active_contexts)
-      for (const auto& context_input : m_contexts[context_index].inputs)
-        if (is_no_might_match_mapping(context_input.input)) {
+    for (auto context_index : m_active_contexts) {
+      const auto& inputs = m_context_inputs[context_index];
+      for (auto i = inputs.begin; i < inputs.end; ++i)
+        if (is_no_might_match_mapping(events(m_inputs[i]))) {
           // pass without NoMightMatch, so it does not skip events at the front
-          const auto& input = without_first(context_input.input);
+          const auto input = without_first(events(m_inputs[i]));
           if (m_match(input, m_history, &any_key_matches, 
                 &input_timeout_event) == MatchResult::might_match)
             return;
         }
+    }
 
     m_history.erase(m_history.begin());
 
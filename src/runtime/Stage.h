@@ -1,13 +1,14 @@
 #pragma once
 
 #include "MatchKeySequence.h"
+#include "MatchAutomaton.h"
+#include "StageImage.h"
+#include "KeySet.h"
 #include "common/DeviceDesc.h"
 #include "common/Filter.h"
 #include <functional>
 #include <variant>
 
-using Trigger = std::variant<const KeySequence*, KeyEvent, Key>;
-
 class Stage {
 public:
   static const int no_device_index = -1;
@@ -38,8 +39,10 @@ public:
   };
 
   explicit Stage(std::vector<Context> contexts = { });
+  explicit Stage(const StageImage& image);
 
-  const std::vector<Context>& contexts() const { return m_contexts; }
+  size_t context_count() const { return m_context_events.size(); }
+  Context get_context(int context_index) const;
   const std::vector<int>& active_client_contexts() const { return m_active_client_contexts; }
   bool has_mouse_mappings() const { return m_has_mouse_mappings; }
   bool has_device_filters() const { return m_has_device_filter; }
@@ -54,13 +57,59 @@ public:
   void reuse_buffer(KeySequence&& buffer);
   void validate_state(const std::function<bool(Key)>& is_down);
   bool should_exit() const;
+  void set_match_automaton_enabled(bool enabled);
+  bool match_automaton_enabled() const { return !m_match_automata.empty(); }
+  void replace_context(int context_index, Context context);
 
 private:
-  using MatchInputResult = std::tuple<MatchResult, const KeySequence*, Trigger, int>;
+  using Span = StageSpan;
+
+  struct ContextFlags {
+    bool invert_modifier_filter;
+    bool fallthrough;
+  };
+
+  struct DeviceFilters {
+    Filter device_filter;
+    Filter device_id_filter;
+  };
 
+  // the input which matched, the event which triggered it or the key
+  using Trigger = std::variant<const Span*, KeyEvent, Key>;
+  using MatchInputResult = std::tuple<MatchResult, const Span*, Trigger, int>;
+
+  // inputs of a context by the keys a matching sequence can start with
+  struct InputIndex {
+    std::vector<std::pair<Key, int>> by_key;
+    std::vector<int> unindexed;
+  };
+
+  // modifier filters compiled to the keys of a word of the sequence keys,
+  // which need to be in the sequence or not
+  struct ModifierMask {
+    uint32_t word_index;
+    KeySet::Word required;
+    KeySet::Word forbidden;
+  };
+
+  void set_contexts(std::vector<Context> contexts);
+  void set_context(int context_index, Context context);
+  void update_mapping_flags();
+  void add_modifier_masks(const Span& modifier_filter,
+    std::vector<ModifierMask>* masks) const;
+  InputIndex create_input_index(int context_index) const;
+  void initialize();
+  void reserve_buffers();
+  ConstKeySequenceRange events(const Span& span) const;
+  const Span& context_input(int context_index, int input_index) const;
+  bool has_device_filter(int context_index) const;
+  KeyEvent get_trigger_event(const Trigger& trigger) const;
+  Key get_trigger_key(const Trigger& trigger) const;
   void advance_exit_sequence(const KeyEvent& event);
-  const KeySequence* find_output(const Context& context, int output_index) const;
-  bool device_matches_filter(const Context& context, int device_index) const;
+  const Span* find_output(int context_index, int output_index) const;
+  bool device_matches_filter(int context_index, int device_index) const;
+  bool set_lookup_keys(ConstKeySequenceRange sequence);
+  const std::vector<int>& get_input_candidates(int context_index, bool use_index);
   MatchInputResult match_input(bool first_iteration, 
     ConstKeySequenceRange sequence, int device_index, 
     bool is_key_up_event);
@@ -68,11 +117,14 @@ private:
   void apply_input(KeyEvent event, int device_index);
   void release_triggered(Key key, int context_index = -1);
   void forward_from_sequence();
+  void erase_from_sequence(KeySequence::const_iterator it);
+  void update_sequence_key(Key key);
+  void update_sequence_keys();
   void apply_output(ConstKeySequenceRange sequence,
     const Trigger& trigger, int context_index);
   void update_output(const KeyEvent& event, const Trigger& trigger, int context_index = -1);
   void finish_sequence(ConstKeySequenceRange sequence);
-  bool match_context_modifier_filter(const KeySequence& modifiers);
+  bool match_context_modifier_filter(int context_index) const;
   void update_active_contexts();
   bool continue_output_on_release(const KeyEvent& event, int context_index = -1);
   void cancel_inactive_output_on_release();
@@ -81,7 +133,32 @@ private:
   void on_context_active_event(const KeyEvent& event, int context_index);
   void clean_up_history();
 
-  std::vector<Context> m_contexts;
+  // the input and output expressions and modifier filters of all
+  // contexts are packed into one pool, the events of a context are
+  // contiguous. tables refer to them by span.
+  KeySequence m_events;
+  std::vector<Span> m_inputs;
+  std::vector<int> m_input_output_indices;
+  std::vector<Span> m_outputs;
+  // sorted by index per context (to allow binary search)
+  std::vector<Span> m_command_outputs;
+  std::vector<int> m_command_output_indices;
+
+  // context data, spans refer to the pool or the tables above
+  std::vector<Span> m_context_events;
+  std::vector<Span> m_context_inputs;
+  std::vector<Span> m_context_outputs;
+  std::vector<Span> m_context_command_outputs;
+  std::vector<Span> m_context_modifier_filters;
+  std::vector<ContextFlags> m_context_flags;
+  std::vector<uint64_t> m_context_matching_device_bits;
+  std::vector<DeviceFilters> m_context_device_filters;
+
+  std::vector<InputIndex> m_input_indices;
+
+  std::vector<ModifierMask> m_modifier_masks;
+  std::vector<Span> m_context_modifier_masks;
+
   bool m_has_mouse_mappings{ };
   bool m_has_device_filter{ };
   bool m_has_no_might_match_mapping{ };
@@ -89,18 +166,22 @@ private:
   std::vector<int> m_active_contexts;
   std::vector<int> m_prev_active_contexts;
   MatchKeySequence m_match;
+  std::vector<MatchAutomaton> m_match_automata;
   size_t m_exit_sequence_position{ };
 
   // the input since the last match (or already matched but still hold)
   KeySequence m_sequence;
   bool m_sequence_might_match{ };
+  // keys with an event in the sequence and with the last one not Up
+  KeySet m_sequence_keys;
+  KeySet m_pressed_keys;
 
   // the input which might still match a no-might-match mapping
   KeySequence m_history;
 
   struct OutputOnRelease {
     Key trigger;
-    ConstKeySequenceRange sequence;
+    Span sequence;
     int context_index;
   };
   std::vector<OutputOnRelease> m_output_on_release;
@@ -118,7 +199,7 @@ private:
 
   struct CurrentTimeout : KeyEvent {
     Key trigger;
-    const KeySequence* matched_output;
+    const Span* matched_output;
     bool not_exceeded;
   };
   std::optional<CurrentTimeout> m_current_timeout;
@@ -127,4 +208,7 @@ private:
   KeySequence m_output_buffer;
   bool m_temporary_reapplied{ };
   std::vector<Key> m_any_key_matches;
+  std::vector<Key> m_history_any_key_matches;
+  std::vector<Key> m_lookup_keys;
+  std::vector<int> m_input_candidates;
 };
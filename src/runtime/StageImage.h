@@ -0,0 +1,235 @@
+#pragma once
+
+#include "KeyEvent.h"
+#include "common/Filter.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+// range [begin, end) of events in pool or of entries in a table
+struct StageSpan {
+  uint32_t begin;
+  uint32_t end;
+};
+
+// Position independent layout of the contexts of a stage, in which they
+// are stored by Stage. It allows to pass the contexts in shared memory and
+// to load them without deserializing every field. It consists of:
+// Header, Context[], KeyEvent[], inputs StageSpan[], int32_t[],
+// outputs StageSpan[], command outputs StageSpan[], int32_t[]
+struct StageImage {
+  struct Header {
+    uint32_t context_count;
+    uint32_t event_count;
+    uint32_t input_count;
+    uint32_t output_count;
+    uint32_t command_output_count;
+  };
+
+  struct Context {
+    StageSpan events;
+    StageSpan inputs;
+    StageSpan outputs;
+    StageSpan command_outputs;
+    StageSpan modifier_filter;
+    uint32_t flags;
+  };
+
+  static constexpr uint32_t invert_modifier_filter_flag = 1;
+  static constexpr uint32_t fallthrough_flag = 2;
+
+  const Header* header{ };
+  const Context* contexts{ };
+  const KeyEvent* events{ };
+  const StageSpan* inputs{ };
+  const int32_t* input_output_indices{ };
+  const StageSpan* outputs{ };
+  const StageSpan* command_outputs{ };
+  const int32_t* command_output_indices{ };
+
+  // not part of the image
+  std::vector<Filter> device_filters;
+  std::vector<Filter> device_id_filters;
+
+  static size_t get_size(const Header& header) {
+    return sizeof(Header) +
+      header.context_count * sizeof(Context) +
+      header.event_count * sizeof(KeyEvent) +
+      header.input_count * (sizeof(StageSpan) + sizeof(int32_t)) +
+      header.output_count * sizeof(StageSpan) +
+      header.command_output_count * (sizeof(StageSpan) + sizeof(int32_t));
+  }
+
+  // data needs to be aligned to 4 bytes
+  bool map(const char* data, size_t size);
+};
+
+static_assert(sizeof(KeyEvent) % 4 == 0 && sizeof(StageImage::Header) % 4 == 0 &&
+  sizeof(StageImage::Context) % 4 == 0, "image arrays need to be aligned");
+
+inline bool StageImage::map(const char* data, size_t size) {
+  if (size < sizeof(Header))
+    return false;
+  header = reinterpret_cast<const Header*>(data);
+  if (get_size(*header) != size)
+    return false;
+
+  const auto next = [&](auto& pointer, size_t count) {
+    pointer = reinterpret_cast<std::remove_reference_t<decltype(pointer)>>(data);
+    data += count * sizeof(*pointer);
+  };
+  data += sizeof(Header);
+  next(contexts, header->context_count);
+  next(events, header->event_count);
+  next(inputs, header->input_count);
+  next(input_output_indices, header->input_count);
+  next(outputs, header->output_count);
+  next(command_outputs, header->command_output_count);
+  next(command_output_indices, header->command_output_count);
+
+  // validate, so a Stage can rely on it
+  const auto valid_span = [](const StageSpan& span, uint32_t end) {
+    return (span.begin <= span.end && span.end <= end);
+  };
+  const auto within = [](const StageSpan& span, const StageSpan& outer) {
+    return (span.begin >= outer.begin && span.end <= outer.end);
+  };
+  auto prev = Context{ };
+  for (auto i = 0u; i < header->context_count; ++i) {
+    const auto& context = contexts[i];
+    if (!valid_span(context.events, header->event_count) ||
+        !valid_span(context.inputs, header->input_count) ||
+        !valid_span(context.outputs, header->output_count) ||
+        !valid_span(context.command_outputs, header->command_output_count) ||
+        context.events.begin != prev.events.end ||
+        context.inputs.begin != prev.inputs.end ||
+        context.outputs.begin != prev.outputs.end ||
+        context.command_outputs.begin != prev.command_outputs.end ||
+        !within(context.modifier_filter, context.events))
+      return false;
+
+    for (auto j = context.inputs.begin; j < context.inputs.end; ++j)
+      if (inputs[j].begin == inputs[j].end ||
+          !within(inputs[j], context.events) ||
+          input_output_indices[j] >= static_cast<int32_t>(
+            context.outputs.end - context.outputs.begin))
+        return false;
+    for (auto j = context.outputs.begin; j < context.outputs.end; ++j)
+      if (!within(outputs[j], context.events))
+        return false;
+    for (auto j = context.command_outputs.begin; j < context.command_outputs.end; ++j)
+      if (!within(command_outputs[j], context.events) ||
+          (j > context.command_outputs.begin &&
+           command_output_indices[j - 1] >= command_output_indices[j]))
+        return false;
+    prev = context;
+  }
+  // last context cannot fall through
+  return (prev.events.end == header->event_count &&
+    prev.inputs.end == header->input_count &&
+    prev.outputs.end == header->output_count &&
+    prev.command_outputs.end == header->command_output_count &&
+    !(prev.flags & fallthrough_flag));
+}
+
+// writes contexts (Stage::Context or Config::Context) as image
+template<typename It>
+class StageImageWriter {
+public:
+  StageImageWriter(It begin, It end) : m_begin(begin), m_end(end) {
+    m_header.context_count = static_cast<uint32_t>(std::distance(begin, end));
+    for (auto it = begin; it != end; ++it) {
+      m_header.event_count += static_cast<uint32_t>(it->modifier_filter.size());
+      for (const auto& input : it->inputs)
+        m_header.event_count += static_cast<uint32_t>(input.input.size());
+      for (const auto& output : it->outputs)
+        m_header.event_count += static_cast<uint32_t>(output.size());
+      for (const auto& command : it->command_outputs)
+        m_header.event_count += static_cast<uint32_t>(command.output.size());
+      m_header.input_count += static_cast<uint32_t>(it->inputs.size());
+      m_header.output_count += static_cast<uint32_t>(it->outputs.size());
+      m_header.command_output_count +=
+        static_cast<uint32_t>(it->command_outputs.size());
+    }
+  }
+
+  size_t size() const { return StageImage::get_size(m_header); }
+
+  // data needs to be size() bytes
+  void write(char* data) const {
+    auto contexts = data + sizeof(StageImage::Header);
+    auto events = contexts + m_header.context_count * sizeof(StageImage::Context);
+    auto inputs = events + m_header.event_count * sizeof(KeyEvent);
+    auto input_output_indices = inputs + m_header.input_count * sizeof(StageSpan);
+    auto outputs = input_output_indices + m_header.input_count * sizeof(int32_t);
+    auto command_outputs = outputs + m_header.output_count * sizeof(StageSpan);
+    auto command_output_indices = command_outputs +
+      m_header.command_output_count * sizeof(StageSpan);
+    put(data, m_header);
+
+    auto event_count = uint32_t{ };
+    auto input_count = uint32_t{ };
+    auto output_count = uint32_t{ };
+    auto command_output_count = uint32_t{ };
+    const auto add_events = [&](const KeySequence& sequence) {
+      const auto begin = event_count;
+      for (const auto& event : sequence)
+        put(events, event);
+      event_count += static_cast<uint32_t>(sequence.size());
+      return StageSpan{ begin, event_count };
+    };
+    auto order = std::vector<size_t>();
+    for (auto it = m_begin; it != m_end; ++it) {
+      auto context = StageImage::Context{ };
+      context.events.begin = event_count;
+      context.inputs.begin = input_count;
+      context.outputs.begin = output_count;
+      context.command_outputs.begin = command_output_count;
+      for (const auto& input : it->inputs) {
+        put(inputs, add_events(input.input));
+        put(input_output_indices, static_cast<int32_t>(input.output_index));
+      }
+      for (const auto& output : it->outputs)
+        put(outputs, add_events(output));
+
+      // sort command outputs by index (to allow binary search)
+      const auto& commands = it->command_outputs;
+      order.resize(commands.size());
+      std::iota(order.begin(), order.end(), size_t{ });
+      std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return commands[a].index < commands[b].index;
+      });
+      for (auto index : order) {
+        put(command_outputs, add_events(commands[index].output));
+        put(command_output_indices, static_cast<int32_t>(commands[index].index));
+      }
+      context.modifier_filter = add_events(it->modifier_filter);
+      input_count += static_cast<uint32_t>(it->inputs.size());
+      output_count += static_cast<uint32_t>(it->outputs.size());
+      command_output_count += static_cast<uint32_t>(commands.size());
+      context.events.end = event_count;
+      context.inputs.end = input_count;
+      context.outputs.end = output_count;
+      context.command_outputs.end = command_output_count;
+      context.flags =
+        (it->invert_modifier_filter ? StageImage::invert_modifier_filter_flag : 0) |
+        (it->fallthrough ? StageImage::fallthrough_flag : 0);
+      put(contexts, context);
+    }
+  }
+
+private:
+  template<typename T>
+  static void put(char*& data, const T& value) {
+    std::memcpy(data, &value, sizeof(T));
+    data += sizeof(T);
+  }
+
+  It m_begin;
+  It m_end;
+  StageImage::Header m_header{ };
+};
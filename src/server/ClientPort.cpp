@@ -2,6 +2,14 @@
 #include "ClientPort.h"
 #include "common/parse_regex.h"
 
+#if defined(__linux__)
+#include "runtime/StageImage.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace {
   KeySequence read_key_sequence(Deserializer& d) {
     auto sequence = KeySequence();
@@ -22,6 +30,47 @@ namespace {
     return filter;
   }
 
+  Stage::Context read_context(Deserializer& d) {
+    auto context = Stage::Context();
+
+    // inputs
+    auto count = d.read<uint32_t>();
+    context.inputs.resize(count);
+    for (auto& input : context.inputs) {
+      input.input = read_key_sequence(d);
+      input.output_index = d.read<int32_t>();
+    }
+
+    // outputs
+    count = d.read<uint32_t>();
+    context.outputs.resize(count);
+    for (auto& output : context.outputs) {
+      output = read_key_sequence(d);
+    }
+
+    // command outputs
+    count = d.read<uint32_t>();
+    context.command_outputs.resize(count);
+    for (auto& command : context.command_outputs) {
+      command.output = read_key_sequence(d);
+      command.index = d.read<int32_t>();
+    }
+
+    // device filter
+    context.device_filter = read_filter(d);
+
+    // device-id filter
+    context.device_id_filter = read_filter(d);
+
+    // modifier filter
+    context.modifier_filter = read_key_sequence(d);
+    d.read(&context.invert_modifier_filter);
+
+    // fallthrough
+    d.read(&context.fallthrough);
+    return context;
+  }
+
   MultiStagePtr read_stages(Deserializer& d) {
     auto stages = std::vector<StagePtr>();
     auto contexts = std::vector<Stage::Context>();
@@ -34,51 +83,97 @@ namespace {
         stages.emplace_back(std::make_unique<Stage>(std::move(contexts)));
         contexts = { };
       }
+      contexts.push_back(read_context(d));
+    }
 
-      auto& context = contexts.emplace_back();
-
-      // inputs
-      auto count = d.read<uint32_t>();
-      context.inputs.resize(count);
-      for (auto& input : context.inputs) {
-        input.input = read_key_sequence(d);
-        input.output_index = d.read<int32_t>();
-      }
+    if (!contexts.empty())
+      stages.emplace_back(std::make_unique<Stage>(std::move(contexts)));
 
-      // outputs
-      count = d.read<uint32_t>();
-      context.outputs.resize(count);
-      for (auto& output : context.outputs) {
-        output = read_key_sequence(d);
-      }
+    return std::make_unique<MultiStage>(std::move(stages));
+  }
 
-      // command outputs
-      count = d.read<uint32_t>();
-      context.command_outputs.resize(count);
-      for (auto& command : context.command_outputs) {
-        command.output = read_key_sequence(d);
-        command.index = d.read<int32_t>();
+#if defined(__linux__)
+  // maps the stage images written by the client and copies their tables
+  std::vector<StagePtr> read_stage_images(const char* data, size_t size,
+      std::vector<Filter>& filters) {
+    auto stages = std::vector<StagePtr>();
+    const auto read_size = [&](uint32_t* value) {
+      if (size < sizeof(uint32_t))
+        return false;
+      std::memcpy(value, data, sizeof(uint32_t));
+      data += sizeof(uint32_t);
+      size -= sizeof(uint32_t);
+      return true;
+    };
+    auto stage_count = uint32_t{ };
+    if (!read_size(&stage_count))
+      return { };
+    auto filter = filters.begin();
+    for (auto i = 0u; i < stage_count; ++i) {
+      auto image_size = uint32_t{ };
+      auto image = StageImage{ };
+      if (!read_size(&image_size) || image_size > size ||
+          !image.map(data, image_size))
+        return { };
+      const auto context_count = image.header->context_count;
+      if (static_cast<size_t>(filters.end() - filter) < 2 * context_count)
+        return { };
+      for (auto j = 0u; j < context_count; ++j) {
+        image.device_filters.push_back(std::move(*filter++));
+        image.device_id_filters.push_back(std::move(*filter++));
       }
-
-      // device filter
-      context.device_filter = read_filter(d);
-
-      // device-id filter
-      context.device_id_filter = read_filter(d);
-
-      // modifier filter
-      context.modifier_filter = read_key_sequence(d);
-      d.read(&context.invert_modifier_filter);
-
-      // fallthrough
-      d.read(&context.fallthrough);
+      stages.push_back(std::make_unique<Stage>(image));
+      data += image_size;
+      size -= image_size;
     }
+    if (size != 0 || filter != filters.end())
+      return { };
+    return stages;
+  }
 
-    if (!contexts.empty())
-      stages.emplace_back(std::make_unique<Stage>(std::move(contexts)));
+  MultiStagePtr read_stages_image(Deserializer& d, int fd) {
+    auto filters = std::vector<Filter>();
+    const auto context_count = d.read<uint32_t>();
+    for (auto i = 0u; i < context_count; ++i) {
+      filters.push_back(read_filter(d));
+      filters.push_back(read_filter(d));
+    }
+    if (fd < 0)
+      return nullptr;
 
+    // only accept images which can no longer be modified by client
+    const auto required_seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+    const auto seals = ::fcntl(fd, F_GET_SEALS);
+    struct stat status{ };
+    auto stages = std::vector<StagePtr>();
+    if (seals >= 0 && (seals & required_seals) == required_seals &&
+        ::fstat(fd, &status) == 0 && status.st_size > 0) {
+      const auto size = static_cast<size_t>(status.st_size);
+      const auto data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        stages = read_stage_images(static_cast<const char*>(data), size, filters);
+        ::munmap(data, size);
+      }
+    }
+    ::close(fd);
+    if (stages.empty() && context_count != 0)
+      return nullptr;
     return std::make_unique<MultiStage>(std::move(stages));
   }
+#endif // defined(__linux__)
+
+  std::vector<std::pair<int, Stage::Context>> read_context_updates(
+      Deserializer& d) {
+    auto contexts = std::vector<std::pair<int, Stage::Context>>();
+    const auto count = d.read<uint32_t>();
+    for (auto i = 0u; i < count; ++i) {
+      const auto index = static_cast<int>(d.read<uint32_t>());
+      // stages cannot change with an update
+      d.read<bool>();
+      contexts.emplace_back(index, read_context(d));
+    }
+    return contexts;
+  }
 
   std::vector<GrabDeviceFilter> read_grab_device_filters(Deserializer& d) {
     auto device_filters = std::vector<GrabDeviceFilter>();
@@ -107,8 +202,8 @@ namespace {
   }
 } // namespace
 
-ClientPort::ClientPort() 
-  : m_host("keymapper") {
+ClientPort::ClientPort(std::string ipc_id) 
+  : m_host(std::move(ipc_id)) {
 }
 
 bool ClientPort::listen() {
@@ -156,6 +251,14 @@ bool ClientPort::send_next_key_info(Key key, const DeviceDesc& device_desc) {
     });
 }
 
+bool ClientPort::send_latency_report(const std::string& report) {
+  return m_connection.send_message(
+    [&](Serializer& s) {
+      s.write(MessageType::latency_report);
+      s.write(report);
+    });
+}
+
 bool ClientPort::read_messages(MessageHandler& handler,
     std::optional<Duration> timeout) {
   return m_connection.read_messages(timeout,
@@ -167,6 +270,19 @@ bool ClientPort::read_messages(MessageHandler& handler,
           handler.on_directives_message(read_directives(d));
           break;
         }
+#if defined(__linux__)
+        case MessageType::configuration_image: {
+          handler.on_grab_device_filters_message(read_grab_device_filters(d));
+          handler.on_configuration_message(
+            read_stages_image(d, m_connection.take_received_fd()));
+          handler.on_directives_message(read_directives(d));
+          break;
+        }
+#endif
+        case MessageType::configuration_update: {
+          handler.on_configuration_update_message(read_context_updates(d));
+          break;
+        }
         case MessageType::active_contexts: {
           handler.on_active_contexts_message(read_active_contexts(d));
           break;
@@ -193,6 +309,10 @@ bool ClientPort::read_messages(MessageHandler& handler,
           handler.on_inject_output_message(read_key_sequence(d));
           break;
         }
+        case MessageType::latency_report: {
+          handler.on_request_latency_report_message(d.read<bool>());
+          break;
+        }
         default: break;
       }
     });
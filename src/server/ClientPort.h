@@ -10,6 +10,8 @@ class IClientPort {
 public:
   struct MessageHandler {
     virtual void on_configuration_message(MultiStagePtr stage) = 0;
+    virtual void on_configuration_update_message(
+      std::vector<std::pair<int, Stage::Context>> contexts) = 0;
     virtual void on_grab_device_filters_message(std::vector<GrabDeviceFilter> filters) = 0;
     virtual void on_directives_message(const std::vector<std::string>& directives) = 0;
     virtual void on_active_contexts_message(const std::vector<int>& context_indices) = 0;
@@ -18,6 +20,7 @@ public:
     virtual void on_request_next_key_info_message() = 0;
     virtual void on_inject_input_message(const KeySequence& sequence) = 0;
     virtual void on_inject_output_message(const KeySequence& sequence) = 0;
+    virtual void on_request_latency_report_message(bool chrome_trace) = 0;
   };
 
   virtual ~IClientPort() = default;
@@ -30,13 +33,14 @@ public:
   virtual bool send_triggered_action(int action) = 0;
   virtual bool send_virtual_key_state(Key key, KeyState state) = 0;
   virtual bool send_next_key_info(Key key, const DeviceDesc& device_desc) = 0;
+  virtual bool send_latency_report(const std::string& report) = 0;
   virtual bool read_messages(MessageHandler& handler, 
     std::optional<Duration> timeout) = 0;
 };
 
 class ClientPort : public IClientPort {
 public:
-  ClientPort();
+  explicit ClientPort(std::string ipc_id = "keymapper");
   Socket socket() const override { return m_connection.socket(); }
   Socket listen_socket() const override { return m_host.listen_socket(); }
   bool version_mismatch() const override { return m_host.version_mismatch(); }
@@ -46,6 +50,7 @@ public:
   bool send_triggered_action(int action) override;
   bool send_virtual_key_state(Key key, KeyState state) override;
   bool send_next_key_info(Key key, const DeviceDesc& device_desc) override;
+  bool send_latency_report(const std::string& report) override;
   bool read_messages(MessageHandler& handler, 
     std::optional<Duration> timeout) override;
 
@@ -0,0 +1,187 @@
+
+#include "LatencyTrace.h"
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+
+namespace {
+  const auto max_pending = size_t{ 256 };
+  const auto bucket_count = 24;
+
+  struct Stage {
+    const char* name;
+    Clock::time_point LatencyTrace::Sample::* begin;
+    Clock::time_point LatencyTrace::Sample::* end;
+  };
+
+  const Stage stages[] = {
+    { "kernel to read", &LatencyTrace::Sample::event_time,
+                        &LatencyTrace::Sample::read_time },
+    { "translate", &LatencyTrace::Sample::read_time,
+                   &LatencyTrace::Sample::translated_time },
+    { "write", &LatencyTrace::Sample::translated_time,
+               &LatencyTrace::Sample::written_time },
+  };
+
+  bool is_set(Clock::time_point time) {
+    return (time != Clock::time_point{ });
+  }
+
+  double to_us(Clock::duration value) {
+    using namespace std::chrono;
+    return duration_cast<duration<double, std::micro>>(value).count();
+  }
+
+  template<typename... Args>
+  void append(std::string& string, const char* format, Args... args) {
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer), format, args...);
+    string += buffer;
+  }
+
+  void append_histogram(std::string& string, const char* name,
+      std::vector<double>& values) {
+    string += name;
+    if (values.empty()) {
+      string += ": no samples\n";
+      return;
+    }
+    std::sort(values.begin(), values.end());
+    const auto percentile = [&](double p) {
+      return values[static_cast<size_t>(p * static_cast<double>(values.size() - 1))];
+    };
+    append(string, ": %zu samples", values.size());
+    append(string, ", median %.1fus", percentile(0.5));
+    append(string, ", 99th percentile %.1fus", percentile(0.99));
+    append(string, ", max %.1fus\n", values.back());
+
+    // buckets of powers of two microseconds
+    auto buckets = std::vector<size_t>(bucket_count);
+    for (auto value : values) {
+      auto bucket = 0;
+      while (bucket < bucket_count - 1 && value >= static_cast<double>(1 << bucket))
+        ++bucket;
+      ++buckets[bucket];
+    }
+    const auto first = std::find_if(buckets.begin(), buckets.end(),
+      [](size_t count) { return count != 0; }) - buckets.begin();
+    const auto last = buckets.rend() - std::find_if(buckets.rbegin(), buckets.rend(),
+      [](size_t count) { return count != 0; });
+    for (auto i = first; i < last; ++i)
+      append(string, "  < %8dus %8zu\n", 1 << i, buckets[i]);
+  }
+} // namespace
+
+LatencyTrace::LatencyTrace(size_t capacity)
+  : m_slots(new Slot[capacity]()),
+    m_capacity(capacity) {
+  m_pending.reserve(max_pending);
+}
+
+void LatencyTrace::on_input_translated(Clock::time_point event_time,
+    Clock::time_point read_time, Clock::time_point translated_time) {
+  if (m_pending.size() == max_pending)
+    on_no_output_pending();
+  m_pending.push_back({ event_time, read_time, translated_time, { } });
+}
+
+void LatencyTrace::on_output_written(Clock::time_point written_time) {
+  for (auto& sample : m_pending) {
+    sample.written_time = written_time;
+    add_sample(sample);
+  }
+  m_pending.clear();
+}
+
+void LatencyTrace::on_no_output_pending() {
+  for (const auto& sample : m_pending)
+    add_sample(sample);
+  m_pending.clear();
+}
+
+void LatencyTrace::add_sample(const Sample& sample) {
+  const auto index = m_written.load(std::memory_order_relaxed);
+  auto& slot = m_slots[index % m_capacity];
+
+  // odd sequence while slot is being written
+  const auto sequence = slot.sequence.load(std::memory_order_relaxed);
+  slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  const Clock::time_point* times[] = { &sample.event_time,
+    &sample.read_time, &sample.translated_time, &sample.written_time };
+  for (auto i = 0; i < 4; ++i)
+    slot.times[i].store(times[i]->time_since_epoch().count(),
+      std::memory_order_relaxed);
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+  m_written.store(index + 1, std::memory_order_release);
+}
+
+auto LatencyTrace::samples() const -> std::vector<Sample> {
+  const auto written = m_written.load(std::memory_order_acquire);
+  const auto begin = (written > m_capacity ? written - m_capacity : 0);
+  auto samples = std::vector<Sample>();
+  samples.reserve(written - begin);
+  for (auto index = begin; index < written; ++index) {
+    const auto& slot = m_slots[index % m_capacity];
+    const auto sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence & 1)
+      continue;
+    Clock::rep times[4];
+    for (auto i = 0; i < 4; ++i)
+      times[i] = slot.times[i].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // skip when it was overwritten while reading
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+      continue;
+    const auto to_time = [](Clock::rep rep) {
+      return Clock::time_point(Clock::duration(rep));
+    };
+    samples.push_back({ to_time(times[0]), to_time(times[1]),
+      to_time(times[2]), to_time(times[3]) });
+  }
+  std::sort(samples.begin(), samples.end(),
+    [](const Sample& a, const Sample& b) { return a.read_time < b.read_time; });
+  return samples;
+}
+
+std::string LatencyTrace::get_histograms() const {
+  const auto samples = this->samples();
+  auto string = std::string();
+  auto values = std::vector<double>();
+  for (const auto& stage : stages) {
+    values.clear();
+    for (const auto& sample : samples)
+      if (is_set(sample.*stage.begin) && is_set(sample.*stage.end))
+        values.push_back(to_us(sample.*stage.end - sample.*stage.begin));
+    append_histogram(string, stage.name, values);
+  }
+
+  values.clear();
+  for (const auto& sample : samples)
+    if (is_set(sample.written_time))
+      values.push_back(to_us(sample.written_time - (is_set(sample.event_time) ?
+        sample.event_time : sample.read_time)));
+  append_histogram(string, "total", values);
+  return string;
+}
+
+std::string LatencyTrace::get_chrome_trace() const {
+  const auto samples = this->samples();
+  auto string = std::string("{\"traceEvents\":[");
+  auto first = true;
+  for (const auto& sample : samples)
+    for (const auto& stage : stages) {
+      if (!is_set(sample.*stage.begin) || !is_set(sample.*stage.end))
+        continue;
+      if (!std::exchange(first, false))
+        string += ",";
+      string += "\n{\"name\":\"";
+      string += stage.name;
+      append(string, "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+        "\"ts\":%.3f,\"dur\":%.3f}",
+        to_us((sample.*stage.begin).time_since_epoch()),
+        to_us(sample.*stage.end - sample.*stage.begin));
+    }
+  string += "\n]}\n";
+  return string;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "common/Duration.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Records the timestamps of the processing stages of input events in a
+// lock-free ring. It is written by the input thread and can be read and
+// reported from another thread.
+class LatencyTrace {
+public:
+  struct Sample {
+    // timestamp from kernel, when available
+    Clock::time_point event_time;
+    Clock::time_point read_time;
+    Clock::time_point translated_time;
+    // not set when input did not produce output
+    Clock::time_point written_time;
+  };
+
+  explicit LatencyTrace(size_t capacity = 4096);
+
+  // input thread
+  void on_input_translated(Clock::time_point event_time,
+    Clock::time_point read_time, Clock::time_point translated_time);
+  void on_output_written(Clock::time_point written_time);
+  void on_no_output_pending();
+
+  // any thread
+  std::vector<Sample> samples() const;
+  std::string get_histograms() const;
+  std::string get_chrome_trace() const;
+
+private:
+  struct Slot {
+    std::atomic<uint64_t> sequence;
+    std::atomic<Clock::rep> times[4];
+  };
+
+  void add_sample(const Sample& sample);
+
+  std::unique_ptr<Slot[]> m_slots;
+  size_t m_capacity;
+  std::atomic<uint64_t> m_written{ };
+  // samples waiting for their output to be written
+  std::vector<Sample> m_pending;
+};
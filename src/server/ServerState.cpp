@@ -3,10 +3,13 @@
 #include "server/verbose_debug_io.h"
 #include "runtime/Timeout.h"
 #include "common/output.h"
+#include <algorithm>
 
 ServerState::ServerState(std::unique_ptr<IClientPort> client)
   : m_client(std::move(client)),
     m_stage(std::make_unique<MultiStage>()) {
+  // reserve buffer, so it does not need to grow while translating input
+  m_send_buffer.reserve(256);
 }
 
 void ServerState::on_configuration_message(std::unique_ptr<MultiStage> stage) {
@@ -15,8 +18,21 @@ void ServerState::on_configuration_message(std::unique_ptr<MultiStage> stage) {
   reset_configuration(std::move(stage));  
 }
 
+void ServerState::on_configuration_update_message(
+    std::vector<std::pair<int, Stage::Context>> contexts) {
+  verbose("Updating configuration (%u contexts)", contexts.size());
+  // keep state of unaffected contexts, like keys which are still hold
+  for (auto& [index, context] : contexts)
+    if (!m_stage->replace_context(index, std::move(context)))
+      return error("Receiving configuration update failed");
+  evaluate_device_filters();
+}
+
 void ServerState::on_directives_message(const std::vector<std::string>& directives) {
-  // no common server directives yet
+  // directives always follow the configuration they belong to
+  const auto match_automaton = (std::count(directives.begin(),
+    directives.end(), "match-automaton") > 0);
+  m_stage->set_match_automaton_enabled(match_automaton);
 }
 
 void ServerState::on_active_contexts_message(
@@ -50,6 +66,15 @@ void ServerState::on_request_next_key_info_message() {
   m_next_key_info_requested = true;
 }
 
+void ServerState::on_request_latency_report_message(bool chrome_trace) {
+  verbose("Latency report requested");
+  m_client->send_latency_report(get_latency_report(chrome_trace));
+}
+
+std::string ServerState::get_latency_report(bool chrome_trace) {
+  return "Latency tracing is not supported on this system\n";
+}
+
 void ServerState::on_inject_input_message(const KeySequence& sequence) {
   for (const auto& event : sequence)
     if ((event.state == KeyState::Up || event.state == KeyState::Down) &&
@@ -289,6 +314,7 @@ bool ServerState::flush_send_buffer() {
   m_flush_scheduled_at.reset();
 
   auto succeeded = true;
+  auto sent_keys = false;
   auto i = size_t{ };
   auto toggled_virtual_keys = 0;
   for (; i < m_send_buffer.size(); ++i) {
@@ -334,7 +360,10 @@ bool ServerState::flush_send_buffer() {
       succeeded = false;
       break;
     }
+    sent_keys = true;
   }
+  if (sent_keys && !on_flush_sent_keys())
+    succeeded = false;
   m_send_buffer.erase(m_send_buffer.begin(), m_send_buffer.begin() + i);
   m_sending_key = false;
   return succeeded;
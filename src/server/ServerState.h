@@ -30,6 +30,8 @@ public:
 
 protected:
   void on_configuration_message(std::unique_ptr<MultiStage> stage) override;
+  void on_configuration_update_message(
+    std::vector<std::pair<int, Stage::Context>> contexts) override;
   void on_directives_message(const std::vector<std::string>& directives) override;
   void on_active_contexts_message(
       const std::vector<int>& active_contexts) override;
@@ -38,14 +40,17 @@ protected:
   void on_request_next_key_info_message() override;
   void on_inject_input_message(const KeySequence& sequence) override;
   void on_inject_output_message(const KeySequence& sequence) override;
+  void on_request_latency_report_message(bool chrome_trace) override;
 
   virtual bool on_send_key(const KeyEvent& event) = 0;
+  virtual bool on_flush_sent_keys() { return true; }
   virtual void on_flush_scheduled(Duration timeout) { }
   virtual void on_timeout_scheduled(Duration timeout) { }
   virtual void on_timeout_cancelled() { }
   virtual void on_exit_requested() = 0;
   virtual bool on_validate_key_is_down(Key key) { return true; }
   virtual std::string get_devices_error_message() { return { }; }
+  virtual std::string get_latency_report(bool chrome_trace);
 
   void release_all_keys();
   void set_active_contexts(const std::vector<int>& active_contexts);
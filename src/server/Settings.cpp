@@ -17,6 +17,11 @@ bool interpret_commandline(Settings& settings, int argc, char* argv[]) {
     if (argument == T("-v") || argument == T("--verbose")) {
       settings.verbose = true;
     }
+#if !defined(_WIN32)
+    else if (argument == T("--trace-latency")) {
+      settings.trace_latency = true;
+    }
+#endif
 #if defined(__APPLE__)
     else if (argument == T("-g")) {
       settings.grab_and_exit = true;
@@ -35,6 +40,9 @@ void print_help_message() {
     "\n"
     "Usage: keymapperd [-options]\n"
     "  -v, --verbose        enable verbose output.\n"
+#if !defined(_WIN32)
+    "  --trace-latency      record latencies for keymapperctl --latency-report.\n"
+#endif
     "  -h, --help           print this help.\n"
     "\n"
     "%s\n"
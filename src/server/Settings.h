@@ -5,6 +5,7 @@
 struct Settings {
   bool verbose;
   bool grab_and_exit;
+  bool trace_latency;
 };
 
 #if defined(_WIN32)
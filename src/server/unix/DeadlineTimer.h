@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+
+// Descriptor which becomes readable when a point in time is reached.
+// The deadline is absolute, so it is not delayed by rounding the
+// timeout of a wait or by the time spent before waiting.
+class DeadlineTimer {
+public:
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  DeadlineTimer();
+  DeadlineTimer(const DeadlineTimer&) = delete;
+  DeadlineTimer& operator=(const DeadlineTimer&) = delete;
+  ~DeadlineTimer();
+
+  int fd() const { return m_fd; }
+  // does nothing when deadline did not change
+  bool set(std::optional<TimePoint> deadline);
+  // returns true when deadline was reached
+  bool acknowledge();
+
+private:
+  int m_fd{ -1 };
+  std::optional<TimePoint> m_deadline;
+};
@@ -0,0 +1,46 @@
+
+#include "DeadlineTimer.h"
+#include <algorithm>
+#include <cstdint>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+DeadlineTimer::DeadlineTimer()
+  : m_fd(::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) {
+}
+
+DeadlineTimer::~DeadlineTimer() {
+  if (m_fd >= 0)
+    ::close(m_fd);
+}
+
+bool DeadlineTimer::set(std::optional<TimePoint> deadline) {
+  if (m_fd < 0)
+    return false;
+  if (deadline == m_deadline)
+    return true;
+  m_deadline = deadline;
+
+  // steady_clock is CLOCK_MONOTONIC, a zero value disarms timer
+  auto spec = itimerspec{ };
+  if (deadline) {
+    using namespace std::chrono;
+    const auto time = std::max(deadline->time_since_epoch(),
+      duration_cast<steady_clock::duration>(nanoseconds(1)));
+    const auto secs = duration_cast<seconds>(time);
+    spec.it_value.tv_sec = static_cast<time_t>(secs.count());
+    spec.it_value.tv_nsec = static_cast<long>(
+      duration_cast<nanoseconds>(time - secs).count());
+  }
+  return (::timerfd_settime(m_fd, TFD_TIMER_ABSTIME, &spec, nullptr) == 0);
+}
+
+bool DeadlineTimer::acknowledge() {
+  auto expirations = uint64_t{ };
+  if (::read(m_fd, &expirations, sizeof(expirations)) !=
+        sizeof(expirations) || !expirations)
+    return false;
+  // one-shot timer is disarmed
+  m_deadline.reset();
+  return true;
+}
@@ -12,12 +12,15 @@
 class GrabbedDevices {
 public:
   using Duration = std::chrono::duration<double>;
+  using TimePoint = std::chrono::steady_clock::time_point;
 
   struct Event {
     int device_index;
     int type;
     int code;
     int value;
+    // kernel timestamp of event, when available
+    TimePoint time;
   };
 
   GrabbedDevices();
@@ -28,7 +31,7 @@ public:
   bool grab(bool grab_mice, std::vector<GrabDeviceFilter> grab_filters);
   bool update_devices();
   std::pair<bool, std::optional<Event>> read_input_event(
-    std::optional<Duration> timeout, int interrupt_fd);
+    std::optional<TimePoint> timeout_at, int interrupt_fd);
   const std::vector<DeviceDesc>& grabbed_device_descs() const;
 
 private:
@@ -2,6 +2,7 @@
 #include "GrabbedDevices.h"
 #include "VirtualDevices.h"
 #include "DeviceDescLinux.h"
+#include "DeadlineTimer.h"
 #include "common/output.h"
 #include "common/Duration.h"
 #include <cstdio>
@@ -11,9 +12,13 @@
 #include <bitset>
 #include <iterator>
 #include <filesystem>
+#include <cmath>
+#include <ctime>
+#include <limits>
 #include <fcntl.h>
 #include <unistd.h>
 #include <linux/input.h>
+#include <sys/epoll.h>
 #include <sys/inotify.h>
 
 namespace {
@@ -237,6 +242,12 @@ namespace {
     return (::ioctl(fd, EVIOCGRAB, (grab ? 1 : 0)) == 0);
   }
 
+  void set_monotonic_timestamps(int fd) {
+    // same clock as std::chrono::steady_clock
+    auto clock_id = int{ CLOCK_MONOTONIC };
+    ::ioctl(fd, EVIOCSCLOCKID, &clock_id);
+  }
+
   int open_event_device(const char* event_path) {
     do {
       const auto fd = ::open(event_path, O_RDONLY);
@@ -259,17 +270,23 @@ namespace {
     return fd;
   }
 
-  bool read_all(int fd, char* buffer, size_t length) {
-    while (length != 0) {
-      auto ret = ::read(fd, buffer, length);
-      if (ret == -1 && errno == EINTR)
-        continue;
-      if (ret <= 0)
-        return false;
-      length -= static_cast<size_t>(ret);
-      buffer += ret;
-    }
-    return true;
+  // epoll data of descriptors, which are not grabbed devices
+  const auto device_monitor_tag = std::numeric_limits<uint32_t>::max();
+  const auto interrupt_tag = device_monitor_tag - 1;
+  const auto timer_tag = device_monitor_tag - 2;
+
+  bool set_epoll_interest(int epoll_fd, int fd, uint32_t data) {
+    auto event = epoll_event{ };
+    event.events = EPOLLIN;
+    event.data.u32 = data;
+    if (::epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) == 0)
+      return true;
+    return (errno == ENOENT &&
+      ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0);
+  }
+
+  void remove_epoll_interest(int epoll_fd, int fd) {
+    ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
   }
 } // namespace
 
@@ -285,17 +302,42 @@ private:
     bool disappeared;
   };
 
+  using Event = GrabbedDevices::Event;
+
+  // maximum number of events read from a device at once
+  static constexpr auto max_events_per_read = 64;
+  static constexpr auto max_ready_per_wait = 16;
+
   std::string_view m_ignore_device_name;
   bool m_grab_mice{ };
   std::vector<GrabDeviceFilter> m_grab_filters;
+  int m_epoll_fd{ -1 };
   int m_device_monitor_fd{ -1 };
+  int m_interrupt_fd{ -1 };
+  DeadlineTimer m_timer;
   std::vector<Device> m_grabbed_devices;
   std::vector<DeviceDesc> m_grabbed_device_descs;
   bool m_devices_changed{ };
 
+  // events read but not yet returned
+  std::vector<Event> m_events;
+  size_t m_events_returned{ };
+  bool m_device_monitor_ready{ };
+  bool m_interrupt_ready{ };
+  bool m_timer_ready{ };
+
 public:
-  using Event = GrabbedDevices::Event;
-  using Duration = GrabbedDevices::Duration;
+  using TimePoint = GrabbedDevices::TimePoint;
+
+  GrabbedDevicesImpl()
+    : m_epoll_fd(::epoll_create1(EPOLL_CLOEXEC)) {
+    m_events.reserve(max_events_per_read * max_ready_per_wait);
+    if (m_epoll_fd >= 0 && m_timer.fd() >= 0 &&
+        !set_epoll_interest(m_epoll_fd, m_timer.fd(), timer_tag)) {
+      ::close(m_epoll_fd);
+      m_epoll_fd = -1;
+    }
+  }
 
   ~GrabbedDevicesImpl() {
     if (!m_grabbed_devices.empty()) {
@@ -304,9 +346,13 @@ public:
         ungrab_device(device);
     }
     release_device_monitor();
+    if (m_epoll_fd >= 0)
+      ::close(m_epoll_fd);
   }
 
   bool initialize(bool grab_mice, std::vector<GrabDeviceFilter> grab_filters) {
+    if (m_epoll_fd < 0)
+      return false;
     m_grab_mice = grab_mice;
     m_grab_filters = std::move(grab_filters);
     update();
@@ -327,81 +373,114 @@ public:
   }
 
   std::pair<bool, std::optional<Event>> read_input_event(
-        std::optional<Duration> timeout, int interrupt_fd) {
+        std::optional<TimePoint> timeout_at, int interrupt_fd) {
+    if (!set_interrupt_fd(interrupt_fd) ||
+        !m_timer.set(timeout_at))
+      return { false, std::nullopt };
+
     for (;;) {
-      auto read_set = fd_set{ };
-      FD_ZERO(&read_set);
-      auto max_fd = 0;
-      for (const auto& device : m_grabbed_devices) {
-        max_fd = std::max(max_fd, device.fd);
-        FD_SET(device.fd, &read_set);
-      }
+      // report before events, so client messages do not wait for them
+      if (std::exchange(m_interrupt_ready, false))
+        return { true, std::nullopt };
 
-      if (m_device_monitor_fd >= 0) {
-        max_fd = std::max(max_fd, m_device_monitor_fd);
-        FD_SET(m_device_monitor_fd, &read_set);
-      }
+      // return events which were read at once
+      if (m_events_returned < m_events.size())
+        return { true, m_events[m_events_returned++] };
+      m_events.clear();
+      m_events_returned = 0;
 
-      if (interrupt_fd >= 0) {
-        max_fd = std::max(max_fd, interrupt_fd);
-        FD_SET(interrupt_fd, &read_set);
+      // report after events, which were read with old device indices
+      if (std::exchange(m_device_monitor_ready, false)) {
+        m_devices_changed = true;
+        return { true, std::nullopt };
       }
 
-      auto timeoutval = (timeout ? to_timeval(timeout.value()) : timeval{ });
-      const auto result = ::select(max_fd + 1, &read_set,
-        nullptr, nullptr, (timeout ? &timeoutval : nullptr));
-      if (result == -1 && errno == EINTR)
+      // timeout
+      if (std::exchange(m_timer_ready, false))
+        return { true, std::nullopt };
+
+      auto ready = std::array<epoll_event, max_ready_per_wait>();
+      const auto count = ::epoll_wait(m_epoll_fd, ready.data(),
+        static_cast<int>(ready.size()), -1);
+      if (count == -1 && errno == EINTR)
         continue;
 
-      if (result < 0)
+      if (count <= 0)
         return { false, std::nullopt };
 
-      if (m_device_monitor_fd >= 0 &&
-          FD_ISSET(m_device_monitor_fd, &read_set)) {
-        m_devices_changed = true;
-        return { true, std::nullopt };
+      for (auto i = 0; i < count; ++i) {
+        const auto data = ready[i].data.u32;
+        if (data == device_monitor_tag) {
+          m_device_monitor_ready = true;
+        }
+        else if (data == interrupt_tag) {
+          m_interrupt_ready = true;
+        }
+        else if (data == timer_tag) {
+          m_timer_ready = m_timer.acknowledge();
+        }
+        else if (!read_device_events(static_cast<int>(data))) {
+          return { false, std::nullopt };
+        }
       }
+    }
+  }
 
-      if (interrupt_fd >= 0 &&
-          FD_ISSET(interrupt_fd, &read_set))
-        return { true, std::nullopt };
+private:
+  bool read_device_events(int device_index) {
+    const auto& device = m_grabbed_devices[device_index];
+    auto events = std::array<input_event, max_events_per_read>();
+    auto size = ssize_t{ };
+    do {
+      size = ::read(device.fd, events.data(), sizeof(events));
+    } while (size == -1 && errno == EINTR);
 
-      auto device_index = 0;
-      for (const auto& device : m_grabbed_devices) {
-        if (FD_ISSET(device.fd, &read_set)) {
-          auto ev = input_event{ };
-          if (!read_all(device.fd,
-                reinterpret_cast<char*>(&ev), sizeof(input_event)))
-            return { false, std::nullopt };
-
-          // map from device range to default range
-          if (ev.type == EV_ABS) {
-            if (ev.code == ABS_VOLUME) {
-              ev.value = map_to_range(ev.value, device.abs_range_volume, default_abs_range);
-            }
-            else if (ev.code == ABS_MISC) {
-              ev.value = map_to_range(ev.value, device.abs_range_misc, default_abs_range);
-            }
-          }
+    if (size <= 0 || size % sizeof(input_event) != 0)
+      return false;
 
-          return { true, Event{ device_index, ev.type, ev.code, ev.value } };
+    const auto count = static_cast<size_t>(size) / sizeof(input_event);
+    for (auto i = size_t{ }; i < count; ++i) {
+      auto& ev = events[i];
+
+      // map from device range to default range
+      if (ev.type == EV_ABS) {
+        if (ev.code == ABS_VOLUME) {
+          ev.value = map_to_range(ev.value, device.abs_range_volume, default_abs_range);
+        }
+        else if (ev.code == ABS_MISC) {
+          ev.value = map_to_range(ev.value, device.abs_range_misc, default_abs_range);
         }
-        ++device_index;
       }
-      
-      // timeout
-      return { true, std::nullopt };
+      const auto time = TimePoint(
+        std::chrono::seconds(ev.input_event_sec) +
+        std::chrono::microseconds(ev.input_event_usec));
+      m_events.push_back({ device_index, ev.type, ev.code, ev.value, time });
     }
+    return true;
+  }
+
+  bool set_interrupt_fd(int interrupt_fd) {
+    if (interrupt_fd == m_interrupt_fd)
+      return true;
+    if (m_interrupt_fd >= 0)
+      remove_epoll_interest(m_epoll_fd, m_interrupt_fd);
+    m_interrupt_fd = interrupt_fd;
+    m_interrupt_ready = false;
+    return (interrupt_fd < 0 ||
+      set_epoll_interest(m_epoll_fd, interrupt_fd, interrupt_tag));
   }
 
-private:
   void initialize_device_monitor() {
     release_device_monitor();
     m_device_monitor_fd = create_event_device_monitor();
+    if (m_device_monitor_fd >= 0 &&
+        !set_epoll_interest(m_epoll_fd, m_device_monitor_fd, device_monitor_tag))
+      error("Monitoring devices failed");
   }
 
   void release_device_monitor() {
     if (m_device_monitor_fd >= 0) {
+      remove_epoll_interest(m_epoll_fd, m_device_monitor_fd);
       ::close(m_device_monitor_fd);
       m_device_monitor_fd = -1;
     }
@@ -411,6 +490,7 @@ private:
     wait_until_keys_released(fd);
     if (!grab_event_device(fd, true))
       return false;
+    set_monotonic_timestamps(fd);
 
     m_grabbed_devices.push_back({
       event_id,
@@ -422,6 +502,7 @@ private:
   }
 
   void ungrab_device(const Device& device) {
+    remove_epoll_interest(m_epoll_fd, device.fd);
     wait_until_keys_released(device.fd);
     grab_event_device(device.fd, false);
     ::close(device.fd);
@@ -488,6 +569,12 @@ private:
       }
     }
 
+    // wait for input of grabbed devices, data is the device index
+    for (auto i = 0u; i < m_grabbed_devices.size(); ++i)
+      if (!set_epoll_interest(m_epoll_fd, m_grabbed_devices[i].fd, i))
+        error("Waiting for input of /dev/input/event%d failed",
+          m_grabbed_devices[i].event_id);
+
     // collect grabbed device descs
     m_grabbed_device_descs.clear();
     for (const auto& device : m_grabbed_devices) {
@@ -535,9 +622,9 @@ bool GrabbedDevices::update_devices() {
   return m_impl->update_devices();
 }
 
-auto GrabbedDevices::read_input_event(std::optional<Duration> timeout, int interrupt_fd)
-    -> std::pair<bool, std::optional<Event>> {
-  return m_impl->read_input_event(timeout, interrupt_fd);
+auto GrabbedDevices::read_input_event(std::optional<TimePoint> timeout_at,
+    int interrupt_fd) -> std::pair<bool, std::optional<Event>> {
+  return m_impl->read_input_event(timeout_at, interrupt_fd);
 }
 
 const std::vector<DeviceDesc>& GrabbedDevices::grabbed_device_descs() const {
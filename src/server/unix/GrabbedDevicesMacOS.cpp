@@ -109,6 +109,7 @@ class GrabbedDevicesImpl {
 private:
   using Event = GrabbedDevices::Event;
   using Duration = GrabbedDevices::Duration;
+  using TimePoint = GrabbedDevices::TimePoint;
 
   IOHIDManagerRef m_hid_manager{ };
   bool m_grab_mice{ };
@@ -147,12 +148,7 @@ public:
   }
 
   std::pair<bool, std::optional<Event>> read_input_event(
-      std::optional<Duration> timeout, int interrupt_fd) {      
-        
-    const auto timeout_at = (timeout ? 
-        std::chrono::steady_clock::now() + *timeout : 
-        std::chrono::steady_clock::time_point::max());
-
+      std::optional<TimePoint> timeout_at, int interrupt_fd) {      
     for (;;) {
       if (m_event_queue_pos < m_event_queue.size())
         return { true, m_event_queue[m_event_queue_pos++] };
@@ -164,7 +160,9 @@ public:
         return { true, std::nullopt };
 
       // TODO: do not poll. see https://stackoverflow.com/questions/48434976/cfsocket-data-callbacks
-      auto poll_timeout = (timeout.has_value() ? timeout.value() : Duration::max());
+      auto poll_timeout = (timeout_at.has_value() ?
+        std::max(Duration(*timeout_at - std::chrono::steady_clock::now()), Duration::zero()) :
+        Duration::max());
       if (interrupt_fd >=0) {
         if (can_read_from_file(interrupt_fd))
           return { true, std::nullopt };
@@ -173,7 +171,7 @@ public:
 
       CFRunLoopRunInMode(kCFRunLoopDefaultMode, poll_timeout.count(), true);
 
-      if (std::chrono::steady_clock::now() >= timeout_at)  
+      if (timeout_at && std::chrono::steady_clock::now() >= *timeout_at)  
         return { true, std::nullopt };
     }
   }
@@ -325,9 +323,9 @@ bool GrabbedDevices::update_devices() {
   return m_impl->update_devices();
 }
 
-auto GrabbedDevices::read_input_event(std::optional<Duration> timeout, int interrupt_fd)
-    -> std::pair<bool, std::optional<Event>> {
-  return m_impl->read_input_event(timeout, interrupt_fd);
+auto GrabbedDevices::read_input_event(std::optional<TimePoint> timeout_at,
+    int interrupt_fd) -> std::pair<bool, std::optional<Event>> {
+  return m_impl->read_input_event(timeout_at, interrupt_fd);
 }
 
 const std::vector<DeviceDesc>& GrabbedDevices::grabbed_device_descs() const {
@@ -0,0 +1,323 @@
+
+#include "ThreadedClientPort.h"
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <iterator>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+namespace {
+  bool create_pipe(int (&fds)[2]) {
+    if (::pipe(fds) != 0)
+      return false;
+    for (auto fd : fds) {
+      ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+      ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return true;
+  }
+
+  void close_pipe(int (&fds)[2]) {
+    for (auto& fd : fds)
+      if (fd >= 0)
+        ::close(std::exchange(fd, -1));
+  }
+
+  void write_pipe(int fd) {
+    // when pipe is full it is readable anyway
+    const auto byte = char{ };
+    [[maybe_unused]] const auto result = ::write(fd, &byte, 1);
+  }
+
+  void drain_pipe(int fd) {
+    char buffer[64];
+    while (::read(fd, buffer, sizeof(buffer)) > 0) { }
+  }
+} // namespace
+
+// queues the deserialized messages for the input thread
+class ThreadedClientPort::QueueingHandler : public MessageHandler {
+public:
+  explicit QueueingHandler(ThreadedClientPort& port) : m_port(port) { }
+
+  void on_configuration_message(MultiStagePtr stage) override {
+    push([stage = std::move(stage)](MessageHandler& handler) mutable {
+      handler.on_configuration_message(std::move(stage));
+    });
+  }
+
+  void on_configuration_update_message(
+      std::vector<std::pair<int, Stage::Context>> contexts) override {
+    push([contexts = std::move(contexts)](MessageHandler& handler) mutable {
+      handler.on_configuration_update_message(std::move(contexts));
+    });
+  }
+
+  void on_grab_device_filters_message(
+      std::vector<GrabDeviceFilter> filters) override {
+    push([filters = std::move(filters)](MessageHandler& handler) mutable {
+      handler.on_grab_device_filters_message(std::move(filters));
+    });
+  }
+
+  void on_directives_message(
+      const std::vector<std::string>& directives) override {
+    push([directives](MessageHandler& handler) {
+      handler.on_directives_message(directives);
+    });
+  }
+
+  void on_active_contexts_message(
+      const std::vector<int>& context_indices) override {
+    push([context_indices](MessageHandler& handler) {
+      handler.on_active_contexts_message(context_indices);
+    });
+  }
+
+  void on_set_virtual_key_state_message(Key key, KeyState state) override {
+    push([key, state](MessageHandler& handler) {
+      handler.on_set_virtual_key_state_message(key, state);
+    });
+  }
+
+  void on_validate_state_message() override {
+    push([](MessageHandler& handler) {
+      handler.on_validate_state_message();
+    });
+  }
+
+  void on_request_next_key_info_message() override {
+    push([](MessageHandler& handler) {
+      handler.on_request_next_key_info_message();
+    });
+  }
+
+  void on_inject_input_message(const KeySequence& sequence) override {
+    push([sequence](MessageHandler& handler) {
+      handler.on_inject_input_message(sequence);
+    });
+  }
+
+  void on_inject_output_message(const KeySequence& sequence) override {
+    push([sequence](MessageHandler& handler) {
+      handler.on_inject_output_message(sequence);
+    });
+  }
+
+  void on_request_latency_report_message(bool chrome_trace) override {
+    if (m_port.m_latency_report_handler) {
+      m_port.m_port.send_latency_report(
+        m_port.m_latency_report_handler(chrome_trace));
+      return;
+    }
+    push([chrome_trace](MessageHandler& handler) {
+      handler.on_request_latency_report_message(chrome_trace);
+    });
+  }
+
+private:
+  template<typename F>
+  struct Message : IncomingMessage {
+    F function;
+    explicit Message(F&& function) : function(std::move(function)) { }
+    void apply(MessageHandler& handler) override { function(handler); }
+  };
+
+  template<typename F>
+  void push(F&& function) {
+    m_port.push_incoming(std::make_unique<Message<F>>(std::move(function)));
+  }
+
+  ThreadedClientPort& m_port;
+};
+
+//-------------------------------------------------------------------------
+
+ThreadedClientPort::ThreadedClientPort(std::string ipc_id)
+  : m_port(std::move(ipc_id)) {
+  create_pipe(m_input_pipe);
+  create_pipe(m_control_pipe);
+}
+
+ThreadedClientPort::~ThreadedClientPort() {
+  disconnect();
+  close_pipe(m_input_pipe);
+  close_pipe(m_control_pipe);
+}
+
+void ThreadedClientPort::interrupt() {
+  write_pipe(m_input_pipe[1]);
+}
+
+void ThreadedClientPort::set_latency_report_handler(
+    std::function<std::string(bool)> handler) {
+  m_latency_report_handler = std::move(handler);
+}
+
+bool ThreadedClientPort::listen() {
+  return m_port.listen();
+}
+
+bool ThreadedClientPort::accept() {
+  if (m_input_pipe[0] < 0 || m_control_pipe[0] < 0 || !m_port.accept())
+    return false;
+
+  m_stop.store(false);
+  m_disconnected.store(false);
+  m_thread = std::thread(&ThreadedClientPort::control_thread, this);
+  return true;
+}
+
+void ThreadedClientPort::disconnect() {
+  if (m_thread.joinable()) {
+    m_stop.store(true);
+    write_pipe(m_control_pipe[1]);
+    m_thread.join();
+  }
+  m_port.disconnect();
+
+  // discard what was not received
+  while (m_incoming.pop(&m_incoming_message)) { }
+  while (m_outgoing.pop(&m_outgoing_message)) { }
+  m_outgoing_overflow.clear();
+  m_outgoing_overflowed.store(false);
+  m_sending_overflow.clear();
+  m_incoming_message.reset();
+  drain_pipe(m_input_pipe[0]);
+  drain_pipe(m_control_pipe[0]);
+}
+
+bool ThreadedClientPort::push_outgoing(OutgoingMessage&& message) {
+  // never block input thread, unless the client is not keeping up
+  if (m_outgoing_overflowed.load() ||
+      !m_outgoing.push(std::move(message))) {
+    auto lock = std::lock_guard<std::mutex>(m_overflow_mutex);
+    // keep order, once messages overflowed
+    if (m_outgoing_overflowed.load() ||
+        !m_outgoing.push(std::move(message))) {
+      m_outgoing_overflow.push_back(std::move(message));
+      m_outgoing_overflowed.store(true);
+    }
+  }
+  write_pipe(m_control_pipe[1]);
+  return true;
+}
+
+bool ThreadedClientPort::send_triggered_action(int action) {
+  return push_outgoing({ MessageType::execute_action, action });
+}
+
+bool ThreadedClientPort::send_virtual_key_state(Key key, KeyState state) {
+  return push_outgoing({ MessageType::virtual_key_state, 0, key, state });
+}
+
+bool ThreadedClientPort::send_next_key_info(Key key,
+    const DeviceDesc& device_desc) {
+  return push_outgoing({ MessageType::next_key_info, 0, key, { }, device_desc });
+}
+
+bool ThreadedClientPort::send_latency_report(const std::string& report) {
+  auto message = OutgoingMessage{ MessageType::latency_report };
+  message.report = report;
+  return push_outgoing(std::move(message));
+}
+
+bool ThreadedClientPort::read_messages(MessageHandler& handler,
+    std::optional<Duration> timeout) {
+  if (timeout != Duration::zero() && m_incoming.empty() &&
+      !m_disconnected.load())
+    if (!block_until_readable(m_input_pipe[0], timeout))
+      return false;
+
+  drain_pipe(m_input_pipe[0]);
+  while (m_incoming.pop(&m_incoming_message)) {
+    m_incoming_message->apply(handler);
+    m_incoming_message.reset();
+  }
+  return !m_disconnected.load();
+}
+
+void ThreadedClientPort::push_incoming(IncomingMessagePtr message) {
+  // wait for input thread to catch up
+  while (!m_incoming.push(std::move(message))) {
+    if (m_stop.load())
+      return;
+    write_pipe(m_input_pipe[1]);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  write_pipe(m_input_pipe[1]);
+}
+
+bool ThreadedClientPort::send_outgoing_message(const OutgoingMessage& message) {
+  switch (message.type) {
+    case MessageType::execute_action:
+      return m_port.send_triggered_action(message.action);
+    case MessageType::virtual_key_state:
+      return m_port.send_virtual_key_state(message.key, message.state);
+    case MessageType::next_key_info:
+      return m_port.send_next_key_info(message.key, message.device_desc);
+    case MessageType::latency_report:
+      return m_port.send_latency_report(message.report);
+    default:
+      return true;
+  }
+}
+
+bool ThreadedClientPort::send_outgoing_messages() {
+  while (m_outgoing.pop(&m_outgoing_message))
+    if (!send_outgoing_message(m_outgoing_message))
+      return false;
+
+  if (m_outgoing_overflowed.load()) {
+    // the queued messages precede the overflowed ones
+    auto& messages = m_sending_overflow;
+    {
+      auto lock = std::lock_guard<std::mutex>(m_overflow_mutex);
+      while (m_outgoing.pop(&m_outgoing_message))
+        messages.push_back(std::move(m_outgoing_message));
+      messages.insert(messages.end(),
+        std::make_move_iterator(m_outgoing_overflow.begin()),
+        std::make_move_iterator(m_outgoing_overflow.end()));
+      m_outgoing_overflow.clear();
+      m_outgoing_overflowed.store(false);
+    }
+    for (const auto& message : messages)
+      if (!send_outgoing_message(message))
+        return false;
+    messages.clear();
+  }
+  return true;
+}
+
+void ThreadedClientPort::control_thread() {
+  // signals are handled by input thread
+  auto signals = sigset_t{ };
+  sigfillset(&signals);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  auto handler = QueueingHandler(*this);
+  auto fds = std::array<pollfd, 2>{ {
+    { static_cast<int>(m_port.socket()), POLLIN, 0 },
+    { m_control_pipe[0], POLLIN, 0 },
+  } };
+  while (!m_stop.load()) {
+    if (::poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    drain_pipe(m_control_pipe[0]);
+
+    if (!send_outgoing_messages())
+      break;
+
+    if (fds[0].revents &&
+        !m_port.read_messages(handler, Duration::zero()))
+      break;
+  }
+  m_disconnected.store(true);
+  write_pipe(m_input_pipe[1]);
+}
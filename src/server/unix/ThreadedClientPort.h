@@ -0,0 +1,82 @@
+#pragma once
+
+#include "server/ClientPort.h"
+#include "common/SpscQueue.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Moves the client connection to a control thread, so the thread
+// translating the input is not stalled by reading and deserializing
+// messages. Messages are passed through lock-free queues and the
+// receiving thread is woken up by writing to a pipe. Outgoing messages
+// which do not fit in the queue are kept in a locked overflow vector.
+class ThreadedClientPort : public IClientPort {
+public:
+  explicit ThreadedClientPort(std::string ipc_id = "keymapper");
+  ThreadedClientPort(const ThreadedClientPort&) = delete;
+  ThreadedClientPort& operator=(const ThreadedClientPort&) = delete;
+  ~ThreadedClientPort();
+
+  // readable when messages were queued for the input thread
+  int interrupt_fd() const { return m_input_pipe[0]; }
+  // can be called from a signal handler
+  void interrupt();
+  // latency reports are created on the control thread
+  void set_latency_report_handler(std::function<std::string(bool)> handler);
+
+  Socket socket() const override { return m_port.socket(); }
+  Socket listen_socket() const override { return m_port.listen_socket(); }
+  bool version_mismatch() const override { return m_port.version_mismatch(); }
+  bool listen() override;
+  bool accept() override;
+  void disconnect() override;
+  bool send_triggered_action(int action) override;
+  bool send_virtual_key_state(Key key, KeyState state) override;
+  bool send_next_key_info(Key key, const DeviceDesc& device_desc) override;
+  bool send_latency_report(const std::string& report) override;
+  bool read_messages(MessageHandler& handler,
+    std::optional<Duration> timeout) override;
+
+private:
+  struct IncomingMessage {
+    virtual ~IncomingMessage() = default;
+    virtual void apply(MessageHandler& handler) = 0;
+  };
+  using IncomingMessagePtr = std::unique_ptr<IncomingMessage>;
+
+  struct OutgoingMessage {
+    MessageType type;
+    int action;
+    Key key;
+    KeyState state;
+    DeviceDesc device_desc;
+    std::string report;
+  };
+
+  class QueueingHandler;
+
+  void control_thread();
+  bool send_outgoing_message(const OutgoingMessage& message);
+  bool send_outgoing_messages();
+  bool push_outgoing(OutgoingMessage&& message);
+  void push_incoming(IncomingMessagePtr message);
+
+  ClientPort m_port;
+  std::function<std::string(bool)> m_latency_report_handler;
+  std::thread m_thread;
+  std::atomic<bool> m_stop{ };
+  std::atomic<bool> m_disconnected{ };
+  int m_input_pipe[2]{ -1, -1 };
+  int m_control_pipe[2]{ -1, -1 };
+  SpscQueue<IncomingMessagePtr, 64> m_incoming;
+  SpscQueue<OutgoingMessage, 256> m_outgoing;
+  std::mutex m_overflow_mutex;
+  std::vector<OutgoingMessage> m_outgoing_overflow;
+  std::atomic<bool> m_outgoing_overflowed{ };
+  std::vector<OutgoingMessage> m_sending_overflow;
+  IncomingMessagePtr m_incoming_message;
+  OutgoingMessage m_outgoing_message{ };
+};
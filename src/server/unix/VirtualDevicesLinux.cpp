@@ -9,6 +9,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <linux/uinput.h>
+#include <sys/time.h>
 #include <chrono>
 #include <map>
 
@@ -155,10 +156,50 @@ namespace {
   private:
     int m_uinput_fd{ -1 };
     std::vector<Key> m_down_keys;
+    // events written on flush, the last frame begins at m_frame_begin
+    std::vector<input_event> m_events;
+    size_t m_frame_begin{ };
+    // forwarded events are buffered separately, so forwarding a frame
+    // to the keyboard device does not write the output queued before
+    std::vector<input_event> m_forwarded_events;
+
+    static void add_event(std::vector<input_event>& events,
+        int type, int code, int value) {
+      auto& event = events.emplace_back();
+      event.type = static_cast<unsigned short>(type);
+      event.code = static_cast<unsigned short>(code);
+      event.value = value;
+    }
+
+    bool write_events(std::vector<input_event>& events) {
+      if (events.empty())
+        return true;
+
+      auto time = timeval{ };
+      ::gettimeofday(&time, nullptr);
+      for (auto& event : events)
+        event.time = time;
+
+      auto buffer = reinterpret_cast<const char*>(events.data());
+      auto length = events.size() * sizeof(input_event);
+      while (length != 0) {
+        const auto result = ::write(m_uinput_fd, buffer, length);
+        if (result == -1 && errno == EINTR)
+          continue;
+        if (result <= 0)
+          break;
+        length -= static_cast<size_t>(result);
+        buffer += result;
+      }
+      events.clear();
+      return (length == 0);
+    }
 
   public:
     explicit VirtualDevice(int uinput_fd)
       : m_uinput_fd(uinput_fd) {
+      m_events.reserve(256);
+      m_forwarded_events.reserve(64);
     }
 
     ~VirtualDevice() {
@@ -186,19 +227,33 @@ namespace {
       return press;
     }
 
-    bool send_event(int type, int code, int value) {
-      auto event = input_event{ };
-      ::gettimeofday(&event.time, nullptr);
-      event.type = static_cast<unsigned short>(type);
-      event.code = static_cast<unsigned short>(code);
-      event.value = value;
-      do {
-        const auto result = ::write(m_uinput_fd, &event, sizeof(event));
-        if (result >= 0)
-          return (result == sizeof(event));
-      } while (errno == EINTR);
+    void queue_event(int type, int code, int value) {
+      add_event(m_events, type, code, value);
+      if (type == EV_SYN)
+        m_frame_begin = m_events.size();
+    }
 
-      return false;
+    // puts consecutive events in one frame, unless a code is repeated
+    void queue_event_in_frame(int type, int code, int value) {
+      if (std::any_of(m_events.begin() + static_cast<ptrdiff_t>(m_frame_begin),
+            m_events.end(), [&](const input_event& event) {
+              return (event.type == type && event.code == code);
+            }))
+        queue_event(EV_SYN, SYN_REPORT, 0);
+      queue_event(type, code, value);
+    }
+
+    bool forward_event(int type, int code, int value) {
+      add_event(m_forwarded_events, type, code, value);
+      // forwarded frames are complete on SYN_REPORT
+      return (type != EV_SYN || write_events(m_forwarded_events));
+    }
+
+    bool flush() {
+      if (m_frame_begin < m_events.size())
+        queue_event(EV_SYN, SYN_REPORT, 0);
+      m_frame_begin = 0;
+      return write_events(m_events);
     }
   };
 } // namespace
@@ -248,7 +303,7 @@ public:
   }
 
   bool forward_event(int device_index, int type, int code, int value) {
-    return m_devices[device_index]->send_event(type, code, value);
+    return m_devices[device_index]->forward_event(type, code, value);
   }
 
   bool send_key_event(const KeyEvent& event) {
@@ -256,14 +311,18 @@ public:
       const auto vertical = (event.key == Key::WheelUp || event.key == Key::WheelDown);
       const auto negative = (event.key == Key::WheelDown || event.key == Key::WheelLeft);
       const auto value = (event.value ? event.value : 120) * (negative ? -1 : 1);
-      m_keyboard->send_event(EV_REL, (vertical ? REL_WHEEL : REL_HWHEEL), value / 120);
-      m_keyboard->send_event(EV_REL, (vertical ? REL_WHEEL_HI_RES : REL_HWHEEL_HI_RES), value);
+      m_keyboard->queue_event_in_frame(EV_REL, (vertical ? REL_WHEEL : REL_HWHEEL), value / 120);
+      m_keyboard->queue_event(EV_REL, (vertical ? REL_WHEEL_HI_RES : REL_HWHEEL_HI_RES), value);
     }
     else {
-      if (!m_keyboard->send_event(EV_KEY, *event.key, m_keyboard->update_key_state(event)))
-        return false;
+      m_keyboard->queue_event_in_frame(EV_KEY, *event.key, m_keyboard->update_key_state(event));
     }
-    return m_keyboard->send_event(EV_SYN, SYN_REPORT, 0);
+    return true;
+  }
+
+  bool flush() {
+    // forward devices are flushed when a forwarded frame is complete
+    return m_keyboard->flush();
   }
 };
 
@@ -296,5 +355,5 @@ bool VirtualDevices::forward_event(int device_index, int type, int code, int val
 }
 
 bool VirtualDevices::flush() {
-  return true;
+  return (m_impl && m_impl->flush());
 }
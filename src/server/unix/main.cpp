@@ -1,19 +1,31 @@
 
 #include "GrabbedDevices.h"
 #include "VirtualDevices.h"
+#include "ThreadedClientPort.h"
 #include "server/Settings.h"
+#include "server/LatencyTrace.h"
 #include "server/ServerState.h"
 #include "runtime/Timeout.h"
 #include "common/output.h"
 #include <csignal>
 #include <atomic>
+#include <pthread.h>
+#include <sched.h>
 
 namespace {
+  std::unique_ptr<IClientPort> create_client_port();
+
   class ServerStateImpl final : public ServerState {
+  public:
+    ServerStateImpl() : ServerState(create_client_port()) { }
+
   private:
     bool on_send_key(const KeyEvent& event) override;
+    bool on_flush_sent_keys() override;
     void on_exit_requested() override;
     void on_configuration_message(MultiStagePtr stage) override;
+    void on_configuration_update_message(
+      std::vector<std::pair<int, Stage::Context>> contexts) override;
     void on_grab_device_filters_message(
       std::vector<GrabDeviceFilter> filters) override;
     void on_directives_message(
@@ -22,28 +34,54 @@ namespace {
   
   VirtualDevices g_virtual_devices;
   GrabbedDevices g_grabbed_devices;
+  ThreadedClientPort* g_client_port;
+  std::unique_ptr<LatencyTrace> g_latency_trace;
   int g_interrupt_fd;
   std::atomic<bool> g_shutdown;
   std::vector<GrabDeviceFilter> m_grab_device_filters;
   bool g_grab_device_filters_changed;
   ServerStateImpl g_state;
+
+  std::unique_ptr<IClientPort> create_client_port() {
+    auto client_port = std::make_unique<ThreadedClientPort>();
+    g_client_port = client_port.get();
+    return client_port;
+  }
   
   bool ServerStateImpl::on_send_key(const KeyEvent& event) {
     return g_virtual_devices.send_key_event(event);
   }
 
+  bool ServerStateImpl::on_flush_sent_keys() {
+    const auto result = g_virtual_devices.flush();
+    if (g_latency_trace)
+      g_latency_trace->on_output_written(Clock::now());
+    return result;
+  }
+
   void ServerStateImpl::on_exit_requested() {
     g_shutdown.store(true);
   }
 
   void ServerStateImpl::on_configuration_message(MultiStagePtr stage) {
-    if (has_configuration() &&
+    // a rejected configuration image is reported by ServerState
+    if (stage && has_configuration() &&
         has_mouse_mappings() != stage->has_mouse_mappings()) {
       verbose("Mouse usage in configuration changed");
       g_grab_device_filters_changed = true;
     }
     ServerState::on_configuration_message(std::move(stage));
   }
+
+  void ServerStateImpl::on_configuration_update_message(
+      std::vector<std::pair<int, Stage::Context>> contexts) {
+    const auto had_mouse_mappings = has_mouse_mappings();
+    ServerState::on_configuration_update_message(std::move(contexts));
+    if (had_mouse_mappings != has_mouse_mappings()) {
+      verbose("Mouse usage in configuration changed");
+      g_grab_device_filters_changed = true;
+    }
+  }
     
   void ServerStateImpl::on_grab_device_filters_message(
       std::vector<GrabDeviceFilter> filters) {
@@ -85,21 +123,31 @@ namespace {
     return true;
   }
 
+  void set_realtime_priority(bool enabled) {
+    auto param = sched_param{ };
+    param.sched_priority = (enabled ? sched_get_priority_min(SCHED_FIFO) : 0);
+    if (::pthread_setschedparam(::pthread_self(),
+          (enabled ? SCHED_FIFO : SCHED_OTHER), &param) != 0 && enabled)
+      verbose("Setting real-time priority failed");
+  }
+
   bool main_loop() {
     auto& s = g_state;
+    const auto max_client_message_delay = std::chrono::milliseconds(10);
+    auto client_messages_due_at = Clock::now() + max_client_message_delay;
     for (;;) {
-      // wait for next input event
-      auto now = Clock::now();
-      auto timeout = std::optional<Duration>();
-      const auto set_timeout = [&](const Duration& duration) {
-        if (!timeout || duration < timeout)
-          timeout = duration;
+      // wait for next input event or until deadline is reached
+      auto timeout_at = std::optional<Clock::time_point>();
+      const auto set_timeout_at = [&](const Clock::time_point& time) {
+        if (!timeout_at || time < timeout_at)
+          timeout_at = time;
       };
       
       if (s.flush_scheduled_at())
-        set_timeout(s.flush_scheduled_at().value() - now);
+        set_timeout_at(s.flush_scheduled_at().value());
       if (s.timeout_start_at())
-        set_timeout(s.timeout_start_at().value() + s.timeout() - now);
+        set_timeout_at(s.timeout_start_at().value() +
+          std::chrono::ceil<Clock::duration>(s.timeout()));
 
       if (g_shutdown.load()) {
         verbose("Received shutdown signal");
@@ -108,18 +156,21 @@ namespace {
 
       // interrupt waiting when client sends an update
       const auto [succeeded, input] =
-        g_grabbed_devices.read_input_event(timeout, g_interrupt_fd);
+        g_grabbed_devices.read_input_event(timeout_at, g_interrupt_fd);
       if (!succeeded) {
         error("Reading input event failed");
         return true;
       }
 
-      now = Clock::now();
+      const auto now = Clock::now();
 
       if (input) {
         if (auto event = to_key_event(input.value())) {
-          if (event->key != Key::none)
+          if (event->key != Key::none) {
             s.translate_input(event.value(), input->device_index);
+            if (g_latency_trace)
+              g_latency_trace->on_input_translated(input->time, now, Clock::now());
+          }
         }
         else {
           // forward other events
@@ -136,12 +187,14 @@ namespace {
         s.translate_input(timeout, Stage::any_device_index);
       }
 
-      if (!s.flush_scheduled_at() || now > s.flush_scheduled_at()) {
+      if (!s.flush_scheduled_at() || now >= s.flush_scheduled_at()) {
         if (!s.flush_send_buffer()) {
           error("Sending input failed");
           return true;
         }
       }
+      if (g_latency_trace && !s.flush_scheduled_at())
+        g_latency_trace->on_no_output_pending();
 
       if (g_grabbed_devices.update_devices()) {
         if (!g_virtual_devices.update_forward_devices(
@@ -152,14 +205,18 @@ namespace {
         s.set_device_descs(g_grabbed_devices.grabbed_device_descs());
       }
 
-      // let client update configuration and context
-      if (g_interrupt_fd >= 0)
+      // apply messages the control thread received from client,
+      // when it interrupted reading, but not later than a bound
+      // during sustained input
+      if (g_interrupt_fd >= 0 && (!input || now >= client_messages_due_at)) {
+        client_messages_due_at = now + max_client_message_delay;
         if (!s.read_client_messages(Duration::zero()) ||
             std::exchange(g_grab_device_filters_changed, false) ||
             !s.has_configuration()) {
           verbose("Connection to keymapper reset");
           return true;
         }
+      }
 
       if (s.should_exit())
         return false;
@@ -168,7 +225,7 @@ namespace {
 
   void handle_shutdown_signal(int) {
     g_shutdown.store(true);
-    g_state.disconnect();
+    g_client_port->interrupt();
   }
  
   int connection_loop() {
@@ -183,7 +240,8 @@ namespace {
       if (!client_socket)
         continue;
 
-      g_interrupt_fd = *client_socket;
+      // client messages are received by the control thread
+      g_interrupt_fd = g_client_port->interrupt_fd();
 
       if (read_initial_config()) {
         if (!g_virtual_devices.create_keyboard_device()) {
@@ -207,8 +265,10 @@ namespace {
         const auto prev_sigterm_handler = ::signal(SIGTERM, handle_shutdown_signal);
 
         verbose("Entering update loop");
+        set_realtime_priority(true);
         if (!main_loop())
           g_shutdown.store(true);
+        set_realtime_priority(false);
         g_state.reset_configuration();
 
         ::signal(SIGINT, prev_sigint_handler);
@@ -239,6 +299,16 @@ int main(int argc, char* argv[]) {
     return (g_grabbed_devices.grab(false, { }) ? 0 : 1);
 #endif
 
+  if (settings.trace_latency)
+    g_latency_trace = std::make_unique<LatencyTrace>();
+  g_client_port->set_latency_report_handler([](bool chrome_trace) {
+    if (!g_latency_trace)
+      return std::string("Latency tracing is not enabled, "
+        "start keymapperd with --trace-latency\n");
+    return (chrome_trace ? g_latency_trace->get_chrome_trace() :
+      g_latency_trace->get_histograms());
+  });
+
   if (!g_state.listen_for_client_connections())
     return 1;
 
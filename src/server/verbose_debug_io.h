@@ -9,6 +9,8 @@
 
 void verbose_debug_io(const KeyEvent& input,
     const KeySequence& output, bool translated) {
+  if (!g_verbose_output)
+    return;
 
   const auto format = [](const KeyEvent& e) {
     if (e.key == Key::timeout)
@@ -0,0 +1,659 @@
+#include "config/ParseConfig.h"
+#include "config/get_key_name.h"
+#include "runtime/KeySearch.h"
+#include "runtime/MultiStage.h"
+#include "runtime/Timeout.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if !defined(_WIN32)
+# include "client/ControlPort.h"
+# include <poll.h>
+#endif
+
+#if defined(__linux__)
+# include "server/unix/DeadlineTimer.h"
+#endif
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  std::atomic<size_t> g_allocation_count;
+
+  struct Settings {
+    int event_count = 100000;
+    unsigned int seed = 0;
+    bool match_automaton = false;
+    bool key_search = false;
+    bool parse_includes = false;
+    bool parse_macros = false;
+    bool control_latency = false;
+    bool timer_latency = false;
+    std::string config_filename;
+    std::string stream_filename;
+  };
+
+  struct Variant {
+    const char* name;
+    int mapping_count;
+    bool multi_stage;
+    bool timeouts;
+    bool any_key;
+    bool no_might_match;
+  };
+
+  const auto variants = std::vector<Variant>{
+    { "small",               20, false, false, false, false },
+    { "500",                500, false, false, false, false },
+    { "500 multi-stage",    500, true,  false, false, false },
+    { "500 all features",   500, true,  true,  true,  true  },
+    { "5000",              5000, false, false, false, false },
+    { "5000 multi-stage",  5000, true,  false, false, false },
+    { "5000 all features", 5000, true,  true,  true,  true  },
+  };
+
+  const auto key_names = std::vector<const char*>{
+    "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M",
+    "N", "O", "P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z",
+    "1", "2", "3", "4", "5", "6", "7", "8", "9", "0",
+    "ShiftLeft", "ControlLeft", "AltLeft", "Space",
+  };
+
+  std::string generate_config(const Variant& variant, unsigned int seed) {
+    auto rand = std::mt19937(seed);
+    const auto key = [&]() { return key_names[rand() % 36]; };
+    const auto modifier = [&]() { return key_names[36 + rand() % 3]; };
+
+    auto pattern_count = 3u;
+    if (variant.timeouts)
+      pattern_count += 2;
+    if (variant.any_key)
+      ++pattern_count;
+    if (variant.no_might_match)
+      ++pattern_count;
+
+    auto os = std::ostringstream();
+    for (auto i = 0; i < variant.mapping_count; ++i) {
+      // begin a new context every 100 mappings
+      if (i % 100 == 0)
+        os << "[" << (variant.multi_stage &&
+          i == variant.mapping_count / 200 * 100 ? "stage" : "default") << "]\n";
+
+      switch (rand() % pattern_count) {
+        case 0: os << key() << " " << key(); break;
+        case 1: os << modifier() << "{" << key() << "}"; break;
+        case 2: os << "(" << key() << " " << key() << ")"; break;
+        case 3: os << key() << "{" << (100 + rand() % 400) << "ms}"; break;
+        case 4: os << key() << " !" << (100 + rand() % 400) << "ms " << key(); break;
+        case 5: os << (variant.any_key ? "Any" : key()) << "{" << key() << "}"; break;
+        case 6: os << "? " << key() << " " << key() << " " << key(); break;
+      }
+      os << " >> " << key() << " " << key() << "\n";
+    }
+    return os.str();
+  }
+
+  MultiStagePtr create_multi_stage(const std::string& string) {
+    auto parse_config = ParseConfig();
+    auto stream = std::istringstream(string);
+    auto config = parse_config(stream);
+
+    auto stages = std::vector<StagePtr>();
+    auto contexts = std::vector<Stage::Context>();
+    for (auto& config_context : config.contexts) {
+      if (!contexts.empty() && config_context.begin_stage) {
+        stages.push_back(std::make_unique<Stage>(std::move(contexts)));
+        contexts.clear();
+      }
+
+      auto& context = contexts.emplace_back();
+      for (auto& input : config_context.inputs)
+        context.inputs.push_back({ std::move(input.input), input.output_index });
+      context.outputs = std::move(config_context.outputs);
+      for (auto& output : config_context.command_outputs)
+        context.command_outputs.push_back({ std::move(output.output), output.index });
+      context.modifier_filter = std::move(config_context.modifier_filter);
+      context.fallthrough = config_context.fallthrough;
+    }
+    if (!contexts.empty())
+      stages.push_back(std::make_unique<Stage>(std::move(contexts)));
+
+    auto stage = std::make_unique<MultiStage>(std::move(stages));
+    auto active_contexts = std::vector<int>();
+    for (auto i = 0; i < static_cast<int>(stage->context_count()); ++i)
+      active_contexts.push_back(i);
+    stage->set_active_client_contexts(active_contexts);
+    return stage;
+  }
+
+  // random presses and releases of at most a few keys at once,
+  // some of the requested timeouts are replied as exceeded
+  KeySequence generate_stream(int event_count, unsigned int seed) {
+    auto rand = std::mt19937(seed);
+    auto keys = std::vector<Key>();
+    for (auto name : key_names)
+      keys.push_back(get_key_by_name(name));
+
+    auto stream = KeySequence();
+    auto pressed = std::set<Key>();
+    while (static_cast<int>(stream.size()) < event_count) {
+      if (rand() % 8 == 0) {
+        stream.push_back(make_input_timeout_event(
+          std::chrono::milliseconds(rand() % 600)));
+        continue;
+      }
+      const auto key = keys[rand() % keys.size()];
+      if (pressed.count(key) || pressed.size() >= 4) {
+        const auto release = (pressed.count(key) ? key : *pressed.begin());
+        pressed.erase(release);
+        stream.emplace_back(release, KeyState::Up);
+      }
+      else {
+        pressed.insert(key);
+        stream.emplace_back(key, KeyState::Down);
+      }
+    }
+    for (auto key : pressed)
+      stream.emplace_back(key, KeyState::Up);
+    return stream;
+  }
+
+  // whitespace separated +Key, -Key and timeout replies like 200ms
+  bool read_stream(const std::string& filename, KeySequence* stream) {
+    auto is = std::ifstream(filename);
+    if (!is.good())
+      return false;
+    auto token = std::string();
+    while (is >> token) {
+      if (token.size() > 2 && token.substr(token.size() - 2) == "ms") {
+        stream->push_back(make_input_timeout_event(
+          std::chrono::milliseconds(std::atoi(token.c_str()))));
+        continue;
+      }
+      const auto key = get_key_by_name(std::string_view(token).substr(1));
+      if ((token[0] != '+' && token[0] != '-') || key == Key::none) {
+        std::fprintf(stderr, "invalid event '%s' in stream\n", token.c_str());
+        return false;
+      }
+      stream->emplace_back(key, token[0] == '+' ?
+        KeyState::Down : KeyState::Up);
+    }
+    return true;
+  }
+
+  void run_benchmark(const char* name, const std::string& config_string,
+      const KeySequence& stream, const Settings& settings) {
+    auto stage = MultiStagePtr();
+    try {
+      stage = create_multi_stage(config_string);
+    }
+    catch (const std::exception& ex) {
+      std::fprintf(stderr, "%s: %s\n", name, ex.what());
+      return;
+    }
+    stage->set_match_automaton_enabled(settings.match_automaton);
+
+    const auto device_index = 0;
+    auto latencies = std::vector<Clock::duration>();
+    latencies.reserve(stream.size());
+    auto buffer = KeySequence();
+    const auto allocations_begin = g_allocation_count.load();
+    const auto begin = Clock::now();
+    for (const auto& event : stream) {
+      const auto event_begin = Clock::now();
+      buffer = stage->update(event, device_index);
+      stage->reuse_buffer(std::move(buffer));
+      latencies.push_back(Clock::now() - event_begin);
+    }
+    const auto total = Clock::now() - begin;
+    const auto allocations = g_allocation_count.load() - allocations_begin;
+
+    std::sort(latencies.begin(), latencies.end());
+    const auto percentile = [&](double p) {
+      const auto index = static_cast<size_t>(p * (latencies.size() - 1));
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        latencies[index]).count();
+    };
+    const auto seconds = std::chrono::duration<double>(total).count();
+    std::printf("%-20s %9zu %9lld %9lld %9lld %12.2f %12.0f\n",
+      name, stream.size(),
+      static_cast<long long>(percentile(0.5)),
+      static_cast<long long>(percentile(0.99)),
+      static_cast<long long>(percentile(0.999)),
+      static_cast<double>(allocations) / stream.size(),
+      stream.size() / seconds);
+  }
+
+  // compares the vectorized searches with the scalar versions,
+  // the searched keys are present in about half of the sequences
+  void run_key_search_benchmark(unsigned int seed) {
+    // allow searches to be inlined like at their call sites
+#define SEARCH(function) [](const auto* begin, const auto* end, const auto& value) { \
+      return key_search::function(begin, end, value); }
+    const auto iterations = 200000;
+    auto rand = std::mt19937(seed);
+    auto result = size_t{ };
+
+    const auto measure = [&](auto&& search) {
+      const auto begin = Clock::now();
+      for (auto i = 0; i < iterations; ++i)
+        result += search(i);
+      return std::chrono::duration<double, std::nano>(
+        Clock::now() - begin).count() / iterations;
+    };
+
+    std::printf("%-8s %10s %10s %10s %10s %10s %10s %10s %10s\n", "length",
+      "find", "simd", "rfind", "simd", "event", "simd", "keys", "simd");
+    for (auto length : { 4, 8, 16, 32, 64 }) {
+      auto sequences = std::vector<KeySequence>(64);
+      auto keys = std::vector<std::vector<Key>>(sequences.size());
+      for (auto i = 0u; i < sequences.size(); ++i)
+        for (auto j = 0; j < length; ++j) {
+          const auto key = static_cast<Key>(1 + rand() % (2 * length));
+          sequences[i].emplace_back(key, KeyState::Down);
+          keys[i].push_back(key);
+        }
+      const auto search_key = [&](int i) {
+        return static_cast<Key>(1 + (i * 7) % length);
+      };
+      const auto run = [&](auto find) {
+        return measure([&](int i) {
+          const auto& sequence = sequences[i % sequences.size()];
+          return static_cast<size_t>(find(sequence.data(),
+            sequence.data() + sequence.size(), search_key(i)) - sequence.data());
+        });
+      };
+      const auto run_event = [&](auto find) {
+        return measure([&](int i) {
+          const auto& sequence = sequences[i % sequences.size()];
+          return static_cast<size_t>(find(sequence.data(),
+            sequence.data() + sequence.size(),
+            KeyEvent(search_key(i), KeyState::Down)) - sequence.data());
+        });
+      };
+      const auto run_keys = [&](auto contains) {
+        return measure([&](int i) {
+          const auto& k = keys[i % keys.size()];
+          return static_cast<size_t>(contains(k.data(),
+            k.data() + k.size(), search_key(i)));
+        });
+      };
+      std::printf("%-8d %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+        length,
+        run(SEARCH(find_key_scalar)), run(SEARCH(find_key)),
+        run(SEARCH(rfind_key_scalar)), run(SEARCH(rfind_key)),
+        run_event(SEARCH(find_event_scalar)), run_event(SEARCH(find_event)),
+        run_keys(SEARCH(contains_key_scalar)), run_keys(SEARCH(contains_key)));
+    }
+    // prevent searches from being optimized out
+    if (result == 1)
+      std::printf("\n");
+#undef SEARCH
+  }
+
+  // prints median and minimum duration of parsing a configuration
+  void measure_parsing(const std::string& description, int iterations,
+      const std::function<std::istream&()>& open,
+      const std::filesystem::path& base_path = { }) {
+    auto parse = ParseConfig();
+    auto durations = std::vector<Clock::duration>();
+    for (auto i = 0; i < iterations; ++i) {
+      auto& is = open();
+      const auto begin = Clock::now();
+      try {
+        parse(is, base_path);
+      }
+      catch (const std::exception& ex) {
+        std::fprintf(stderr, "parsing failed: %s\n", ex.what());
+        return;
+      }
+      durations.push_back(Clock::now() - begin);
+    }
+    std::sort(durations.begin(), durations.end());
+    std::printf("%s, median %.2fms, min %.2fms\n", description.c_str(),
+      std::chrono::duration<double, std::milli>(
+        durations[durations.size() / 2]).count(),
+      std::chrono::duration<double, std::milli>(durations.front()).count());
+  }
+
+  // parses a configuration, which includes a file per application
+  void run_parse_includes_benchmark(unsigned int seed) {
+    const auto file_count = 50;
+    const auto mapping_count = 200;
+    const auto path = std::filesystem::temp_directory_path() /
+      "keymapper-bench-includes";
+    std::filesystem::create_directories(path);
+    auto main_file = std::ofstream(path / "keymapper.conf");
+    main_file << "Ext = IntlBackslash\n";
+    for (auto i = 0; i < file_count; ++i) {
+      const auto filename = "app" + std::to_string(i) + ".conf";
+      main_file << "@include \"" << filename << "\"\n";
+      auto file = std::ofstream(path / filename);
+      file << "[title=\"Application " << i << "\"]\n";
+      const auto variant = Variant{ "", mapping_count, false, true, false, false };
+      file << generate_config(variant, seed + static_cast<unsigned int>(i));
+    }
+    main_file.close();
+
+    auto is = std::ifstream();
+    measure_parsing(std::to_string(file_count) + " files with " +
+      std::to_string(mapping_count) + " mappings", 20,
+      [&]() -> std::istream& {
+        is = std::ifstream(path / "keymapper.conf");
+        return is;
+      }, path);
+    std::filesystem::remove_all(path);
+  }
+
+  // parses a configuration, which applies the same macros in each context
+  void run_parse_macros_benchmark() {
+    const auto context_count = 100;
+    auto config = std::string(
+      "Ext = IntlBackslash\n"
+      "twice = $0 $0\n"
+      "shifted = Shift{$0}\n"
+      "typed = repeat[shifted[$0], add[length[\"$0\"], 2]]\n");
+    const auto letters = std::string("A, B, C, D, E, F, G, H, I, J, K, L, M, "
+      "N, O, P, Q, R, S, T, U, V, W, X, Y, Z");
+    for (auto i = 0; i < context_count; ++i) {
+      config += "[title=\"Application " + std::to_string(i) + "\"]\n";
+      config += "apply[Ext{$0} >> twice[$0] typed[$0], " + letters + "]\n";
+      config += "apply[Ext{Shift{$0}} >> shifted[$0], " + letters + "]\n";
+    }
+    auto is = std::istringstream();
+    measure_parsing(std::to_string(context_count) +
+      " contexts applying macros", 20,
+      [&]() -> std::istream& {
+        is = std::istringstream(config);
+        return is;
+      });
+  }
+
+#if !defined(_WIN32)
+  struct ControlHandler : ControlPort::MessageHandler {
+    void on_set_virtual_key_state_message(Key, KeyState) override { }
+    bool on_set_config_file_message(std::string) override { return true; }
+    void on_next_key_info_requested_message() override { }
+    void on_latency_report_requested_message(bool) override { }
+    bool on_inject_input_message(const std::string&) override { return true; }
+    bool on_inject_output_message(const std::string&) override { return true; }
+  };
+
+  // round trips of requests like "keymapperctl --is-pressed", which each
+  // connect, while other controls wait for notifications
+  void run_control_latency_benchmark() {
+    const auto ipc_id = std::string("keymapper-bench-control");
+    const auto request_count = 2000;
+    const auto idle_connection_count = 50;
+    const auto timeout = std::chrono::seconds(1);
+
+    std::printf("%-22s %9s %9s %9s\n", "dispatch", "requests",
+      "p50 us", "p99 us");
+    for (auto by_readiness : { false, true }) {
+      auto control = ControlPort(ipc_id);
+      if (!control.listen()) {
+        std::fprintf(stderr, "listening for control connections failed\n");
+        return;
+      }
+      auto stop = std::atomic<bool>();
+      auto thread = std::thread([&]() {
+        // like main loop of client
+        auto handler = ControlHandler();
+        auto sockets = std::vector<Socket>();
+        auto readable_sockets = std::vector<Socket>();
+        auto fds = std::vector<pollfd>();
+        while (!stop.load()) {
+          sockets.clear();
+          control.get_sockets(&sockets);
+          fds.clear();
+          for (auto socket : sockets)
+            fds.push_back({ static_cast<int>(socket), POLLIN, 0 });
+          ::poll(fds.data(), fds.size(), 10);
+          if (by_readiness) {
+            readable_sockets.clear();
+            for (const auto& fd : fds)
+              if (fd.revents)
+                readable_sockets.push_back(static_cast<Socket>(fd.fd));
+            control.read_messages(handler, readable_sockets);
+          }
+          else {
+            control.accept();
+            control.read_messages(handler);
+          }
+        }
+      });
+
+      auto host = Host(ipc_id);
+      auto idle_connections = std::vector<Connection>();
+      for (auto i = 0; i < idle_connection_count; ++i)
+        idle_connections.push_back(host.connect(timeout));
+
+      auto durations = std::vector<Clock::duration>();
+      for (auto i = 0; i < request_count; ++i) {
+        const auto begin = Clock::now();
+        auto connection = host.connect(timeout);
+        if (!connection.send_message([](Serializer& s) {
+              s.write(MessageType::get_virtual_key_state);
+              s.write(std::string_view("Virtual1"));
+            }))
+          break;
+        auto received = false;
+        while (!received && connection.read_messages(timeout,
+            [&](Deserializer&) { received = true; })) { }
+        if (!received)
+          break;
+        durations.push_back(Clock::now() - begin);
+      }
+      stop.store(true);
+      thread.join();
+      if (durations.empty()) {
+        std::fprintf(stderr, "sending control requests failed\n");
+        return;
+      }
+
+      std::sort(durations.begin(), durations.end());
+      const auto to_us = [](Clock::duration duration) {
+        return std::chrono::duration<double, std::micro>(duration).count();
+      };
+      std::printf("%-22s %9zu %9.1f %9.1f\n",
+        (by_readiness ? "readable sockets" : "all sockets"),
+        durations.size(), to_us(durations[durations.size() / 2]),
+        to_us(durations[durations.size() * 99 / 100]));
+    }
+  }
+#endif // !defined(_WIN32)
+
+#if defined(__linux__)
+  // lateness of the timer which schedules timeouts of server
+  void run_timer_latency_benchmark() {
+    const auto round_count = 200;
+
+    std::printf("%-22s %9s %9s %9s\n", "timeout", "rounds",
+      "p50 us", "p99 us");
+    auto timer = DeadlineTimer();
+    if (timer.fd() < 0) {
+      std::fprintf(stderr, "creating timer failed\n");
+      return;
+    }
+    for (auto timeout_ms : { 1, 2, 5, 10 }) {
+      auto lateness = std::vector<Clock::duration>();
+      for (auto i = 0; i < round_count; ++i) {
+        const auto deadline = Clock::now() +
+          std::chrono::milliseconds(timeout_ms);
+        auto fd = pollfd{ timer.fd(), POLLIN, 0 };
+        if (!timer.set(deadline) ||
+            ::poll(&fd, 1, 1000) != 1 ||
+            !timer.acknowledge())
+          break;
+        lateness.push_back(Clock::now() - deadline);
+      }
+      if (lateness.empty()) {
+        std::fprintf(stderr, "waiting for timer failed\n");
+        return;
+      }
+
+      std::sort(lateness.begin(), lateness.end());
+      const auto to_us = [](Clock::duration duration) {
+        return std::chrono::duration<double, std::micro>(duration).count();
+      };
+      std::printf("%-22s %9zu %9.1f %9.1f\n",
+        (std::to_string(timeout_ms) + "ms").c_str(),
+        lateness.size(), to_us(lateness[lateness.size() / 2]),
+        to_us(lateness[lateness.size() * 99 / 100]));
+    }
+  }
+#endif // defined(__linux__)
+
+  bool interpret_commandline(Settings& settings, int argc, char* argv[]) {
+    for (auto i = 1; i < argc; i++) {
+      const auto argument = std::string_view(argv[i]);
+      if (argument == "--automaton") {
+        settings.match_automaton = true;
+      }
+      else if (argument == "--key-search") {
+        settings.key_search = true;
+      }
+      else if (argument == "--parse-includes") {
+        settings.parse_includes = true;
+      }
+      else if (argument == "--parse-macros") {
+        settings.parse_macros = true;
+      }
+#if !defined(_WIN32)
+      else if (argument == "--control-latency") {
+        settings.control_latency = true;
+      }
+#endif
+#if defined(__linux__)
+      else if (argument == "--timer-latency") {
+        settings.timer_latency = true;
+      }
+#endif
+      else if (argument == "--events" && i + 1 < argc) {
+        settings.event_count = std::atoi(argv[++i]);
+      }
+      else if (argument == "--seed" && i + 1 < argc) {
+        settings.seed = static_cast<unsigned int>(std::atoi(argv[++i]));
+      }
+      else if (argument == "--config" && i + 1 < argc) {
+        settings.config_filename = argv[++i];
+      }
+      else if (argument == "--stream" && i + 1 < argc) {
+        settings.stream_filename = argv[++i];
+      }
+      else {
+        return false;
+      }
+    }
+    return (settings.event_count > 0);
+  }
+} // namespace
+
+void* operator new(size_t size) {
+  ++g_allocation_count;
+  if (auto p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+void message(const char* title, const char* format, ...) { }
+void notify(const char* format, ...) { }
+void error(const char* format, ...) { }
+void verbose(const char* format, ...) { }
+
+int main(int argc, char* argv[]) {
+  auto settings = Settings{ };
+  if (!interpret_commandline(settings, argc, argv)) {
+    std::printf(
+      "Usage: keymapper-bench [-options]\n"
+      "  --events <count>     number of random events (default 100000).\n"
+      "  --seed <value>       seed for generating configs and events.\n"
+      "  --config <path>      benchmark configuration file.\n"
+      "  --stream <path>      replay recorded events (e.g. +A -A 200ms).\n"
+      "  --automaton          use match automaton.\n"
+      "  --key-search         compare vectorized and scalar key searches.\n"
+      "  --parse-includes     parse configuration with 50 include files.\n"
+      "  --parse-macros       parse configuration applying macros.\n"
+      "  --control-latency    measure round trips of keymapperctl requests.\n"
+      "  --timer-latency      measure lateness of server timeout timer.\n");
+    return 1;
+  }
+
+  if (settings.key_search) {
+    run_key_search_benchmark(settings.seed);
+    return 0;
+  }
+  if (settings.parse_includes) {
+    run_parse_includes_benchmark(settings.seed);
+    return 0;
+  }
+  if (settings.parse_macros) {
+    run_parse_macros_benchmark();
+    return 0;
+  }
+#if !defined(_WIN32)
+  if (settings.control_latency) {
+    run_control_latency_benchmark();
+    return 0;
+  }
+#endif
+#if defined(__linux__)
+  if (settings.timer_latency) {
+    run_timer_latency_benchmark();
+    return 0;
+  }
+#endif
+
+  auto stream = KeySequence();
+  if (!settings.stream_filename.empty()) {
+    if (!read_stream(settings.stream_filename, &stream)) {
+      std::fprintf(stderr, "reading stream '%s' failed\n",
+        settings.stream_filename.c_str());
+      return 1;
+    }
+  }
+  else {
+    stream = generate_stream(settings.event_count, settings.seed);
+  }
+
+  std::printf("%-20s %9s %9s %9s %9s %12s %12s\n", "config", "events",
+    "p50 ns", "p99 ns", "p999 ns", "allocs/event", "events/s");
+
+  if (!settings.config_filename.empty()) {
+    auto is = std::ifstream(settings.config_filename);
+    auto ss = std::ostringstream();
+    ss << is.rdbuf();
+    if (!is.good()) {
+      std::fprintf(stderr, "reading config '%s' failed\n",
+        settings.config_filename.c_str());
+      return 1;
+    }
+    run_benchmark("config file", ss.str(), stream, settings);
+    return 0;
+  }
+
+  for (const auto& variant : variants)
+    run_benchmark(variant.name, generate_config(variant, settings.seed),
+      stream, settings);
+  return 0;
+}
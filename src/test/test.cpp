@@ -1,5 +1,5 @@
 
-#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_RUNNER
 #include "catch.hpp"
 
 #include "test.h"
@@ -7,6 +7,9 @@
 #include "config/ParseConfig.h"
 #include "runtime/Key.h"
 #include "runtime/Timeout.h"
+#include <cstring>
+
+bool g_match_automaton_enabled;
 
 namespace {
   struct Stream : std::stringstream {
@@ -22,6 +25,10 @@ namespace {
   };
 } // namespace
 
+bool g_verbose_output;
+const char* about_header = "";
+const char* about_footer = "";
+
 void message(const char* title, const char* format, ...) { }
 void notify(const char* format, ...) { }
 void error(const char* format, ...) { }
@@ -136,10 +143,11 @@ Stage create_stage(const char* string, bool activate_all_contexts) {
     context.fallthrough = config_context.fallthrough;
   }
   auto stage = Stage(std::move(contexts));
+  stage.set_match_automaton_enabled(g_match_automaton_enabled);
 
   if (activate_all_contexts) {
     auto active_contexts = std::vector<int>();
-    for (auto i = 0; i < static_cast<int>(stage.contexts().size()); ++i)
+    for (auto i = 0; i < static_cast<int>(stage.context_count()); ++i)
       active_contexts.push_back(i);
     stage.set_active_client_contexts(active_contexts);
   }
@@ -173,7 +181,9 @@ MultiStagePtr create_multi_stage(const char* string) {
   if (!contexts.empty())
     stages.push_back(std::make_unique<Stage>(std::move(contexts)));
 
-  return std::make_unique<MultiStage>(std::move(stages));
+  auto multi_stage = std::make_unique<MultiStage>(std::move(stages));
+  multi_stage->set_match_automaton_enabled(g_match_automaton_enabled);
+  return multi_stage;
 }
 
 KeyEvent reply_timeout_ms(int timeout_ms) {
@@ -197,3 +207,39 @@ KeyEvent make_output_timeout_ms(int timeout_ms) {
   return KeyEvent(Key::timeout, KeyState::Down,
     duration_to_timeout(std::chrono::milliseconds(timeout_ms)));
 }
+
+int main(int argc, char* argv[]) {
+  auto session = Catch::Session();
+  if (const auto result = session.applyCommandLine(argc, argv))
+    return result;
+  if (const auto result = session.run())
+    return result;
+
+  auto config = session.configData();
+  if (config.showHelp || config.listTests || config.listTestNamesOnly ||
+      config.listTags || config.listReporters)
+    return 0;
+
+  // run the selected stage tests again, matching with the automaton
+  auto stage_tests = std::string();
+  const auto& selected = session.config();
+  for (const auto& test : Catch::filterTests(
+        Catch::getAllTestCasesSorted(selected), selected.testSpec(), selected)) {
+    const auto& tags = test.getTestCaseInfo().tags;
+    if (std::find(tags.begin(), tags.end(), "Stage") == tags.end())
+      continue;
+    if (!stage_tests.empty())
+      stage_tests.push_back(',');
+    for (auto c : test.getTestCaseInfo().name) {
+      if (std::strchr("\\,[]\"*~", c))
+        stage_tests.push_back('\\');
+      stage_tests.push_back(c);
+    }
+  }
+  if (stage_tests.empty())
+    return 0;
+  config.testsOrTags = { (config.testsOrTags.empty() ? "[Stage]" : stage_tests) };
+  session.useConfigData(config);
+  g_match_automaton_enabled = true;
+  return session.run();
+}
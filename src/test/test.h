@@ -19,6 +19,9 @@ std::ostream& operator<<(std::ostream& os, const KeyEvent& event);
 std::string format_sequence(const KeySequence& sequence);
 std::string format_list(const std::vector<Key>& keys);
 
+// stages are created with match automaton, when the tests are run again
+extern bool g_match_automaton_enabled;
+
 Stage create_stage(const char* config, bool activate_all_contexts = true);
 MultiStagePtr create_multi_stage(const char* config);
 
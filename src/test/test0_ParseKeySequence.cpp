@@ -1,5 +1,6 @@
 
 #include "test.h"
+#include "config/get_key_name.h"
 
 TEST_CASE("Input Expression", "[ParseKeySequence]") {
   // Empty
@@ -651,6 +652,20 @@ TEST_CASE("Key names", "[ParseKeySequence]") {
   CHECK_THROWS(parse_output("Virtual256"));
   CHECK_THROWS(parse_output("Key1"));
   CHECK_THROWS(parse_output("DigitA"));
+
+  for (auto key_code = 1; key_code <= 0xFFFF; ++key_code) {
+    const auto key = static_cast<Key>(key_code);
+    if (auto name = get_key_name(key))
+      CHECK(get_key_by_name(name) == key);
+  }
+  CHECK(get_key_by_name("Shift") == Key::Shift);
+  CHECK(get_key_by_name("Meta") == Key::Meta);
+  CHECK(get_key_name(Key::Shift) == nullptr);
+  CHECK(get_key_name(Key::none) == nullptr);
+  CHECK(get_key_by_name("") == Key::none);
+  CHECK(get_key_by_name("Escap") == Key::none);
+  CHECK(get_key_by_name("Escapee") == Key::none);
+  CHECK(get_key_by_name("escape") == Key::none);
 }
 
 //--------------------------------------------------------------------
@@ -0,0 +1,187 @@
+
+#include "test.h"
+#include "server/ClientPort.h"
+#include "server/unix/ThreadedClientPort.h"
+#include "runtime/StageImage.h"
+#include <cstdio>
+#include <future>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+  const auto ipc_id = "keymapper-test-" + std::to_string(::getpid());
+
+  class Handler : public IClientPort::MessageHandler {
+  public:
+    std::vector<bool> configurations;
+
+    void on_configuration_message(MultiStagePtr stage) override {
+      configurations.push_back(stage != nullptr);
+    }
+    void on_configuration_update_message(
+      std::vector<std::pair<int, Stage::Context>>) override { }
+    void on_grab_device_filters_message(std::vector<GrabDeviceFilter>) override { }
+    void on_directives_message(const std::vector<std::string>&) override { }
+    void on_active_contexts_message(const std::vector<int>&) override { }
+    void on_set_virtual_key_state_message(Key, KeyState) override { }
+    void on_validate_state_message() override { }
+    void on_request_next_key_info_message() override { }
+    void on_inject_input_message(const KeySequence&) override { }
+    void on_inject_output_message(const KeySequence&) override { }
+    void on_request_latency_report_message(bool) override { }
+  };
+
+  // stage count, image size, image
+  std::vector<char> get_config_image(const Stage& stage) {
+    auto contexts = std::vector<Stage::Context>();
+    for (auto i = 0u; i < stage.context_count(); ++i)
+      contexts.push_back(stage.get_context(static_cast<int>(i)));
+    const auto writer = StageImageWriter(contexts.begin(), contexts.end());
+    auto data = std::vector<char>(2 * sizeof(uint32_t) + writer.size());
+    const uint32_t sizes[] = { 1, static_cast<uint32_t>(writer.size()) };
+    std::memcpy(data.data(), sizes, sizeof(sizes));
+    writer.write(data.data() + sizeof(sizes));
+    return data;
+  }
+
+  int write_memfd(const std::vector<char>& data, bool seal) {
+    const auto fd = ::memfd_create("keymapper-test",
+      MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0 || ::write(fd, data.data(), data.size()) !=
+          static_cast<ssize_t>(data.size()))
+      return -1;
+    if (seal && ::fcntl(fd, F_ADD_SEALS,
+          F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE) != 0)
+      return -1;
+    return fd;
+  }
+
+  int write_regular_file(const std::vector<char>& data) {
+    const auto file = std::tmpfile();
+    if (!file || std::fwrite(data.data(), 1, data.size(), file) != data.size())
+      return -1;
+    std::fflush(file);
+    // file is deleted when all descriptors are closed
+    const auto fd = ::dup(::fileno(file));
+    std::fclose(file);
+    return fd;
+  }
+
+  bool send_config_image(Connection& connection, uint32_t context_count,
+      int fd) {
+    const auto succeeded = connection.send_message([&](Serializer& s) {
+      s.write(MessageType::configuration_image);
+      // grab device filters
+      s.write(uint32_t{ });
+      // device and device id filter of each context
+      s.write(context_count);
+      for (auto i = 0u; i < 2 * context_count; ++i) {
+        s.write(std::string());
+        s.write(false);
+      }
+      // directives
+      s.write(uint32_t{ });
+    }, fd);
+    if (fd >= 0)
+      ::close(fd);
+    return succeeded;
+  }
+
+  bool read_configurations(ClientPort& port, Handler& handler, size_t count) {
+    while (handler.configurations.size() < count)
+      if (!port.read_messages(handler, std::chrono::seconds(1)))
+        return false;
+    return true;
+  }
+} // namespace
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Only accept sealed configuration images", "[ClientPort]") {
+  auto port = ClientPort(ipc_id);
+  REQUIRE(port.listen());
+  auto connecting = std::async(std::launch::async,
+    [&]() { return Host(ipc_id).connect(); });
+  REQUIRE(port.accept());
+  auto connection = connecting.get();
+  REQUIRE(connection);
+
+  const auto stage = create_stage(R"(
+    A >> B
+    [title="Test"]
+    C >> D
+  )");
+  const auto image = get_config_image(stage);
+  const auto context_count = static_cast<uint32_t>(stage.context_count());
+  auto handler = Handler();
+
+  // sealed memfd
+  REQUIRE(send_config_image(connection, context_count,
+    write_memfd(image, true)));
+  REQUIRE(read_configurations(port, handler, 1));
+  CHECK(handler.configurations.back());
+
+  // memfd which can still be written
+  REQUIRE(send_config_image(connection, context_count,
+    write_memfd(image, false)));
+  REQUIRE(read_configurations(port, handler, 2));
+  CHECK(!handler.configurations.back());
+
+  // regular file
+  REQUIRE(send_config_image(connection, context_count,
+    write_regular_file(image)));
+  REQUIRE(read_configurations(port, handler, 3));
+  CHECK(!handler.configurations.back());
+
+  // descriptor sent with another message is not taken by next image
+  const auto fd = write_memfd(image, true);
+  REQUIRE(connection.send_message([&](Serializer& s) {
+    s.write(MessageType::validate_state);
+  }, fd));
+  ::close(fd);
+  REQUIRE(send_config_image(connection, context_count, -1));
+  REQUIRE(read_configurations(port, handler, 4));
+  CHECK(!handler.configurations.back());
+
+  // sealed memfd is still accepted afterwards
+  REQUIRE(send_config_image(connection, context_count,
+    write_memfd(image, true)));
+  REQUIRE(read_configurations(port, handler, 5));
+  CHECK(handler.configurations.back());
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Do not lose messages when outgoing queue is full", "[ClientPort]") {
+  auto port = ThreadedClientPort(ipc_id);
+  REQUIRE(port.listen());
+  auto connecting = std::async(std::launch::async,
+    [&]() { return Host(ipc_id).connect(); });
+  REQUIRE(port.accept());
+  auto connection = connecting.get();
+  REQUIRE(connection);
+
+  // many more than fit in the queue, while client is not reading
+  const auto count = 5000;
+  for (auto i = 0; i < count; ++i)
+    port.send_virtual_key_state(static_cast<Key>(i),
+      (i % 2 ? KeyState::Down : KeyState::Up));
+
+  auto received = 0;
+  auto in_order = true;
+  const auto deadline = Clock::now() + std::chrono::seconds(5);
+  while (received < count && Clock::now() < deadline &&
+      connection.read_messages(std::chrono::milliseconds(100),
+      [&](Deserializer& d) {
+        const auto type = d.read<MessageType>();
+        const auto key = d.read<Key>();
+        const auto state = d.read<KeyState>();
+        in_order &= (type == MessageType::virtual_key_state &&
+          key == static_cast<Key>(received) &&
+          state == (received % 2 ? KeyState::Down : KeyState::Up));
+        ++received;
+      })) { }
+  CHECK(received == count);
+  CHECK(in_order);
+}
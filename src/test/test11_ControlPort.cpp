@@ -0,0 +1,258 @@
+
+#include "test.h"
+#include "client/ControlPort.h"
+#include "control/Settings.h"
+#include <future>
+#include <tuple>
+#include <unistd.h>
+
+namespace {
+  const auto ipc_id = "keymapperctl-test-" + std::to_string(::getpid());
+
+  class Handler : public ControlPort::MessageHandler {
+  public:
+    explicit Handler(ControlPort& port) : m_port(port) { }
+
+    // state is applied at once, like a server would
+    void on_set_virtual_key_state_message(Key key, KeyState state) override {
+      m_port.on_virtual_key_state_changed(key, state);
+    }
+    bool on_set_config_file_message(std::string) override { return false; }
+    void on_next_key_info_requested_message() override { }
+    void on_latency_report_requested_message(bool) override { }
+    bool on_inject_input_message(const std::string&) override { return false; }
+    bool on_inject_output_message(const std::string&) override { return false; }
+
+  private:
+    ControlPort& m_port;
+  };
+
+  Key virtual_key(int n) {
+    return static_cast<Key>(*Key::first_virtual + n);
+  }
+
+  struct Reply {
+    MessageType type;
+    Key key;
+    KeyState state;
+    uint64_t sequence;
+
+    bool operator==(const Reply& b) const {
+      return std::tie(type, key, state, sequence) ==
+        std::tie(b.type, b.key, b.state, b.sequence);
+    }
+  };
+
+  Reply change(Key key, KeyState state, uint64_t sequence) {
+    return { MessageType::virtual_key_state_change, key, state, sequence };
+  }
+
+  Reply state(Key key, KeyState state) {
+    return { MessageType::virtual_key_state, key, state, 0 };
+  }
+
+  Connection connect(ControlPort& port) {
+    auto connecting = std::async(std::launch::async,
+      [&]() { return Host(ipc_id).connect(); });
+    while (!port.accept() && connecting.wait_for(
+      std::chrono::milliseconds(1)) == std::future_status::timeout) { }
+    return connecting.get();
+  }
+
+  bool send_subscribe(Connection& connection,
+      const std::vector<std::string_view>& names,
+      std::optional<uint32_t> count = { }) {
+    return connection.send_message([&](Serializer& s) {
+      s.write(MessageType::subscribe_virtual_key_states);
+      s.write(count.value_or(static_cast<uint32_t>(names.size())));
+      for (auto name : names)
+        s.write(name);
+    });
+  }
+
+  bool send_set_virtual_key_state(Connection& connection,
+      std::string_view name, KeyState state) {
+    return connection.send_message([&](Serializer& s) {
+      s.write(MessageType::set_virtual_key_state);
+      s.write(name);
+      s.write(state);
+    });
+  }
+
+  bool send_get_virtual_key_state(Connection& connection,
+      std::string_view name) {
+    return connection.send_message([&](Serializer& s) {
+      s.write(MessageType::get_virtual_key_state);
+      s.write(name);
+    });
+  }
+
+  std::vector<Reply> read_replies(Connection& connection, size_t count) {
+    auto replies = std::vector<Reply>();
+    const auto deadline = Clock::now() + std::chrono::seconds(1);
+    while (replies.size() < count && Clock::now() < deadline &&
+      connection.read_messages(std::chrono::milliseconds(10),
+        [&](Deserializer& d) {
+          auto& reply = replies.emplace_back();
+          reply.type = d.read<MessageType>();
+          reply.key = d.read<Key>();
+          reply.state = d.read<KeyState>();
+          if (reply.type == MessageType::virtual_key_state_change)
+            reply.sequence = d.read<uint64_t>();
+        })) { }
+    return replies;
+  }
+
+  std::ostream& operator<<(std::ostream& os, const Reply& reply) {
+    return os << static_cast<int>(reply.type) << " " << *reply.key << " " <<
+      static_cast<int>(reply.state) << " " << reply.sequence;
+  }
+} // namespace
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Stream virtual key state changes", "[ControlPort]") {
+  auto port = ControlPort(ipc_id);
+  REQUIRE(port.listen());
+  auto handler = Handler(port);
+  auto some = connect(port);
+  auto all = connect(port);
+  REQUIRE(some);
+  REQUIRE(all);
+
+  // current states are sent on subscription
+  REQUIRE(send_subscribe(some, { "Virtual1", "Virtual255" }));
+  REQUIRE(send_subscribe(all, { }));
+  port.read_messages(handler);
+  CHECK(read_replies(some, 2) == std::vector<Reply>{
+    change(virtual_key(1), KeyState::Up, 0),
+    change(virtual_key(255), KeyState::Up, 0),
+  });
+
+  port.on_virtual_key_state_changed(virtual_key(1), KeyState::Down);
+  port.on_virtual_key_state_changed(virtual_key(2), KeyState::Down);
+  port.on_virtual_key_state_changed(virtual_key(255), KeyState::Down);
+  port.on_virtual_key_state_changed(virtual_key(1), KeyState::Up);
+
+  CHECK(read_replies(some, 3) == std::vector<Reply>{
+    change(virtual_key(1), KeyState::Down, 1),
+    change(virtual_key(255), KeyState::Down, 3),
+    change(virtual_key(1), KeyState::Up, 4),
+  });
+  CHECK(read_replies(all, 4) == std::vector<Reply>{
+    change(virtual_key(1), KeyState::Down, 1),
+    change(virtual_key(2), KeyState::Down, 2),
+    change(virtual_key(255), KeyState::Down, 3),
+    change(virtual_key(1), KeyState::Up, 4),
+  });
+
+  // last virtual key is not confused with others
+  REQUIRE(send_get_virtual_key_state(some, "Virtual255"));
+  REQUIRE(send_get_virtual_key_state(some, "Virtual254"));
+  port.read_messages(handler);
+  CHECK(read_replies(some, 2) == std::vector<Reply>{
+    state(virtual_key(255), KeyState::Down),
+    state(virtual_key(254), KeyState::Up),
+  });
+
+  // a subscriber which connects later gets pressed keys first
+  auto late = connect(port);
+  REQUIRE(late);
+  REQUIRE(send_subscribe(late, { }));
+  port.read_messages(handler);
+  CHECK(read_replies(late, 2) == std::vector<Reply>{
+    change(virtual_key(2), KeyState::Down, 4),
+    change(virtual_key(255), KeyState::Down, 4),
+  });
+
+  // disconnected subscriber is removed
+  some = { };
+  port.read_messages(handler);
+  port.on_virtual_key_state_changed(virtual_key(255), KeyState::Up);
+  CHECK(read_replies(all, 1) == std::vector<Reply>{
+    change(virtual_key(255), KeyState::Up, 5),
+  });
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Reply to pipelined requests in order", "[ControlPort]") {
+  auto port = ControlPort(ipc_id);
+  REQUIRE(port.listen());
+  auto handler = Handler(port);
+  auto control = connect(port);
+  auto subscriber = connect(port);
+  REQUIRE(control);
+  REQUIRE(subscriber);
+  REQUIRE(send_subscribe(subscriber, { "Virtual3" }));
+  port.read_messages(handler);
+  CHECK(read_replies(subscriber, 1) == std::vector<Reply>{
+    change(virtual_key(3), KeyState::Up, 0),
+  });
+
+  // send all requests before reading any reply
+  REQUIRE(send_set_virtual_key_state(control, "Virtual3", KeyState::Down));
+  REQUIRE(send_get_virtual_key_state(control, "Virtual3"));
+  REQUIRE(send_set_virtual_key_state(control, "Virtual3", KeyState::Up));
+  REQUIRE(send_get_virtual_key_state(control, "Virtual3"));
+  REQUIRE(send_get_virtual_key_state(control, "Unknown"));
+  port.read_messages(handler);
+
+  CHECK(read_replies(control, 5) == std::vector<Reply>{
+    state(virtual_key(3), KeyState::Down),
+    state(virtual_key(3), KeyState::Down),
+    state(virtual_key(3), KeyState::Up),
+    state(virtual_key(3), KeyState::Up),
+    state(Key::none, KeyState::Not),
+  });
+  CHECK(read_replies(subscriber, 2) == std::vector<Reply>{
+    change(virtual_key(3), KeyState::Down, 1),
+    change(virtual_key(3), KeyState::Up, 2),
+  });
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Do not trust subscription key count", "[ControlPort]") {
+  auto port = ControlPort(ipc_id);
+  REQUIRE(port.listen());
+  auto handler = Handler(port);
+  auto control = connect(port);
+  REQUIRE(control);
+
+  // count exceeds the names in message
+  REQUIRE(send_subscribe(control, { "Virtual4" }, 0xFFFFFFFFu));
+  port.read_messages(handler);
+  CHECK(read_replies(control, 1) == std::vector<Reply>{
+    change(virtual_key(4), KeyState::Up, 0),
+  });
+
+  port.on_virtual_key_state_changed(virtual_key(4), KeyState::Down);
+  CHECK(read_replies(control, 1) == std::vector<Reply>{
+    change(virtual_key(4), KeyState::Down, 1),
+  });
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Interpret request lines", "[ControlPort]") {
+  auto requests = std::vector<Request>();
+  REQUIRE(interpret_request_line("--press Virtual1 --is-pressed Virtual1",
+    &requests));
+  REQUIRE(requests.size() == 2);
+  CHECK(requests[0].type == RequestType::press);
+  CHECK(requests[0].string == "Virtual1");
+  CHECK(requests[1].type == RequestType::is_pressed);
+
+  REQUIRE(interpret_request_line("  --type 'A \"B\" C'  ", &requests));
+  REQUIRE(requests.size() == 1);
+  CHECK(requests[0].type == RequestType::type_string);
+  CHECK(requests[0].string == "A \"B\" C");
+
+  CHECK(!interpret_request_line("", &requests));
+  CHECK(!interpret_request_line("--press", &requests));
+  CHECK(!interpret_request_line("--type 'A", &requests));
+  CHECK(!interpret_request_line("--stdin", &requests));
+  CHECK(!interpret_request_line("--restart", &requests));
+  CHECK(!interpret_request_line("--unknown", &requests));
+}
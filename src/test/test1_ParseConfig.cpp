@@ -1,6 +1,10 @@
 
 #include "test.h"
 #include "config/ParseConfig.h"
+#include "config/ConfigCache.h"
+#include "config/ContextMatcher.h"
+#include <cstdlib>
+#include <fstream>
 
 namespace {
   Config parse_config(const char* config) {
@@ -352,6 +356,17 @@ TEST_CASE("Config directives", "[ParseConfig]") {
 
 //--------------------------------------------------------------------
 
+TEST_CASE("Server directives", "[ParseConfig]") {
+  auto config = parse_config(R"(
+    @match-automaton
+    @macos-toggle-fn false
+  )");
+  CHECK(config.server_directives == std::vector<std::string>{ "match-automaton" });
+  CHECK_THROWS(parse_config(R"(@match-automaton maybe)"));
+}
+
+//--------------------------------------------------------------------
+
 TEST_CASE("Forward modifiers directive", "[ParseConfig]") {
   CHECK_NOTHROW(parse_config(R"(
     @forward-modifiers
@@ -1153,6 +1168,38 @@ TEST_CASE("Builtin Macros #5", "[ParseConfig]") {
 
 //--------------------------------------------------------------------
 
+TEST_CASE("Memoized macro expansion", "[ParseConfig]") {
+  auto string = R"(
+    key = A
+    append = $0 key
+    B >> append[B] key
+    C >> apply[(append[$0]), X, Y]
+    key = Z
+    append = key $0
+    D >> append[B] key
+    E >> apply[(append[$0]), X, Y]
+  )";
+  auto config = parse_config(string);
+  REQUIRE(config.contexts.size() == 1);
+  REQUIRE(config.contexts[0].outputs.size() == 4);
+  CHECK(format_sequence(config.contexts[0].outputs[0]) == "+B -B +A -A +A -A");
+  CHECK(format_sequence(config.contexts[0].outputs[1]) ==
+    "+X +A -X -A +Y +A -Y -A");
+  CHECK(format_sequence(config.contexts[0].outputs[2]) == "+Z -Z +B -B +Z -Z");
+  CHECK(format_sequence(config.contexts[0].outputs[3]) ==
+    "+Z +X -Z -X +Z +Y -Z -Y");
+
+  // runaway expansion
+  CHECK_THROWS(parse_config("A >> repeat[A, 100000000]"));
+  CHECK_THROWS(parse_config(R"(
+    m1 = repeat[$0, 100]
+    m2 = m1[m1[m1[$0]]]
+    A >> m2[A]
+  )"));
+}
+
+//--------------------------------------------------------------------
+
 TEST_CASE("Top-level Macro", "[ParseConfig]") {
   auto string = R"(
     macro = A >> B ; comment
@@ -1453,3 +1500,205 @@ TEST_CASE("String interpolation", "[ParseConfig]") {
   CHECK(config.actions[0].terminal_command == R"(bcTESTbc)");
   CHECK(config.actions[1].terminal_command == R"(${TEST1 TEST$TEST1)");
 }
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Config cache", "[ParseConfig]") {
+  const auto path = std::filesystem::temp_directory_path() / "keymapper-test";
+  const auto filename = path / "keymapper.conf";
+  const auto include_filename = path / "include.conf";
+  std::filesystem::create_directories(path);
+  const auto write_file = [](const auto& filename, const char* string) {
+    std::ofstream(filename) << string;
+  };
+  write_file(include_filename, "B >> C\n");
+  write_file(filename, R"(
+    @grab-device "Keyboard"
+    Ext = IntlBackslash
+    @include "include.conf"
+    A >> $(echo A)
+    [title=/Title/i device="Device"]
+    Ext{C} >> ^ D
+    [system="Linux" class="Class"]
+    Virtual1 >> E
+  )");
+
+  auto parse = ParseConfig();
+  auto is = std::ifstream(filename);
+  const auto config = parse(is, path);
+  REQUIRE(config.include_filenames.size() == 1);
+
+  const auto cache = ConfigCache(path / "config.cache");
+  REQUIRE(cache.write(filename, config));
+  auto cached = cache.read(filename);
+  REQUIRE(cached.has_value());
+  CHECK(cached->include_filenames == config.include_filenames);
+  CHECK(cached->actions.size() == config.actions.size());
+  CHECK(cached->actions[0].terminal_command == "echo A");
+  CHECK(cached->grab_device_filters.size() == 1);
+  CHECK(cached->grab_device_filters[0].string == "Keyboard");
+  REQUIRE(cached->contexts.size() == config.contexts.size());
+  for (auto i = 0u; i < config.contexts.size(); ++i) {
+    const auto& a = config.contexts[i];
+    const auto& b = cached->contexts[i];
+    CHECK(a.window_title_filter.string == b.window_title_filter.string);
+    CHECK(a.window_title_filter.regex.has_value() == b.window_title_filter.regex.has_value());
+    CHECK(a.device_filter.string == b.device_filter.string);
+    CHECK(a.system_filter_matched == b.system_filter_matched);
+    CHECK(a.outputs == b.outputs);
+    REQUIRE(a.inputs.size() == b.inputs.size());
+    for (auto j = 0u; j < a.inputs.size(); ++j) {
+      CHECK(a.inputs[j].input == b.inputs[j].input);
+      CHECK(a.inputs[j].output_index == b.inputs[j].output_index);
+    }
+  }
+  CHECK(cached->contexts[1].matches("", "title", ""));
+  CHECK(!cached->contexts[1].matches("", "other", ""));
+
+  // changing an include invalidates cache
+  write_file(include_filename, "B >> D\n");
+  CHECK(!cache.read(filename).has_value());
+  REQUIRE(cache.write(filename, config));
+  CHECK(cache.read(filename).has_value());
+
+  // corrupt cache is not used
+  std::filesystem::resize_file(cache.filename(),
+    std::filesystem::file_size(cache.filename()) - 1);
+  CHECK(!cache.read(filename).has_value());
+
+#if !defined(_WIN32)
+  // include paths depending on environment are not cached
+  ::setenv("KEYMAPPER_TEST_INCLUDE", "include.conf", 1);
+  write_file(filename, R"(
+    @include "$KEYMAPPER_TEST_INCLUDE"
+    A >> B
+  )");
+  auto is_expanded = std::ifstream(filename);
+  const auto expanded = ParseConfig()(is_expanded, path);
+  ::unsetenv("KEYMAPPER_TEST_INCLUDE");
+  REQUIRE(expanded.include_filenames.size() == 1);
+  CHECK(expanded.include_filenames[0] == include_filename);
+  CHECK(expanded.include_filenames_expanded);
+  CHECK(!config.include_filenames_expanded);
+  CHECK(!cache.write(filename, expanded));
+  CHECK(!cache.read(filename).has_value());
+#endif
+
+  std::filesystem::remove_all(path);
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Include files", "[ParseConfig]") {
+  const auto path = std::filesystem::temp_directory_path() / "keymapper-test-include";
+  const auto filename = path / "keymapper.conf";
+  std::filesystem::create_directories(path / "apps");
+  const auto write_file = [](const auto& filename, const char* string) {
+    std::ofstream(filename) << string;
+  };
+  write_file(path / "macros.conf", "Ext = IntlBackslash\nKey = A\n");
+  write_file(path / "apps/a.conf", "[title='A']\nExt{B} >> C\n@include 'apps/nested.conf'\n");
+  write_file(path / "apps/nested.conf", "Ext{D} >> \\\n  E\n");
+  write_file(path / "apps/b.conf", "[title='B']\nKey >> $(Ext)\n");
+  write_file(path / "apps/error.conf", "\n\nA >> B >> C\n");
+  write_file(filename, R"(
+    @include "macros.conf"
+    @include "apps/a.conf"
+    @include "apps/b.conf"
+    [default]
+    F >> G
+  )");
+
+  // included files are parsed in declaration order
+  auto parse = ParseConfig();
+  auto is = std::ifstream(filename);
+  auto config = parse(is, path);
+  CHECK(config.include_filenames.size() == 4);
+  REQUIRE(config.contexts.size() == 3);
+  CHECK(config.contexts[0].window_title_filter.string == "A");
+  REQUIRE(config.contexts[0].inputs.size() == 2);
+  CHECK(format_sequence(config.contexts[0].inputs[0].input) ==
+    "+IntlBackslash +B ~B ~IntlBackslash");
+  CHECK(format_sequence(config.contexts[0].inputs[1].input) ==
+    "+IntlBackslash +D ~D ~IntlBackslash");
+  CHECK(config.contexts[1].window_title_filter.string == "B");
+  REQUIRE(config.contexts[1].inputs.size() == 1);
+  CHECK(format_sequence(config.contexts[1].inputs[0].input) == "+A ~A");
+  CHECK(config.actions.back().terminal_command == "Ext");
+  CHECK(config.contexts[2].inputs.size() == 1);
+
+  // errors refer to included file and line
+  write_file(filename, "@include 'macros.conf'\n@include 'apps/a.conf'\n"
+    "@include 'apps/error.conf'\n");
+  is = std::ifstream(filename);
+  try {
+    parse(is, path);
+    FAIL("error expected");
+  }
+  catch (const ParseConfig::ConfigError& error) {
+    const auto message = std::string(error.what());
+    INFO(message);
+    CHECK(message.find("error.conf") != std::string::npos);
+    CHECK(message.find("line 3") != std::string::npos);
+  }
+
+  write_file(filename, "@include 'apps/missing.conf'\n");
+  is = std::ifstream(filename);
+  CHECK_THROWS(parse(is, path));
+
+  std::filesystem::remove_all(path);
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Context matcher", "[ParseConfig]") {
+  auto string = R"(
+    [title = /Title1|Title2/]
+    A >> B
+    [title = /^Title3$/i]
+    A >> C
+    [title = "Title4"]
+    A >> D
+    [class = /^Class1|Class2$/]
+    A >> E
+    [class = "Class3"]
+    A >> F
+    [class = /^Base\d+$/]
+    A >> G
+    [class = /Class3/ title = /\.txt$/]
+    A >> H
+    [class = /Class3/ title = /\.txt$/ path != "/bin/"]
+    A >> I
+    [class = "Class3"]
+    A >> J
+    [path = /\/bin\/|\/sbin\//i]
+    A >> K
+  )";
+  const auto config = parse_config(string);
+  auto matcher = ContextMatcher();
+  matcher.set_contexts(config.contexts);
+
+  const auto classes = { "", "Class1", "Class2", "class2", "Class3",
+    "XClass2", "Class1X", "Base123", "Base" };
+  const auto titles = { "", "Title1", "xTitle2x", "title3", "TITLE3",
+    "Title3x", "Title4", "file.txt", "file.txt2", "filetxt" };
+  const auto paths = { "", "/bin/test", "/SBIN/test", "/usr/bin2" };
+  auto indices = std::vector<int>();
+  auto expected = std::vector<int>();
+
+  // match twice to check cached results
+  for (auto pass = 0; pass < 2; ++pass)
+    for (auto window_class : classes)
+      for (auto window_title : titles)
+        for (auto window_path : paths) {
+          expected.clear();
+          for (auto i = 0; i < static_cast<int>(config.contexts.size()); ++i)
+            if (config.contexts[i].matches(window_class, window_title, window_path))
+              expected.push_back(i);
+          matcher.match(window_class, window_title, window_path, &indices);
+          CHECK(indices == expected);
+        }
+
+  matcher.match("Class3", "file.txt", "/bin/x", &indices);
+  CHECK(indices == (std::vector<int>{ 4, 6, 8, 9 }));
+}
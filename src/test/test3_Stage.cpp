@@ -579,7 +579,7 @@ TEST_CASE("Not Any with ContextActive", "[Stage]") {
     B             >> !Any T
   )";
   Stage stage = create_stage(config, false);
-  REQUIRE(stage.contexts().size() == 1);
+  REQUIRE(stage.context_count() == 1);
   CHECK(format_sequence(stage.set_active_client_contexts({ 0 })) == "+R -R");
 
   CHECK(apply_input(stage, "+A") == "+Virtual1");
@@ -1243,7 +1243,7 @@ TEST_CASE("System context", "[Stage]") {
     commandB >> G
   )";
   Stage stage = create_stage(config);
-  REQUIRE(stage.contexts().size() == 3);
+  REQUIRE(stage.context_count() == 3);
 
 #if defined(__linux__)
   REQUIRE(apply_input(stage, "+A -A") == "+E -E");
@@ -1276,7 +1276,7 @@ TEST_CASE("System context - partially mapped", "[Stage]") {
     commandWindowsDefault >> H
   )";
   Stage stage = create_stage(config);
-  REQUIRE(stage.contexts().size() == 2);
+  REQUIRE(stage.context_count() == 2);
 
 #if defined(__linux__)
   REQUIRE(apply_input(stage, "+A -A") == "+E -E");
@@ -1314,7 +1314,7 @@ TEST_CASE("Mapping sequence in context", "[Stage]") {
     A >> F
   )";
   Stage stage = create_stage(config);
-  REQUIRE(stage.contexts().size() == 4);
+  REQUIRE(stage.context_count() == 4);
   stage.set_active_client_contexts({ 0, 3 }); // No program
 
 #if defined(__linux__)
@@ -1362,7 +1362,7 @@ TEST_CASE("Mapping sequence in context - comparison", "[Stage]") {
     command3 >> Z
   )";
   Stage stage = create_stage(config);
-  REQUIRE(stage.contexts().size() == 4);
+  REQUIRE(stage.context_count() == 4);
   stage.set_active_client_contexts({ 0, 1 }); // No program
 
 #if defined(__linux__)
@@ -1411,7 +1411,7 @@ TEST_CASE("Restore default context", "[Stage]") {
     A >> F
   )";
   Stage stage = create_stage(config);
-  REQUIRE(stage.contexts().size() == 5);
+  REQUIRE(stage.context_count() == 5);
   stage.set_active_client_contexts({ 1, 4 }); // No program
 
 #if defined(__linux__)
@@ -1460,7 +1460,7 @@ TEST_CASE("Context with modifier filter", "[Stage]") {
   )";
   
   Stage stage = create_stage(config);
-  REQUIRE(stage.contexts().size() == 6);
+  REQUIRE(stage.context_count() == 6);
   stage.set_active_client_contexts({ 0, 1, 2, 3 }); // No program
   
   REQUIRE(apply_input(stage, "+A -A") == "+Z -Z");
@@ -1507,7 +1507,7 @@ TEST_CASE("Context with modifier filter #2", "[Stage]") {
   )";
   
   Stage stage = create_stage(config);
-  REQUIRE(stage.contexts().size() == 2);
+  REQUIRE(stage.context_count() == 2);
   
   REQUIRE(apply_input(stage, "+A -A") == "+B -B");
   REQUIRE(apply_input(stage, "+E -E") == "+E -E");
@@ -1517,6 +1517,30 @@ TEST_CASE("Context with modifier filter #2", "[Stage]") {
 
 //--------------------------------------------------------------------
 
+TEST_CASE("Context with modifier filter #3", "[Stage]") {
+  auto config = R"(
+    [modifier="A ShiftLeft !ControlLeft !Virtual1"]
+    E >> F
+  )";
+
+  Stage stage = create_stage(config);
+  REQUIRE(apply_input(stage, "+E -E") == "+E -E");
+  REQUIRE(apply_input(stage, "+A +E -E -A") == "+A +E -E -A");
+  REQUIRE(apply_input(stage, "+A +ShiftLeft +E -E -ShiftLeft -A") ==
+    "+A +ShiftLeft +F -F -ShiftLeft -A");
+  REQUIRE(apply_input(stage, "+ShiftLeft +A +E -E -A -ShiftLeft") ==
+    "+ShiftLeft +A +F -F -A -ShiftLeft");
+  REQUIRE(apply_input(stage, "+A +ShiftLeft +ControlLeft +E -E -ControlLeft -ShiftLeft -A") ==
+    "+A +ShiftLeft +ControlLeft +E -E -ControlLeft -ShiftLeft -A");
+  REQUIRE(apply_input(stage, "+A +ShiftLeft +Virtual1 +E -E") ==
+    "+A +ShiftLeft +E -E");
+  REQUIRE(apply_input(stage, "-Virtual1 +E -E -ShiftLeft -A") ==
+    "+F -F -ShiftLeft -A");
+  REQUIRE(stage.is_clear());
+}
+
+//--------------------------------------------------------------------
+
 TEST_CASE("Context with modifier filter and ContextActive mapping", "[Stage]") {
   auto config = R"(
     [default]
@@ -1538,7 +1562,7 @@ TEST_CASE("Context with modifier filter and ContextActive mapping", "[Stage]") {
   )";
   
   Stage stage = create_stage(config, false);
-  REQUIRE(stage.contexts().size() == 5);
+  REQUIRE(stage.context_count() == 5);
   CHECK(format_sequence(stage.set_active_client_contexts({ 0, 1, 2, 3, 4 })) == "");
   
   CHECK(apply_input(stage, "+A") == "+X +A");
@@ -1584,7 +1608,7 @@ TEST_CASE("Context with modifier filter and string typing", "[Stage]") {
 
   Stage stage = create_stage(config, false);
 
-  REQUIRE(stage.contexts().size() == 2);
+  REQUIRE(stage.context_count() == 2);
   CHECK(format_sequence(stage.set_active_client_contexts({ 0, 1 })) == "+Virtual1");
   CHECK(apply_input(stage, "+Virtual1") == "");
 
@@ -1624,7 +1648,7 @@ TEST_CASE("Context with modifier filter - layer switch", "[Stage]") {
 
   Stage stage = create_stage(config, false);
 
-  REQUIRE(stage.contexts().size() == 4);
+  REQUIRE(stage.context_count() == 4);
   CHECK(format_sequence(stage.set_active_client_contexts({ 0, 1, 2, 3 })) == "+Virtual1");
   CHECK(apply_input(stage, "+Virtual1") == "");
 
@@ -1697,7 +1721,7 @@ TEST_CASE("Focusing window with ContextActive mapping", "[Stage]") {
   )";
   
   Stage stage = create_stage(config, false);
-  REQUIRE(stage.contexts().size() == 2);
+  REQUIRE(stage.context_count() == 2);
 
   // focus first
   CHECK(format_sequence(stage.set_active_client_contexts({ 0 })) == "+A -A");
@@ -1730,7 +1754,7 @@ TEST_CASE("Fallthrough contexts", "[Stage]") {
   )";
   
   Stage stage = create_stage(config, false);
-  REQUIRE(stage.contexts().size() == 4);
+  REQUIRE(stage.context_count() == 4);
 
   CHECK(format_sequence(stage.set_active_client_contexts({ 0 })) == "");
   CHECK(apply_input(stage, "+A +B -A -B") == "+X +B -X -B");
@@ -3281,3 +3305,203 @@ TEST_CASE("String typing input #5", "[Stage]") {
 }
 
 //--------------------------------------------------------------------
+
+TEST_CASE("Input order with different first keys", "[Stage]") {
+  auto config = R"(
+    (B A) >> X
+    A !B C >> Y
+    Any{D} >> Z
+    A >> W
+  )";
+  Stage stage = create_stage(config);
+
+  CHECK(apply_input(stage, "+B") == "");
+  CHECK(apply_input(stage, "+A") == "+X");
+  CHECK(apply_input(stage, "-A") == "-X");
+  CHECK(apply_input(stage, "-B") == "");
+  REQUIRE(stage.is_clear());
+
+  CHECK(apply_input(stage, "+A") == "");
+  CHECK(apply_input(stage, "-A") == "");
+  CHECK(apply_input(stage, "+C") == "+Y");
+  CHECK(apply_input(stage, "-C") == "-Y");
+  REQUIRE(stage.is_clear());
+
+  CHECK(apply_input(stage, "+A") == "");
+  CHECK(apply_input(stage, "+D") == "+Z");
+  CHECK(apply_input(stage, "-D") == "-Z");
+  CHECK(apply_input(stage, "-A") == "");
+  REQUIRE(stage.is_clear());
+
+  CHECK(apply_input(stage, "+A") == "");
+  CHECK(apply_input(stage, "+E") == "+W");
+  CHECK(apply_input(stage, "-E") == "+E -E");
+  CHECK(apply_input(stage, "-A") == "-W");
+  REQUIRE(stage.is_clear());
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Replace context", "[Stage]") {
+  auto config = R"(
+    [default]
+    A >> X
+    [default]
+    B >> Y
+  )";
+  Stage stage = create_stage(config);
+  auto replacement = create_stage(R"(
+    B >> Z
+    C >> W
+  )").get_context(0);
+
+  // output of replaced context is released by trigger
+  CHECK(apply_input(stage, "+A") == "+X");
+  CHECK(apply_input(stage, "+B") == "+Y");
+  stage.replace_context(1, replacement);
+  CHECK(apply_input(stage, "-B") == "-Y");
+  CHECK(apply_input(stage, "-A") == "-X");
+  REQUIRE(stage.is_clear());
+
+  CHECK(apply_input(stage, "+A") == "+X");
+  CHECK(apply_input(stage, "+B") == "+Z");
+  CHECK(apply_input(stage, "-B") == "-Z");
+  CHECK(apply_input(stage, "+C") == "+W");
+  CHECK(apply_input(stage, "-C") == "-W");
+  CHECK(apply_input(stage, "-A") == "-X");
+  REQUIRE(stage.is_clear());
+
+  // unaffected context keeps working
+  CHECK(apply_input(stage, "+A") == "+X");
+  stage.replace_context(1, create_stage("C >> D ^ E").get_context(0));
+  CHECK(apply_input(stage, "-A") == "-X");
+  CHECK(apply_input(stage, "+C") == "+D -D");
+  CHECK(apply_input(stage, "-C") == "+E -E");
+  REQUIRE(stage.is_clear());
+
+  // pending output of replaced context is cancelled
+  CHECK(apply_input(stage, "+C") == "+D -D");
+  stage.replace_context(1, replacement);
+  CHECK(apply_input(stage, "-C") == "");
+  REQUIRE(stage.is_clear());
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Replace context in pool", "[Stage]") {
+  const auto equal = [](const Stage::Context& a, const Stage::Context& b) {
+    return std::equal(a.inputs.begin(), a.inputs.end(),
+        b.inputs.begin(), b.inputs.end(),
+        [](const Stage::Input& a, const Stage::Input& b) {
+          return a.input == b.input && a.output_index == b.output_index;
+        }) &&
+      a.outputs == b.outputs &&
+      std::equal(a.command_outputs.begin(), a.command_outputs.end(),
+        b.command_outputs.begin(), b.command_outputs.end(),
+        [](const Stage::CommandOutput& a, const Stage::CommandOutput& b) {
+          return a.output == b.output && a.index == b.index;
+        }) &&
+      a.modifier_filter == b.modifier_filter &&
+      a.invert_modifier_filter == b.invert_modifier_filter &&
+      a.fallthrough == b.fallthrough;
+  };
+
+  Stage stage = create_stage(R"(
+    A >> X
+    [modifier="Shift"]
+    B >> Y
+    [default]
+    C >> command
+    [default]
+    command >> Z
+  )");
+  const auto larger = create_stage(R"(
+    [modifier="!Control"]
+    B >> Y Y
+    D E >> W
+    F >> V
+  )").get_context(0);
+  const auto smaller = create_stage("G >> U").get_context(0);
+  const auto expected = [&](const Stage::Context& replaced) {
+    auto contexts = std::vector<Stage::Context>();
+    for (auto i = 0; i < static_cast<int>(stage.context_count()); ++i)
+      contexts.push_back(i == 1 ? replaced : stage.get_context(i));
+    return Stage(std::move(contexts));
+  };
+
+  // keep inputs of other contexts, while their output is hold
+  CHECK(apply_input(stage, "+A") == "+X");
+  CHECK(apply_input(stage, "+C") == "+Z");
+  for (const auto* replacement : { &larger, &smaller, &larger }) {
+    const auto other = expected(*replacement);
+    stage.replace_context(1, *replacement);
+    REQUIRE(stage.context_count() == other.context_count());
+    for (auto i = 0; i < static_cast<int>(stage.context_count()); ++i)
+      CHECK(equal(stage.get_context(i), other.get_context(i)));
+  }
+  CHECK(apply_input(stage, "-C") == "-Z");
+  CHECK(apply_input(stage, "-A") == "-X");
+  REQUIRE(stage.is_clear());
+
+  CHECK(apply_input(stage, "+A -A") == "+X -X");
+  CHECK(apply_input(stage, "+D +E -E -D") == "+W -W");
+  CHECK(apply_input(stage, "+F -F") == "+V -V");
+  CHECK(apply_input(stage, "+C -C") == "+Z -Z");
+  CHECK(apply_input(stage, "+ControlLeft +F -F -ControlLeft") ==
+    "+ControlLeft +F -F -ControlLeft");
+  REQUIRE(stage.is_clear());
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Stage image", "[Stage]") {
+  auto config = R"(
+    A >> X
+    [modifier="Shift"]
+    B >> Y
+    [default]
+    B >> Z
+    C{D} >> ^ W
+  )";
+  Stage original = create_stage(config);
+  auto contexts = std::vector<Stage::Context>();
+  auto active_contexts = std::vector<int>();
+  for (auto i = 0; i < static_cast<int>(original.context_count()); ++i) {
+    contexts.push_back(original.get_context(i));
+    active_contexts.push_back(i);
+  }
+
+  const auto writer = StageImageWriter(contexts.begin(), contexts.end());
+  auto buffer = std::vector<uint32_t>((writer.size() + 3) / 4);
+  const auto data = reinterpret_cast<char*>(buffer.data());
+  writer.write(data);
+
+  auto image = StageImage{ };
+  REQUIRE(image.map(data, writer.size()));
+  Stage stage(image);
+  REQUIRE(stage.context_count() == original.context_count());
+  stage.set_active_client_contexts(active_contexts);
+
+  for (auto* s : { &original, &stage }) {
+    CHECK(apply_input(*s, "+A -A") == "+X -X");
+    CHECK(apply_input(*s, "+B -B") == "+Z -Z");
+    CHECK(apply_input(*s, "+ShiftLeft +B -B -ShiftLeft") == "+ShiftLeft +Y -Y -ShiftLeft");
+    CHECK(apply_input(*s, "+C +D -D -C") == "+W -W");
+    REQUIRE(s->is_clear());
+  }
+
+  // truncated or inconsistent images are rejected
+  CHECK(!image.map(data, writer.size() - 4));
+  auto header = StageImage::Header{ };
+  std::memcpy(&header, data, sizeof(header));
+  ++header.input_count;
+  std::memcpy(data, &header, sizeof(header));
+  CHECK(!image.map(data, writer.size()));
+  --header.input_count;
+  std::memcpy(data, &header, sizeof(header));
+  auto context = StageImage::Context{ };
+  std::memcpy(&context, data + sizeof(header), sizeof(context));
+  context.events.end += 1000;
+  std::memcpy(data + sizeof(header), &context, sizeof(context));
+  CHECK(!image.map(data, writer.size()));
+}
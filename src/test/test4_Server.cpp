@@ -20,6 +20,7 @@ namespace {
     bool send_triggered_action(int action) override { m_triggered_actions.push_back(action); return true; }
     bool send_virtual_key_state(Key key, KeyState state) override { return true; }
     bool send_next_key_info(Key key, const DeviceDesc& device_desc) override { return true; }
+    bool send_latency_report(const std::string& report) override { return true; }
 
     bool read_messages(MessageHandler& handler, 
         std::optional<Duration> timeout) override {
@@ -69,6 +70,14 @@ namespace {
       read_client_messages();
     }
 
+    void set_directives(std::vector<std::string> directives) {
+      m_client.inject_client_message([directives = std::move(directives)](
+          ClientPort::MessageHandler& handler) {
+        handler.on_directives_message(directives);
+      });
+      read_client_messages();
+    }
+
     std::string set_active_contexts(std::vector<int> indices) {
       m_client.inject_client_message([indices = std::move(indices)](
           ClientPort::MessageHandler& handler) mutable {
@@ -557,3 +566,30 @@ TEST_CASE("Multi staging - ContextActive", "[Server]") {
   CHECK(state.set_active_contexts({ 0, 1 }) == "+A -A +D -D");
   CHECK(state.set_active_contexts({ 1 }) == "+B -B");
 }
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Match automaton directive", "[Server]") {
+  auto multi_stage = create_multi_stage(R"(
+    A B >> C
+    ? X >> Y
+  )");
+  const auto& stage = *multi_stage->stages().front();
+  auto client = std::make_unique<ClientPortImpl>();
+  auto client_ptr = client.get();
+  auto state = State(std::move(client), client_ptr);
+  state.set_configuration(std::move(multi_stage));
+  state.set_active_contexts({ 0 });
+
+  state.set_directives({ "match-automaton" });
+  CHECK(stage.match_automaton_enabled());
+  CHECK(state.apply_input("+A") == "");
+  CHECK(state.apply_input("+B") == "+C");
+  CHECK(state.apply_input("-B") == "-C");
+  CHECK(state.apply_input("-A") == "");
+  CHECK(state.apply_input("+X") == "+Y");
+  CHECK(state.apply_input("-X") == "-Y");
+
+  state.set_directives({ });
+  CHECK(!stage.match_automaton_enabled());
+}
@@ -81,3 +81,51 @@ TEST_CASE("Fuzz no might match", "[Fuzz]") {
     REQUIRE(stage.history_size() < 8);
   }
 }
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Fuzz match automaton", "[Fuzz]") {
+  const auto device_index = 0;
+  auto config = R"(
+    (A B) >> X
+    A{B} >> Y
+    A !B C >> Z
+    B !250ms >> 1
+    C{250ms} >> 2
+    Any{D} >> 3
+    A B C >> 4
+    D 500ms E >> 5
+    ? A B >> 6
+    (C D){E} >> 7
+    E !A >> 8
+    B !A B >> 9
+    A >> Q
+  )";
+  Stage stage = create_stage(config);
+  Stage automaton_stage = create_stage(config);
+  automaton_stage.set_match_automaton_enabled(true);
+
+  auto keys = std::vector<Key>();
+  for (auto k : { "A", "B", "C", "D", "E", "F" })
+    keys.push_back(parse_input(k).front().key);
+  auto pressed = std::set<Key>();
+
+  auto rand = std::mt19937(0);
+  auto dist = std::uniform_int_distribution<size_t>(0, keys.size());
+  for (auto i = 0; i < 5000; i++) {
+    auto event = reply_timeout_ms(static_cast<int>(rand() % 600));
+    if (const auto k = dist(rand); k < keys.size()) {
+      const auto key = keys[k];
+      if (auto it = pressed.find(key); it != end(pressed)) {
+        pressed.erase(it);
+        event = { key, KeyState::Up };
+      }
+      else {
+        pressed.insert(key);
+        event = { key, KeyState::Down };
+      }
+    }
+    REQUIRE(format_sequence(stage.update(event, device_index)) ==
+            format_sequence(automaton_stage.update(event, device_index)));
+  }
+}
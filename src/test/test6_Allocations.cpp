@@ -0,0 +1,147 @@
+#include "test.h"
+#include "runtime/Timeout.h"
+#include "server/ServerState.h"
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <set>
+
+namespace {
+  bool g_count_allocations;
+  size_t g_allocation_count;
+
+  class ClientPortImpl : public IClientPort {
+  public:
+    Socket socket() const override { return 0; }
+    Socket listen_socket() const override { return 0; }
+    bool version_mismatch() const override { return false; }
+    bool listen() override { return false; }
+    bool accept() override { return false; }
+    void disconnect() override { }
+    bool send_triggered_action(int action) override { return true; }
+    bool send_virtual_key_state(Key key, KeyState state) override { return true; }
+    bool send_next_key_info(Key key, const DeviceDesc& device_desc) override { return true; }
+    bool send_latency_report(const std::string& report) override { return true; }
+    bool read_messages(MessageHandler& handler,
+        std::optional<Duration> timeout) override { return true; }
+  };
+
+  class State : public ServerState {
+  public:
+    explicit State(MultiStagePtr multi_stage)
+      : ServerState(std::make_unique<ClientPortImpl>()) {
+      const auto context_count = multi_stage->context_count();
+      on_configuration_message(std::move(multi_stage));
+      auto indices = std::vector<int>();
+      for (auto i = 0u; i < context_count; ++i)
+        indices.push_back(static_cast<int>(i));
+      on_active_contexts_message(indices);
+      set_device_descs({ DeviceDesc{ "Device0" } });
+    }
+
+    bool on_send_key(const KeyEvent& event) override { return true; }
+    void on_exit_requested() override { }
+    void on_grab_device_filters_message(
+        std::vector<GrabDeviceFilter> filters) override { }
+
+    // returns the number of heap allocations
+    size_t apply_input(const KeyEvent& event) {
+      g_allocation_count = 0;
+      g_count_allocations = true;
+      if (event.key == Key::timeout) {
+        cancel_timeout();
+        translate_input(event, Stage::any_device_index);
+      }
+      else {
+        translate_input(event, 0);
+      }
+      if (!flush_scheduled_at())
+        flush_send_buffer();
+      g_count_allocations = false;
+      return g_allocation_count;
+    }
+  };
+
+  // random presses and releases, with up to 4 keys held
+  KeySequence generate_input(int count, std::mt19937& rand) {
+    auto keys = std::vector<Key>();
+    for (auto k : { "A", "B", "C", "D", "E", "F", "ShiftLeft" })
+      keys.push_back(parse_input(k).front().key);
+
+    auto input = KeySequence();
+    auto pressed = std::set<Key>();
+    while (static_cast<int>(input.size()) < count) {
+      if (rand() % 8 == 0) {
+        input.push_back(reply_timeout_ms(static_cast<int>(rand() % 600)));
+        continue;
+      }
+      const auto key = keys[rand() % keys.size()];
+      if (pressed.count(key) || pressed.size() >= 4) {
+        const auto release = (pressed.count(key) ? key : *pressed.begin());
+        pressed.erase(release);
+        input.emplace_back(release, KeyState::Up);
+      }
+      else {
+        pressed.insert(key);
+        input.emplace_back(key, KeyState::Down);
+      }
+    }
+    for (auto key : pressed)
+      input.emplace_back(key, KeyState::Up);
+    return input;
+  }
+
+  const auto allocations_config = R"(
+    (A B) >> X
+    A{B} >> Y
+    A !B C >> Z
+    B !250ms >> 1
+    C{250ms} >> 2
+    Any{D} >> 3
+    A B C >> 4
+    D 500ms E >> 5
+    ? A B >> 6
+    (C D){E} >> 7
+    E !A >> 8
+    B !A B >> 9
+    ShiftLeft{F} >> ^ Q W
+    A >> Q
+
+    [stage]
+    Q >> ShiftLeft{W}
+    X Y >> Z
+  )";
+} // namespace
+
+void* operator new(size_t size) {
+  if (g_count_allocations)
+    ++g_allocation_count;
+  if (auto p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("No allocations after warm-up", "[Allocations]") {
+  for (auto match_automaton : { false, true }) {
+    auto multi_stage = create_multi_stage(allocations_config);
+    multi_stage->set_match_automaton_enabled(match_automaton);
+    auto state = State(std::move(multi_stage));
+
+    auto rand = std::mt19937(0);
+    for (const auto& event : generate_input(5000, rand))
+      state.apply_input(event);
+
+    for (const auto& event : generate_input(5000, rand))
+      REQUIRE(state.apply_input(event) == 0);
+  }
+}
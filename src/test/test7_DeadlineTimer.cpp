@@ -0,0 +1,55 @@
+
+#include "test.h"
+#include "server/unix/DeadlineTimer.h"
+#include "common/Duration.h"
+#include <poll.h>
+
+namespace {
+  using namespace std::chrono;
+
+  bool wait_for_timer(DeadlineTimer& timer, milliseconds timeout) {
+    auto fd = pollfd{ timer.fd(), POLLIN, 0 };
+    return (::poll(&fd, 1, static_cast<int>(timeout.count())) == 1 &&
+      timer.acknowledge());
+  }
+} // namespace
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Deadline timer fires at deadline", "[DeadlineTimer]") {
+  auto timer = DeadlineTimer();
+  REQUIRE(timer.fd() >= 0);
+
+  for (auto timeout_ms : { 1, 2, 5, 10, 20 }) {
+    const auto deadline = Clock::now() + milliseconds(timeout_ms);
+    REQUIRE(timer.set(deadline));
+    CHECK(wait_for_timer(timer, milliseconds(1000)));
+
+    // never fires too early
+    CHECK(Clock::now() >= deadline);
+  }
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Deadline timer rearming", "[DeadlineTimer]") {
+  auto timer = DeadlineTimer();
+  REQUIRE(timer.fd() >= 0);
+
+  // deadline in the past fires immediately
+  REQUIRE(timer.set(Clock::now() - milliseconds(1)));
+  CHECK(wait_for_timer(timer, milliseconds(0)));
+  CHECK(!wait_for_timer(timer, milliseconds(0)));
+
+  // disarming
+  REQUIRE(timer.set(Clock::now() + milliseconds(2)));
+  REQUIRE(timer.set(std::nullopt));
+  CHECK(!wait_for_timer(timer, milliseconds(10)));
+
+  // moving deadline
+  const auto deadline = Clock::now() + milliseconds(5);
+  REQUIRE(timer.set(Clock::now() + milliseconds(500)));
+  REQUIRE(timer.set(deadline));
+  CHECK(wait_for_timer(timer, milliseconds(1000)));
+  CHECK(Clock::now() >= deadline);
+}
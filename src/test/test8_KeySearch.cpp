@@ -0,0 +1,56 @@
+
+#include "test.h"
+#include "runtime/KeySearch.h"
+#include <random>
+
+namespace {
+  KeySequence generate_sequence(std::mt19937& rand, size_t size) {
+    auto sequence = KeySequence();
+    for (auto i = 0u; i < size; ++i)
+      sequence.emplace_back(static_cast<Key>(1 + rand() % 8),
+        static_cast<KeyState>(rand() % 3),
+        static_cast<KeyEvent::value_t>(rand() % 2));
+    return sequence;
+  }
+} // namespace
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Search keys and events", "[KeySearch]") {
+  using namespace key_search;
+  auto rand = std::mt19937(0);
+  for (auto size = 0u; size < 40; ++size)
+    for (auto i = 0; i < 20; ++i) {
+      const auto sequence = generate_sequence(rand, size);
+      const auto begin = sequence.data();
+      const auto end = begin + sequence.size();
+      const auto key = static_cast<Key>(1 + rand() % 10);
+      const auto event = KeyEvent(key, static_cast<KeyState>(rand() % 3),
+        static_cast<KeyEvent::value_t>(rand() % 2));
+
+      CHECK(find_key(begin, end, key) == find_key_scalar(begin, end, key));
+      CHECK(rfind_key(begin, end, key) == rfind_key_scalar(begin, end, key));
+      CHECK(find_event(begin, end, event) ==
+        find_event_scalar(begin, end, event));
+
+      auto keys = std::vector<Key>();
+      for (const auto& e : sequence)
+        keys.push_back(e.key);
+      CHECK(contains_key(keys, key) ==
+        contains_key_scalar(keys.data(), keys.data() + keys.size(), key));
+    }
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Search keys in containers", "[KeySearch]") {
+  auto sequence = parse_sequence("+A +B -A +C -B +A");
+  CHECK(find_key(sequence, Key::A) == sequence.begin());
+  CHECK(rfind_key(sequence, Key::A) == sequence.end() - 1);
+  CHECK(find_key(sequence, Key::C) == sequence.begin() + 3);
+  CHECK(find_key(sequence, Key::D) == sequence.end());
+  CHECK(rfind_key(sequence, Key::D) == sequence.end());
+  CHECK(contains_event(sequence, KeyEvent(Key::B, KeyState::Up)));
+  CHECK(!contains_event(sequence, KeyEvent(Key::C, KeyState::Up)));
+  CHECK(!contains_event(KeySequence(), KeyEvent(Key::C, KeyState::Up)));
+}
@@ -0,0 +1,161 @@
+
+#include "test.h"
+#include "client/FileWatcher.h"
+#include "client/ConfigFile.h"
+#include <cstdlib>
+#include <fstream>
+#include <poll.h>
+
+namespace {
+  namespace fs = std::filesystem;
+
+  bool wait_for_change(FileWatcher& watcher, int timeout_ms = 1000) {
+    auto fd = pollfd{ watcher.fd(), POLLIN, 0 };
+    return (::poll(&fd, 1, timeout_ms) == 1 && watcher.read_changes());
+  }
+
+  void write_file(const fs::path& filename, const char* contents) {
+    std::ofstream(filename) << contents;
+  }
+
+  struct TempDirectory {
+    fs::path path;
+
+    TempDirectory() {
+      auto name = std::string("keymapper-test-XXXXXX");
+      path = fs::temp_directory_path() / name;
+      auto string = path.string();
+      if (::mkdtemp(string.data()))
+        path = string;
+    }
+    ~TempDirectory() {
+      auto error = std::error_code{ };
+      fs::remove_all(path, error);
+    }
+  };
+} // namespace
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Watch files", "[FileWatcher]") {
+  auto dir = TempDirectory();
+  const auto config = dir.path / "keymapper.conf";
+  const auto include = dir.path / "include.conf";
+  const auto other = dir.path / "other.conf";
+  write_file(config, "A >> B");
+  write_file(include, "C >> D");
+
+  auto watcher = FileWatcher();
+  REQUIRE(watcher.watch({ config, include }));
+  REQUIRE(watcher.fd() >= 0);
+  CHECK(!watcher.read_changes());
+
+  // writing
+  write_file(include, "C >> E");
+  CHECK(wait_for_change(watcher));
+  CHECK(!watcher.read_changes());
+
+  // other files in directory are ignored
+  write_file(other, "E >> F");
+  CHECK(!wait_for_change(watcher, 50));
+
+  // replacing by renaming
+  write_file(other, "A >> C");
+  fs::rename(other, config);
+  CHECK(wait_for_change(watcher));
+
+  // removing and creating
+  fs::remove(include);
+  CHECK(wait_for_change(watcher));
+  write_file(include, "C >> D");
+  CHECK(wait_for_change(watcher));
+
+  watcher.reset();
+  CHECK(watcher.fd() < 0);
+  CHECK(!watcher.read_changes());
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Watch symlinked file", "[FileWatcher]") {
+  auto dir = TempDirectory();
+  fs::create_directory(dir.path / "dotfiles");
+  const auto target = dir.path / "dotfiles" / "keymapper.conf";
+  const auto config = dir.path / "keymapper.conf";
+  write_file(target, "A >> B");
+  fs::create_symlink(target, config);
+
+  auto watcher = FileWatcher();
+  REQUIRE(watcher.watch({ config }));
+
+  // writing to target is noticed, although its directory is not watched
+  write_file(target, "A >> C");
+  CHECK(wait_for_change(watcher));
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Update watched files", "[FileWatcher]") {
+  auto dir = TempDirectory();
+  fs::create_directory(dir.path / "include");
+  const auto config = dir.path / "keymapper.conf";
+  const auto include = dir.path / "include" / "include.conf";
+  write_file(config, "A >> B");
+  write_file(include, "C >> D");
+
+  auto watcher = FileWatcher();
+  REQUIRE(watcher.watch({ config }));
+  const auto fd = watcher.fd();
+
+  // change while watches are updated is not lost
+  write_file(config, "A >> C");
+  REQUIRE(watcher.watch({ config, include }));
+  CHECK(watcher.fd() == fd);
+  CHECK(wait_for_change(watcher));
+
+  write_file(include, "C >> E");
+  CHECK(wait_for_change(watcher));
+
+  // no longer watched
+  REQUIRE(watcher.watch({ config }));
+  write_file(include, "C >> F");
+  CHECK(!wait_for_change(watcher, 50));
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Only update config when contents changed", "[ConfigFile]") {
+  auto dir = TempDirectory();
+  ::setenv("XDG_CACHE_HOME", dir.path.c_str(), 1);
+  const auto config = dir.path / "keymapper.conf";
+  const auto include = dir.path / "include.conf";
+  write_file(config, "@include \"include.conf\"\nA >> B");
+  write_file(include, "C >> D");
+
+  auto config_file = ConfigFile();
+  REQUIRE(config_file.load(config));
+  CHECK(config_file.config().contexts.size() == 1);
+  CHECK(!config_file.update(true));
+
+  const auto touch = [](const fs::path& filename) {
+    fs::last_write_time(filename,
+      fs::last_write_time(filename) + std::chrono::seconds(1));
+  };
+
+  // only modification time changed
+  touch(config);
+  CHECK(!config_file.update(true));
+  touch(include);
+  CHECK(!config_file.update(true));
+
+  // same second, but different contents
+  const auto time = fs::last_write_time(include);
+  write_file(include, "C >> E");
+  fs::last_write_time(include, time + std::chrono::milliseconds(1));
+  CHECK(config_file.update(true));
+  CHECK(!config_file.update(true));
+
+  // forced
+  CHECK(config_file.update(false));
+  ::unsetenv("XDG_CACHE_HOME");
+}